@@ -19,9 +19,14 @@
   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <map>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -36,33 +41,63 @@ namespace py = pybind11;
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
 
-#ifdef PYMEM_MALLOC
-#define malloc PyMem_Malloc
-#define realloc PyMem_Realloc
-#define free PyMem_Free
-#endif
-
 #define SCL_PY_PRINTF
 #include "../src/SCL/sclpython.h"
 
 #define FCELIB_PYTHON_BINDINGS  // avoid some deterministic checks
 #include "../src/fcelib/fcelib.h"
 
+#ifdef PYMEM_MALLOC
+// fcelib allocator: Python raw memory domain is thread-safe and traced by tracemalloc
+void *FCECODECMODULE_Malloc(void *, size_t size) { return PyMem_RawMalloc(size); }
+void *FCECODECMODULE_Realloc(void *, void *ptr, size_t size) { return PyMem_RawRealloc(ptr, size); }
+void FCECODECMODULE_Free(void *, void *ptr) { PyMem_RawFree(ptr); }
+#endif
+
+// fcelib parallel for: runs tasks on up to hardware_concurrency threads, pulling indexes from a shared counter
+void FCECODECMODULE_ParallelFor(void *, const int n, FcelibTaskFn fn, void *arg)
+{
+  const int num_threads = std::min(n, static_cast<int>(std::thread::hardware_concurrency()));
+  if (num_threads < 2)
+  {
+    for (int i = 0; i < n; ++i)
+      fn(arg, i);
+    return;
+  }
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < n; i = next++)
+      fn(arg, i);
+  };
+  std::vector<std::thread> threads;
+  for (int k = 1; k < num_threads; ++k)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+}
+
 /* classes, structs --------------------------------------------------------- */
 
 class Mesh : public FcelibMesh
 {
 public:
   Mesh() : mesh_(*this) { FCELIB_MeshInit(&mesh_); }
-  ~Mesh() { FCELIB_MeshRelease(&mesh_); }
+  Mesh(const Mesh &other);
+  Mesh(Mesh &&other) noexcept : FcelibMesh(other), mesh_(*this), journal_(other.journal_) { FCELIB_MeshInit(&other.mesh_); other.journal_ = nullptr; }
+  Mesh &operator=(const Mesh &) = delete;
+  ~Mesh() { JournalDisable(); FCELIB_MeshRelease(&mesh_); }
 
 #if !defined(SCL_DEBUG) || SCL_DEBUG != 0
   // Service
   bool MValid() const { return FCELIB_MeshValidate(&mesh_); }
 #endif
+  Mesh MCopy() const { return Mesh(*this); }
+  Mesh MDeepCopy(py::dict /* memo */) const { return Mesh(*this); }
 
   // Stats
   void PrintInfo() const { FCELIB_PrintMeshInfo(&mesh_); }
+  py::dict MMemoryStats() const;
 #if !defined(SCL_DEBUG) || SCL_DEBUG != 0
   void PrintParts(void) const { FCELIB_PrintMeshParts(&mesh_); }
   void PrintTriags(void) const { FCELIB_PrintMeshTriangles(&mesh_); }
@@ -72,17 +107,32 @@ public:
   int MNumTriags() const { return mesh_.hdr.NumTriangles; }
   int MNumVerts() const { return mesh_.hdr.NumVertices; }
 
+  // Journal
+  void JournalEnable(const long budget);
+  void JournalDisable();
+  py::dict MJournalStats();
+  bool Undo();
+  bool Redo();
+
   // i/o
   void IoDecode(const std::string &buf);
-  py::bytes IoEncode_Fce3(const bool center_parts) const;
-  py::bytes IoEncode_Fce4(const bool center_parts) const;
-  py::bytes IoEncode_Fce4M(const bool center_parts) const;
+  py::bytes IoEncode_Fce3(const bool center_parts);
+  py::bytes IoEncode_Fce4(const bool center_parts);
+  py::bytes IoEncode_Fce4M(const bool center_parts);
+  void IoDecode_Snapshot(const std::string &buf);
+  py::bytes IoEncode_Snapshot() const;
   void IoExportObj(const std::string &objpath, const std::string &mtlpath,
                    const std::string &texture_name,
                    const int print_damage, const int print_dummies,
                    const int use_part_positions,
                    const int print_part_positions,
                    const int filter_triagflags_0xfff) const;
+  py::tuple IoEncode_Obj(const std::string &objname, const std::string &mtlname,
+                         const std::string &texture_name,
+                         const int print_damage, const int print_dummies,
+                         const int use_part_positions,
+                         const int print_part_positions,
+                         const int filter_triagflags_0xfff) const;
   int IoGeomDataToNewPart(py::array_t<int, py::array::c_style | py::array::forcecast> vert_idxs,
                           py::array_t<float, py::array::c_style | py::array::forcecast> vert_texcoords,
                           py::array_t<float, py::array::c_style | py::array::forcecast> vert_pos,
@@ -90,9 +140,9 @@ public:
 
   // Mesh / Header
   int MGetNumArts() const { return mesh_.hdr.NumArts; }
-  void MSetNumArts(const int NumArts) { mesh_.hdr.NumArts = NumArts; }
+  void MSetNumArts(const int NumArts) { RecordStep_({}); mesh_.hdr.NumArts = NumArts; }
   int MGetUnknown3() const { return mesh_.hdr.Unknown3; }
-  void MSetUnknown3(const int Unknown3) { mesh_.hdr.Unknown3 = Unknown3; }
+  void MSetUnknown3(const int Unknown3) { RecordStep_({}); mesh_.hdr.Unknown3 = Unknown3; }
   py::buffer MGetColors(void) const;
   void MSetColors(py::array_t<unsigned char, py::array::c_style | py::array::forcecast> arr);
   std::vector<std::string> GetDummyNames() const;
@@ -118,6 +168,19 @@ public:
   py::buffer PGetTriagsTexpages(const int pid) const;
   void PSetTriagsTexpages(const int pid, py::array_t<int, py::array::c_style | py::array::forcecast> arr);
 
+  // Queries
+  py::buffer PGetTriagsNeighbors(const int pid);
+  py::tuple PGetVertTriags(const int pid);
+  py::buffer PGetBoundaryEdges(const int pid);
+  py::buffer PGetComponents(const int pid) const;
+  py::buffer PFindSymmetry(const int pid_a, const int pid_b, const float eps, const int axis) const;
+  py::tuple PRaycast(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> origin,
+                     py::array_t<float, py::array::c_style | py::array::forcecast> dir);
+  py::tuple PRaycastBatch(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> origins,
+                          py::array_t<float, py::array::c_style | py::array::forcecast> dirs);
+  py::tuple PClosestPoint(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> point);
+  py::tuple PClosestPointBatch(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> points);
+
   // Verts
   py::buffer MVertsGetMap_idx2order() const;
 
@@ -136,64 +199,223 @@ public:
   int OpAddHelperPart(const std::string &s, py::array_t<float, py::array::c_style | py::array::forcecast> new_center);
   bool OpCenterPart(const int pid);
   bool OpSetPartCenter(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> new_center);
+  bool OpComputeNormals(const int pid, const std::string &mode, const py::object &crease_angle, const bool apply_to_damage);
+  bool OpTransform(py::array_t<float, py::array::c_style | py::array::forcecast> matrix, const py::object &pids,
+                   const bool apply_to_damage, const bool transform_normals);
+  bool OpGenerateDamage(const py::object &pids, py::array_t<float, py::array::c_style | py::array::forcecast> impact_points,
+                        const float radius, const float strength, const unsigned long seed, const py::object &crease_angle);
+  int OpMirrorPart(const int pid, const int axis, const std::string &new_name);
   int OpCopyPart(const int pid_src);
   int OpInsertPart(Mesh *mesh_src, const int pid_src);
   bool OpDeletePart(const int pid);
   bool OpDeletePartTriags(const int pid, const std::vector<int> &idxs);
-  bool OpDelUnrefdVerts() { return FCELIB_DeleteUnrefdVerts(&mesh_); }
+  bool OpDeleteTriags(py::array_t<int, py::array::c_style | py::array::forcecast> pids,
+                      py::array_t<int, py::array::c_style | py::array::forcecast> idxs);
+  bool OpDeleteTriagsDict(const std::map<int, std::vector<int> > &triags);
+  bool OpSortPartTriags(const int pid, const std::string &key, const int mask);
+  bool OpOptimizeVertexCache(const int pid, const bool reorder_verts);
+  int OpSplitPart(const int pid, const int mask, const int value, const std::string &key);
+  int OpSplitComponents(const int pid);
+  bool OpDelUnrefdVerts(const bool compact);
+  bool OpDelPartUnrefdVerts(const int pid, const bool compact);
+  int OpWeldVertices(const int pid, const float epsilon, const bool compare_normals, const bool compare_damage);
+  int OpDecimatePart(const int pid, const int target_triags, const bool preserve_uv_seams);
   int OpMergeParts(const int pid1, const int pid2);
+  int OpMergePartsList(const std::vector<int> &pids);
   int OpMovePart(const int pid);
+  bool OpReorderParts(const std::vector<int> &new_order);
+  bool OpSortPartsToFce3Order() { RecordStep_({}); return FCELIB_SortPartsToFce3Order(&mesh_); }
+  bool OpSortPartsToFce4Order() { RecordStep_({}); return FCELIB_SortPartsToFce4Order(&mesh_); }
 
 private:
   FcelibMesh *Get_mesh_() { return &mesh_; }
+  static int TriagKey_(const std::string &key, const char *caller);
+  const FcelibBvh *GetBvh_(const int pid, const char *caller);
+  const FcelibAdjacency *GetAdjacency_(const int pid, const char *caller);
+  void RecordStep_(const std::vector<int> &pids);
+  void RecordStep_();
   FcelibMesh& mesh_;
+  FcelibJournal *journal_ = nullptr;
 };
 
 /* Mesh:: wrappers ---------------------------------------------------------- */
+
+Mesh::Mesh(const Mesh &other) : FcelibMesh(), mesh_(*this)
+{
+  FCELIB_MeshInit(&mesh_);
+  if (!FCELIB_MeshClone(&mesh_, &other.mesh_))
+    throw std::runtime_error("Mesh: Cannot copy mesh");
+}
+
+/* stats ---------------------------- */
+
+py::dict Mesh::MMemoryStats() const
+{
+  FcelibMemoryStats stats;
+  FCELIB_MeshMemoryStats(&mesh_, &stats);
+  py::dict result;
+  result["parts_bytes"] = stats.parts_bytes;
+  result["triangles_bytes"] = stats.triangles_bytes;
+  result["vertices_bytes"] = stats.vertices_bytes;
+  result["index_bytes"] = stats.index_bytes;
+  result["total_bytes"] = stats.total_bytes;
+  result["NumParts"] = stats.NumParts;
+  result["parts_len"] = stats.parts_len;
+  result["NumTriangles"] = stats.NumTriangles;
+  result["triangles_len"] = stats.triangles_len;
+  result["NumVertices"] = stats.NumVertices;
+  result["vertices_len"] = stats.vertices_len;
+  result["ptriangles_len"] = stats.ptriangles_len;
+  result["pvertices_len"] = stats.pvertices_len;
+  result["fragmentation"] = stats.fragmentation;
+  return result;
+}
+
+/* journal -------------------------- */
+
+void Mesh::JournalEnable(const long budget)
+{
+  if (journal_)
+  {
+    FCELIB_JournalSetBudget(journal_, budget);
+    return;
+  }
+  journal_ = new FcelibJournal();
+  FCELIB_JournalInit(journal_, budget);
+}
+
+void Mesh::JournalDisable()
+{
+  if (!journal_)
+    return;
+  FCELIB_JournalRelease(journal_);
+  delete journal_;
+  journal_ = nullptr;
+}
+
+py::dict Mesh::MJournalStats()
+{
+  if (journal_ && FCELIB_JournalRecord(journal_, &mesh_) < 0)
+    throw std::runtime_error("Journal: Cannot record step");
+  py::dict result;
+  result["enabled"] = journal_ != nullptr;
+  result["undo_steps"] = journal_ ? journal_->cursor : 0;
+  result["redo_steps"] = journal_ ? journal_->num_steps - journal_->cursor : 0;
+  result["bytes"] = journal_ ? journal_->bytes : 0;
+  result["budget"] = journal_ ? journal_->budget : 0;
+  return result;
+}
+
+bool Mesh::Undo()
+{
+  if (!journal_)
+    throw std::runtime_error("Undo: Journal is not enabled");
+  const int retv = FCELIB_JournalUndo(journal_, &mesh_);
+  if (retv < 0)
+    throw std::runtime_error("Undo: Cannot revert step");
+  return retv > 0;
+}
+
+bool Mesh::Redo()
+{
+  if (!journal_)
+    throw std::runtime_error("Redo: Journal is not enabled");
+  const int retv = FCELIB_JournalRedo(journal_, &mesh_);
+  if (retv < 0)
+    throw std::runtime_error("Redo: Cannot re-apply step");
+  return retv > 0;
+}
+
+// Seals changes since the last step into a step, then saves parts pids (order) for the next step.
+// Called on entry of each mesh-modifying method. pids: parts the method modifies or deletes.
+void Mesh::RecordStep_(const std::vector<int> &pids)
+{
+  static const int none = -1;
+  if (journal_ && !FCELIB_JournalBegin(journal_, &mesh_, pids.empty() ? &none : pids.data(), static_cast<int>(pids.size())))
+    throw std::runtime_error("Journal: Cannot record step");
+}
+
+// Same, for methods that may modify any part.
+void Mesh::RecordStep_()
+{
+  if (journal_ && !FCELIB_JournalBegin(journal_, &mesh_, NULL, 0))
+    throw std::runtime_error("Journal: Cannot record step");
+}
+
 /* i/o ------------------------------ */
 
 void Mesh::IoDecode(const std::string &buf)
 {
+  RecordStep_();
   if (!FCELIB_DecodeFce(&mesh_, buf.c_str(), buf.size()))
     throw std::runtime_error("IoDecode: Cannot parse FCE data");
 }
 
-py::bytes Mesh::IoEncode_Fce3(const bool center_parts) const
+py::bytes Mesh::IoEncode_Fce3(const bool center_parts)
 {
+  if (center_parts)
+    RecordStep_();  // centers parts in place
   const int bufsz_ = FCELIB_FCETYPES_Fce3ComputeSize(mesh_.hdr.NumVertices, mesh_.hdr.NumTriangles);
-  unsigned char *buf_ = (unsigned char *)malloc(bufsz_ * sizeof(*buf_));
+  unsigned char *buf_ = (unsigned char *)FCELIB_Malloc(bufsz_ * sizeof(*buf_));
   if (!buf_)
     throw std::runtime_error("IoEncode_Fce3: Cannot allocate memory");
   if (!FCELIB_EncodeFce3(&mesh_, &buf_, bufsz_, static_cast<int>(center_parts)))
     throw std::runtime_error("IoEncode_Fce3: Cannot encode FCE3");
   py::bytes result = py::bytes((char *)buf_, bufsz_);
-  free(buf_);
+  FCELIB_Free(buf_);
   return result;
 }
 
-py::bytes Mesh::IoEncode_Fce4(const bool center_parts) const
+py::bytes Mesh::IoEncode_Fce4(const bool center_parts)
 {
+  if (center_parts)
+    RecordStep_();  // centers parts in place
   const int bufsz_ = FCELIB_FCETYPES_Fce4ComputeSize(0x00101014, mesh_.hdr.NumVertices, mesh_.hdr.NumTriangles);
-  unsigned char *buf_ = (unsigned char *)malloc(bufsz_ * sizeof(*buf_));
+  unsigned char *buf_ = (unsigned char *)FCELIB_Malloc(bufsz_ * sizeof(*buf_));
   if (!buf_)
     throw std::runtime_error("IoEncode_Fce4: Cannot allocate memory");
   if (!FCELIB_EncodeFce4(&mesh_, &buf_, bufsz_, static_cast<int>(center_parts)))
     throw std::runtime_error("IoEncode_Fce4: Cannot encode FCE4");
   py::bytes result = py::bytes((char *)buf_, bufsz_);
-  free(buf_);
+  FCELIB_Free(buf_);
   return result;
 }
 
-py::bytes Mesh::IoEncode_Fce4M(const bool center_parts) const
+py::bytes Mesh::IoEncode_Fce4M(const bool center_parts)
 {
+  if (center_parts)
+    RecordStep_();  // centers parts in place
   const int bufsz_ = FCELIB_FCETYPES_Fce4ComputeSize(0x00101015, mesh_.hdr.NumVertices, mesh_.hdr.NumTriangles);
-  unsigned char *buf_ = (unsigned char *)malloc(bufsz_ * sizeof(*buf_));
+  unsigned char *buf_ = (unsigned char *)FCELIB_Malloc(bufsz_ * sizeof(*buf_));
   if (!buf_)
     throw std::runtime_error("IoEncode_Fce4M: Cannot allocate memory");
   if (!FCELIB_EncodeFce4M(&mesh_, &buf_, bufsz_, static_cast<int>(center_parts)))
     throw std::runtime_error("IoEncode_Fce4M: Cannot encode FCE4M");
   py::bytes result = py::bytes((char *)buf_, bufsz_);
-  free(buf_);
+  FCELIB_Free(buf_);
+  return result;
+}
+
+void Mesh::IoDecode_Snapshot(const std::string &buf)
+{
+  RecordStep_();
+  if (!FCELIB_DecodeSnapshot(&mesh_, buf.c_str(), buf.size()))
+    throw std::runtime_error("IoDecode_Snapshot: Cannot parse snapshot data");
+}
+
+py::bytes Mesh::IoEncode_Snapshot() const
+{
+  const int bufsz_ = FCELIB_SnapshotComputeSize(&mesh_);
+  unsigned char *buf_ = (unsigned char *)FCELIB_Malloc(bufsz_ * sizeof(*buf_));
+  if (!buf_)
+    throw std::runtime_error("IoEncode_Snapshot: Cannot allocate memory");
+  if (!FCELIB_EncodeSnapshot(&mesh_, &buf_, bufsz_))
+  {
+    FCELIB_Free(buf_);
+    throw std::runtime_error("IoEncode_Snapshot: Cannot encode snapshot");
+  }
+  py::bytes result = py::bytes((char *)buf_, bufsz_);
+  FCELIB_Free(buf_);
   return result;
 }
 
@@ -205,18 +427,52 @@ void Mesh::IoExportObj(const std::string &objpath, const std::string &mtlpath,
                        const int filter_triagflags_0xfff) const
 {
   if (!FCELIB_ExportObj(&mesh_, objpath.c_str(), mtlpath.c_str(),
-                               texture_name.c_str(),
-                               print_damage, print_dummies,
-                               use_part_positions, print_part_positions,
-                               filter_triagflags_0xfff))
+                        texture_name.c_str(),
+                        print_damage, print_dummies,
+                        use_part_positions, print_part_positions,
+                        filter_triagflags_0xfff))
     throw std::runtime_error("IoExportObj: Cannot export OBJ");
 }
 
+py::tuple Mesh::IoEncode_Obj(const std::string &objname, const std::string &mtlname,
+                             const std::string &texture_name,
+                             const int print_damage, const int print_dummies,
+                             const int use_part_positions,
+                             const int print_part_positions,
+                             const int filter_triagflags_0xfff) const
+{
+  char *objbuf_ = NULL;
+  char *mtlbuf_ = NULL;
+  int objbufsz_ = 0;
+  int mtlbufsz_ = 0;
+  int objlen_ = 0;
+  int mtllen_ = 0;
+  if (!FCELIB_ExportObjToMemory(&mesh_,
+                                &objbuf_, &objbufsz_, &objlen_,
+                                &mtlbuf_, &mtlbufsz_, &mtllen_,
+                                objname.c_str(), mtlname.c_str(),
+                                texture_name.c_str(),
+                                print_damage, print_dummies,
+                                use_part_positions, print_part_positions,
+                                filter_triagflags_0xfff))
+  {
+    FCELIB_Free(objbuf_);
+    FCELIB_Free(mtlbuf_);
+    throw std::runtime_error("IoEncode_Obj: Cannot encode OBJ");
+  }
+  py::bytes obj = py::bytes(objbuf_, objlen_);
+  FCELIB_Free(objbuf_);
+  py::bytes mtl = py::bytes(mtlbuf_, mtllen_);
+  FCELIB_Free(mtlbuf_);
+  return py::make_tuple(obj, mtl);
+}
+
 int Mesh::IoGeomDataToNewPart(py::array_t<int, py::array::c_style | py::array::forcecast> vert_idxs,
                               py::array_t<float, py::array::c_style | py::array::forcecast> vert_texcoords,
                               py::array_t<float, py::array::c_style | py::array::forcecast> vert_pos,
                               py::array_t<float, py::array::c_style | py::array::forcecast> normals)
 {
+  RecordStep_({});
   py::buffer_info tbuf = vert_idxs.request();
   py::buffer_info tcbuf = vert_texcoords.request();
   py::buffer_info vbuf = vert_pos.request();
@@ -283,6 +539,7 @@ py::buffer Mesh::MGetColors() const
 
 void Mesh::MSetColors(py::array_t<unsigned char, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({});
   py::buffer_info buf = arr.request();
   unsigned char *ptr;
 
@@ -340,6 +597,7 @@ std::vector<std::string> Mesh::GetDummyNames() const
 
 void Mesh::SetDummyNames(std::vector<std::string> &arr)
 {
+  RecordStep_({});
   std::memset(mesh_.hdr.DummyNames, '\0', 16 * 64);
 
   for (int i = 0; i < static_cast<int>(arr.size()) && i < 16; ++i)
@@ -367,6 +625,7 @@ py::buffer Mesh::MGetDummyPos() const
 
 void Mesh::MSetDummyPos(py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({});
   py::buffer_info buf = arr.request();
   float *ptr;
 
@@ -398,8 +657,8 @@ void Mesh::MSetDummyPos(py::array_t<float, py::array::c_style | py::array::force
 int Mesh::PNumTriags(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PNumTriags: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PNumTriags: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -409,8 +668,8 @@ int Mesh::PNumTriags(const int pid) const
 int Mesh::PNumVerts(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PNumVerts: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PNumVerts: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -421,8 +680,8 @@ int Mesh::PNumVerts(const int pid) const
 const std::string Mesh::PGetName(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetName: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetName: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -431,9 +690,10 @@ const std::string Mesh::PGetName(const int pid) const
 }
 void Mesh::PSetName(const int pid, const std::string &s)
 {
+  RecordStep_({pid});
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PSetName: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PSetName: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -445,8 +705,8 @@ void Mesh::PSetName(const int pid, const std::string &s)
 py::buffer Mesh::PGetPos(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetPos: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -461,9 +721,10 @@ py::buffer Mesh::PGetPos(const int pid) const
 }
 void Mesh::PSetPos(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({pid});
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PSetPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PSetPos: failure");
 #endif
   const int internal_pid = FCELIB_GetInternalPartIdxByOrder(&mesh_, pid);
   if (internal_pid < 0)
@@ -480,6 +741,7 @@ void Mesh::PSetPos(const int pid, py::array_t<float, py::array::c_style | py::ar
   memcpy(&mesh_.parts[ mesh_.hdr.Parts[internal_pid] ]->PartPos.x, ptr + 0, sizeof(float));
   memcpy(&mesh_.parts[ mesh_.hdr.Parts[internal_pid] ]->PartPos.y, ptr + 1, sizeof(float));
   memcpy(&mesh_.parts[ mesh_.hdr.Parts[internal_pid] ]->PartPos.z, ptr + 2, sizeof(float));
+  FCELIB_PartInvalidateCaches(mesh_.parts[ mesh_.hdr.Parts[internal_pid] ]);
 }
 
 /* triags --------------------------- */
@@ -487,8 +749,8 @@ void Mesh::PSetPos(const int pid, py::array_t<float, py::array::c_style | py::ar
 py::buffer Mesh::PGetTriagsVidx(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetTriagsVidx: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetTriagsVidx: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PGetTriagsVidx: pid");
@@ -517,8 +779,8 @@ py::buffer Mesh::PGetTriagsVidx(const int pid) const
 py::buffer Mesh::PGetTriagsFlags(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetTriagsFlags: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetTriagsFlags: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PGetTriagsFlags: pid");
@@ -538,9 +800,10 @@ py::buffer Mesh::PGetTriagsFlags(const int pid) const
 }
 void Mesh::PSetTriagsFlags(const int pid, py::array_t<int, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({pid});
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PSetTriagsFlags: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PSetTriagsFlags: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PSetTriagsFlags: pid");
@@ -567,8 +830,8 @@ void Mesh::PSetTriagsFlags(const int pid, py::array_t<int, py::array::c_style |
 py::buffer Mesh::PGetTriagsTexcoords(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetTriagsTexcoords: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetTriagsTexcoords: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PGetTriagsTexcoords: pid");
@@ -595,9 +858,10 @@ py::buffer Mesh::PGetTriagsTexcoords(const int pid) const
 }
 void Mesh::PSetTriagsTexcoords(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({pid});
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PSetTriagsTexcoords: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PSetTriagsTexcoords: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PSetTriagsTexcoords: pid");
@@ -627,8 +891,8 @@ void Mesh::PSetTriagsTexcoords(const int pid, py::array_t<float, py::array::c_st
 py::buffer Mesh::PGetTriagsTexpages(const int pid) const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PGetTriagsTexpages: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PGetTriagsTexpages: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PGetTriagsTexpages: pid");
@@ -649,9 +913,10 @@ py::buffer Mesh::PGetTriagsTexpages(const int pid) const
 }
 void Mesh::PSetTriagsTexpages(const int pid, py::array_t<int, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_({pid});
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("PSetTriagsTexpages: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("PSetTriagsTexpages: failure");
 #endif
   if (pid < 0 || pid >= mesh_.hdr.NumParts)
     throw std::range_error("PSetTriagsTexpages: pid");
@@ -675,14 +940,172 @@ void Mesh::PSetTriagsTexpages(const int pid, py::array_t<int, py::array::c_style
   }
 }
 
+/* queries -------------------------- */
+
+const FcelibBvh *Mesh::GetBvh_(const int pid, const char *caller)
+{
+  if (pid < 0 || pid >= mesh_.hdr.NumParts)
+    throw std::out_of_range(std::string(caller) + ": part index (pid) out of range");
+  const FcelibBvh *bvh = FCELIB_GetPartBvh(&mesh_, pid);
+  if (!bvh)
+    throw std::runtime_error(std::string(caller) + ": Cannot build BVH");
+  return bvh;
+}
+
+const FcelibAdjacency *Mesh::GetAdjacency_(const int pid, const char *caller)
+{
+  if (pid < 0 || pid >= mesh_.hdr.NumParts)
+    throw std::out_of_range(std::string(caller) + ": part index (pid) out of range");
+  const FcelibAdjacency *adj = FCELIB_GetPartAdjacency(&mesh_, pid);
+  if (!adj)
+    throw std::runtime_error(std::string(caller) + ": Cannot build adjacency");
+  return adj;
+}
+
+py::buffer Mesh::PGetTriagsNeighbors(const int pid)
+{
+  const FcelibAdjacency *adj = GetAdjacency_(pid, "PGetTriagsNeighbors");
+  py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(adj->num_triangles * 3) }, {  });
+  int *ptr = static_cast<int *>(result.request().ptr);
+  for (int i = 0; i < adj->num_triangles * 3; ++i)
+    ptr[i] = adj->twins[i] >= 0 ? adj->twins[i] / 3 : adj->twins[i];
+  return result;
+}
+
+py::tuple Mesh::PGetVertTriags(const int pid)
+{
+  const FcelibAdjacency *adj = GetAdjacency_(pid, "PGetVertTriags");
+  py::array_t<int> result_offsets = py::array_t<int>({ static_cast<py::ssize_t>(adj->num_vertices + 1) }, {  });
+  py::array_t<int> result_triags = py::array_t<int>({ static_cast<py::ssize_t>(adj->num_triangles * 3) }, {  });
+  memcpy(result_offsets.request().ptr, adj->vert_offsets, (adj->num_vertices + 1) * sizeof(int));
+  memcpy(result_triags.request().ptr, adj->vert_triags, adj->num_triangles * 3 * sizeof(int));
+  return py::make_tuple(result_offsets, result_triags);
+}
+
+py::buffer Mesh::PGetBoundaryEdges(const int pid)
+{
+  const FcelibAdjacency *adj = GetAdjacency_(pid, "PGetBoundaryEdges");
+  py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(adj->num_boundary) }, {  });
+  memcpy(result.request().ptr, adj->boundary, adj->num_boundary * sizeof(int));
+  return result;
+}
+
+py::buffer Mesh::PGetComponents(const int pid) const
+{
+  if (pid < 0 || pid >= mesh_.hdr.NumParts)
+    throw std::out_of_range("PGetComponents: part index (pid) out of range");
+  FcelibPart *part = mesh_.parts[ mesh_.hdr.Parts[FCELIB_GetInternalPartIdxByOrder(&mesh_, pid)] ];
+
+  py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(part->PNumTriangles) }, {  });
+  if (FCELIB_GetPartComponents(&mesh_, pid, static_cast<int *>(result.request().ptr)) < 0)
+    throw std::runtime_error("PGetComponents");
+  return result;
+}
+
+py::buffer Mesh::PFindSymmetry(const int pid_a, const int pid_b, const float eps, const int axis) const
+{
+  if (pid_a < 0 || pid_a >= mesh_.hdr.NumParts || pid_b < 0 || pid_b >= mesh_.hdr.NumParts)
+    throw std::out_of_range("PFindSymmetry: part index (pid) out of range");
+  if (axis < 0 || axis > 2)
+    throw std::runtime_error("PFindSymmetry: axis must be 0, 1, or 2");
+  FcelibPart *part = mesh_.parts[ mesh_.hdr.Parts[FCELIB_GetInternalPartIdxByOrder(&mesh_, pid_a)] ];
+
+  py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(part->PNumVertices) }, {  });
+  int *matches = static_cast<int *>(result.request().ptr);
+  if (FCELIB_FindSymmetry(&mesh_, pid_a, pid_b, axis, eps, matches) < 0)
+    throw std::runtime_error("PFindSymmetry");
+  return result;
+}
+
+py::tuple Mesh::PRaycast(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> origin,
+                         py::array_t<float, py::array::c_style | py::array::forcecast> dir)
+{
+  py::buffer_info buf_o = origin.request();
+  py::buffer_info buf_d = dir.request();
+  if (buf_o.ndim != 1 || buf_o.shape[0] != 3 || buf_d.ndim != 1 || buf_d.shape[0] != 3)
+    throw std::runtime_error("PRaycast: Shape must be (3, )");
+  const FcelibBvh *bvh = GetBvh_(pid, "PRaycast");
+  float t = -1.0f;
+  const int idx = FCELIB_BvhRaycast(bvh, static_cast<float *>(buf_o.ptr), static_cast<float *>(buf_d.ptr), &t);
+  return py::make_tuple(idx, idx < 0 ? -1.0f : t);
+}
+
+py::tuple Mesh::PRaycastBatch(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> origins,
+                              py::array_t<float, py::array::c_style | py::array::forcecast> dirs)
+{
+  py::buffer_info buf_o = origins.request();
+  py::buffer_info buf_d = dirs.request();
+  if (buf_o.ndim != 1 || buf_o.shape[0] % 3 != 0 || buf_d.ndim != 1 || buf_d.shape[0] != buf_o.shape[0])
+    throw std::runtime_error("PRaycastBatch: Shape must be (N*3, ) for N rays");
+  const int nrows = static_cast<int>(buf_o.shape[0] / 3);
+  const FcelibBvh *bvh = GetBvh_(pid, "PRaycastBatch");
+
+  py::array_t<int> result_idx = py::array_t<int>({ static_cast<py::ssize_t>(nrows) }, {  });
+  py::array_t<float> result_t = py::array_t<float>({ static_cast<py::ssize_t>(nrows) }, {  });
+  int *idx = static_cast<int *>(result_idx.request().ptr);
+  float *t = static_cast<float *>(result_t.request().ptr);
+  const float *o = static_cast<float *>(buf_o.ptr);
+  const float *d = static_cast<float *>(buf_d.ptr);
+  for (int i = 0; i < nrows; ++i)
+  {
+    t[i] = -1.0f;
+    idx[i] = FCELIB_BvhRaycast(bvh, o + 3 * i, d + 3 * i, &t[i]);
+  }
+  return py::make_tuple(result_idx, result_t);
+}
+
+py::tuple Mesh::PClosestPoint(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> point)
+{
+  py::buffer_info buf = point.request();
+  if (buf.ndim != 1 || buf.shape[0] != 3)
+    throw std::runtime_error("PClosestPoint: Shape must be (3, )");
+  const FcelibBvh *bvh = GetBvh_(pid, "PClosestPoint");
+  py::array_t<float> result = py::array_t<float>({ 3 }, {  });
+  float *c = static_cast<float *>(result.request().ptr);
+  float dist2 = -1.0f;
+  const int idx = FCELIB_BvhClosestPoint(bvh, static_cast<float *>(buf.ptr), c, &dist2);
+  if (idx < 0)
+    memset(c, 0, 3 * sizeof(*c));
+  return py::make_tuple(idx, result, idx < 0 ? -1.0f : std::sqrt(dist2));
+}
+
+py::tuple Mesh::PClosestPointBatch(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> points)
+{
+  py::buffer_info buf = points.request();
+  if (buf.ndim != 1 || buf.shape[0] % 3 != 0)
+    throw std::runtime_error("PClosestPointBatch: Shape must be (N*3, ) for N points");
+  const int nrows = static_cast<int>(buf.shape[0] / 3);
+  const FcelibBvh *bvh = GetBvh_(pid, "PClosestPointBatch");
+
+  py::array_t<int> result_idx = py::array_t<int>({ static_cast<py::ssize_t>(nrows) }, {  });
+  py::array_t<float> result_c = py::array_t<float>({ static_cast<py::ssize_t>(nrows * 3) }, {  });
+  py::array_t<float> result_d = py::array_t<float>({ static_cast<py::ssize_t>(nrows) }, {  });
+  int *idx = static_cast<int *>(result_idx.request().ptr);
+  float *c = static_cast<float *>(result_c.request().ptr);
+  float *d = static_cast<float *>(result_d.request().ptr);
+  const float *p = static_cast<float *>(buf.ptr);
+  for (int i = 0; i < nrows; ++i)
+  {
+    idx[i] = FCELIB_BvhClosestPoint(bvh, p + 3 * i, c + 3 * i, &d[i]);
+    if (idx[i] < 0)
+    {
+      memset(c + 3 * i, 0, 3 * sizeof(*c));
+      d[i] = -1.0f;
+    }
+    else
+      d[i] = std::sqrt(d[i]);
+  }
+  return py::make_tuple(result_idx, result_c, result_d);
+}
+
 /* verts ---------------------------- */
 
 /* Via vector index (=global vert idx) map to global vert order. */
 py::buffer Mesh::MVertsGetMap_idx2order() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MVertsGetMap_idx2order: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MVertsGetMap_idx2order: failure");
 #endif
   py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(mesh_.vertices_len) }, {  });
   auto buf = result.request();
@@ -711,8 +1134,8 @@ py::buffer Mesh::MVertsGetMap_idx2order() const
 py::buffer Mesh::MGetVertsPos() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MGetVertsPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MGetVertsPos: failure");
 #endif
   py::array_t<float> result = py::array_t<float>({ static_cast<py::ssize_t>(mesh_.hdr.NumVertices * 3) }, {  });
   auto buf = result.mutable_unchecked<>();
@@ -741,9 +1164,10 @@ py::buffer Mesh::MGetVertsPos() const
 }
 void Mesh::MSetVertsPos(py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_();
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MSetVertsPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MSetVertsPos: failure");
 #endif
   const int nrows = mesh_.hdr.NumVertices;
   py::buffer_info buf = arr.request();
@@ -760,6 +1184,7 @@ void Mesh::MSetVertsPos(py::array_t<float, py::array::c_style | py::array::force
     if (mesh_.hdr.Parts[k] < 0)
       continue;
     part = mesh_.parts[ mesh_.hdr.Parts[k] ];
+    FCELIB_PartInvalidateCaches(part);
 
     for (int i = 0; i < part->pvertices_len; ++i)
     {
@@ -777,8 +1202,8 @@ void Mesh::MSetVertsPos(py::array_t<float, py::array::c_style | py::array::force
 py::buffer Mesh::MGetVertsNorms() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MGetVertsNorms: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MGetVertsNorms: failure");
 #endif
   py::array_t<float> result = py::array_t<float>({ static_cast<py::ssize_t>(mesh_.hdr.NumVertices * 3) }, {  });
   auto buf = result.mutable_unchecked<>();
@@ -807,9 +1232,10 @@ py::buffer Mesh::MGetVertsNorms() const
 }
 void Mesh::MSetVertsNorms(py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_();
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MSetVertsNorms: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MSetVertsNorms: failure");
 #endif
   const int nrows = mesh_.hdr.NumVertices;
   py::buffer_info buf = arr.request();
@@ -843,8 +1269,8 @@ void Mesh::MSetVertsNorms(py::array_t<float, py::array::c_style | py::array::for
 py::buffer Mesh::MGetDamgdVertsPos() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MGetDamgdVertsPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MGetDamgdVertsPos: failure");
 #endif
   py::array_t<float> result = py::array_t<float>({ static_cast<py::ssize_t>(mesh_.hdr.NumVertices * 3) }, {  });
   auto buf = result.mutable_unchecked<>();
@@ -873,9 +1299,10 @@ py::buffer Mesh::MGetDamgdVertsPos() const
 }
 void Mesh::MSetDamgdVertsPos(py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_();
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MSetDamgdVertsPos: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MSetDamgdVertsPos: failure");
 #endif
   const int nrows = mesh_.hdr.NumVertices;
   py::buffer_info buf = arr.request();
@@ -909,8 +1336,8 @@ void Mesh::MSetDamgdVertsPos(py::array_t<float, py::array::c_style | py::array::
 py::buffer Mesh::MGetDamgdVertsNorms() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MGetDamgdVertsNorms: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MGetDamgdVertsNorms: failure");
 #endif
   py::array_t<float> result = py::array_t<float>({ static_cast<py::ssize_t>(mesh_.hdr.NumVertices * 3) }, {  });
   auto buf = result.mutable_unchecked<>();
@@ -939,9 +1366,10 @@ py::buffer Mesh::MGetDamgdVertsNorms() const
 }
 void Mesh::MSetDamgdVertsNorms(py::array_t<float, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_();
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MSetDamgdVertsNorms: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MSetDamgdVertsNorms: failure");
 #endif
   const int nrows = mesh_.hdr.NumVertices;
   py::buffer_info buf = arr.request();
@@ -975,8 +1403,8 @@ void Mesh::MSetDamgdVertsNorms(py::array_t<float, py::array::c_style | py::array
 py::buffer Mesh::MGetVertsAnimation() const
 {
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MGetVertsAnimation: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MGetVertsAnimation: failure");
 #endif
   py::array_t<int> result = py::array_t<int>({ static_cast<py::ssize_t>(mesh_.hdr.NumVertices) }, {  });
   auto buf = result.mutable_unchecked<>();
@@ -1003,9 +1431,10 @@ py::buffer Mesh::MGetVertsAnimation() const
 }
 void Mesh::MSetVertsAnimation(py::array_t<int, py::array::c_style | py::array::forcecast> arr)
 {
+  RecordStep_();
 #ifdef FCELIB_PYTHON_DEBUG
-  if (!FCELIB_ValidateMesh(&mesh_))
-    std::runtime_error("MSetVertsAnimation: failure");
+  if (!FCELIB_MeshValidateSummary(&mesh_))
+    throw std::runtime_error("MSetVertsAnimation: failure");
 #endif
   const int nrows = mesh_.hdr.NumVertices;
   py::buffer_info buf = arr.request();
@@ -1038,6 +1467,7 @@ void Mesh::MSetVertsAnimation(py::array_t<int, py::array::c_style | py::array::f
 
 int Mesh::OpAddHelperPart(const std::string &s, py::array_t<float, py::array::c_style | py::array::forcecast> new_center)
 {
+  RecordStep_({});
   const int pid_new = FCELIB_AddHelperPart(&mesh_);
   if (pid_new < 0)
     throw std::runtime_error("OpAddHelperPart: Cannot add helper part");
@@ -1052,6 +1482,7 @@ int Mesh::OpAddHelperPart(const std::string &s, py::array_t<float, py::array::c_
 
 bool Mesh::OpCenterPart(const int pid)
 {
+  RecordStep_({pid});
   if (pid > mesh_.hdr.NumParts || pid < 0)
     throw std::out_of_range("OpCenterPart: part index (pid) out of range");
   return FCELIB_CenterPart(&mesh_, pid);
@@ -1059,6 +1490,7 @@ bool Mesh::OpCenterPart(const int pid)
 
 bool Mesh::OpSetPartCenter(const int pid, py::array_t<float, py::array::c_style | py::array::forcecast> new_center)
 {
+  RecordStep_({pid});
   if (pid > mesh_.hdr.NumParts || pid < 0)
     throw std::out_of_range("OpSetPartCenter: part index (pid) out of range");
   py::buffer_info buf = new_center.request();
@@ -1069,8 +1501,100 @@ bool Mesh::OpSetPartCenter(const int pid, py::array_t<float, py::array::c_style
   return FCELIB_SetPartCenter(&mesh_, pid, static_cast<float *>(buf.ptr));
 }
 
+bool Mesh::OpComputeNormals(const int pid, const std::string &mode, const py::object &crease_angle, const bool apply_to_damage)
+{
+  if (pid < 0)
+    RecordStep_();
+  else
+    RecordStep_({pid});
+  int mode_;
+  float crease_cos = 2.0f;  // disabled
+  if (pid >= mesh_.hdr.NumParts)
+    throw std::out_of_range("OpComputeNormals: part index (pid) out of range");
+  if (mode == "area")
+    mode_ = FCELIB_OP_NORMALS_AREA;
+  else if (mode == "angle")
+    mode_ = FCELIB_OP_NORMALS_ANGLE;
+  else
+    throw std::runtime_error("OpComputeNormals: mode must be 'area' or 'angle'");
+  if (!crease_angle.is_none())
+    crease_cos = static_cast<float>(std::cos(crease_angle.cast<double>() * 3.14159265358979323846 / 180.0));
+  if (!FCELIB_ComputeNormals(&mesh_, pid, mode_, crease_cos, static_cast<int>(apply_to_damage)))
+    throw std::runtime_error("OpComputeNormals");
+  return 1;
+}
+
+bool Mesh::OpTransform(py::array_t<float, py::array::c_style | py::array::forcecast> matrix, const py::object &pids,
+                       const bool apply_to_damage, const bool transform_normals)
+{
+  py::buffer_info buf = matrix.request();
+  if (buf.size != 16 || (buf.ndim != 2 && buf.ndim != 1))
+    throw std::runtime_error("OpTransform: Shape must be (4, 4) or (16, )");
+  if (pids.is_none())
+  {
+    RecordStep_();
+    return FCELIB_Transform(&mesh_, static_cast<float *>(buf.ptr), NULL, 0,
+                            static_cast<int>(apply_to_damage), static_cast<int>(transform_normals));
+  }
+  const std::vector<int> pids_ = pids.cast<std::vector<int> >();
+  for (const int pid : pids_)
+  {
+    if (pid >= mesh_.hdr.NumParts || pid < 0)
+      throw std::out_of_range("OpTransform: part index (pids) out of range");
+  }
+  RecordStep_(pids_);
+  if (!FCELIB_Transform(&mesh_, static_cast<float *>(buf.ptr), pids_.data(), static_cast<int>(pids_.size()),
+                        static_cast<int>(apply_to_damage), static_cast<int>(transform_normals)))
+    throw std::runtime_error("OpTransform");
+  return 1;
+}
+
+bool Mesh::OpGenerateDamage(const py::object &pids, py::array_t<float, py::array::c_style | py::array::forcecast> impact_points,
+                            const float radius, const float strength, const unsigned long seed, const py::object &crease_angle)
+{
+  float crease_cos = 2.0f;  // disabled
+  py::buffer_info buf = impact_points.request();
+  if (buf.size % 3 != 0 || (buf.ndim != 2 && buf.ndim != 1))
+    throw std::runtime_error("OpGenerateDamage: Shape must be (N, 3) or (N*3, )");
+  std::vector<int> pids_;
+  if (!pids.is_none())
+  {
+    pids_ = pids.cast<std::vector<int> >();
+    for (const int pid : pids_)
+    {
+      if (pid >= mesh_.hdr.NumParts || pid < 0)
+        throw std::out_of_range("OpGenerateDamage: part index (pids) out of range");
+    }
+    RecordStep_(pids_);
+  }
+  else
+    RecordStep_();
+  if (!crease_angle.is_none())
+    crease_cos = static_cast<float>(std::cos(crease_angle.cast<double>() * 3.14159265358979323846 / 180.0));
+  const int retv = FCELIB_GenerateDamage(&mesh_, pids.is_none() ? NULL : pids_.data(), static_cast<int>(pids_.size()),
+                                         static_cast<float *>(buf.ptr), static_cast<int>(buf.size / 3), radius, strength, seed,
+                                         crease_cos);
+  if (!retv)
+    throw std::runtime_error("OpGenerateDamage");
+  return 1;
+}
+
+int Mesh::OpMirrorPart(const int pid, const int axis, const std::string &new_name)
+{
+  RecordStep_({});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpMirrorPart: part index (pid) out of range");
+  if (axis < 0 || axis > 2)
+    throw std::runtime_error("OpMirrorPart: axis must be 0, 1, or 2");
+  const int pid_new = FCELIB_MirrorPart(&mesh_, pid, axis, new_name.empty() ? NULL : new_name.c_str());
+  if (pid_new < 0)
+    throw std::runtime_error("OpMirrorPart");
+  return pid_new;
+}
+
 int Mesh::OpCopyPart(const int pid_src)
 {
+  RecordStep_({});
   if (pid_src > this->mesh_.hdr.NumParts || pid_src < 0)
     throw std::out_of_range("OpCopyPart: part index (pid_src) out of range");
   const int pid_new = FCELIB_CopyPartToMesh(&this->mesh_, &this->mesh_, pid_src);
@@ -1081,6 +1605,7 @@ int Mesh::OpCopyPart(const int pid_src)
 
 int Mesh::OpInsertPart(Mesh *mesh_src, const int pid_src)
 {
+  RecordStep_({});
   FcelibMesh *mesh_src_ = mesh_src->Get_mesh_();
   if (pid_src > mesh_src_->hdr.NumParts || pid_src < 0)
     throw std::out_of_range("OpInsertPart: part index (pid_src) out of range");
@@ -1092,6 +1617,7 @@ int Mesh::OpInsertPart(Mesh *mesh_src, const int pid_src)
 
 bool Mesh::OpDeletePart(const int pid)
 {
+  RecordStep_({pid});
   if (pid > mesh_.hdr.NumParts || pid < 0)
     throw std::out_of_range("OpDeletePart: part index (pid) out of range");
   FCELIB_DeletePart(&mesh_, pid);
@@ -1100,13 +1626,132 @@ bool Mesh::OpDeletePart(const int pid)
 
 bool Mesh::OpDeletePartTriags(const int pid, const std::vector<int> &idxs)
 {
+  RecordStep_({pid});
   if (pid > mesh_.hdr.NumParts || pid < 0)
     throw std::out_of_range("OpDeletePartTriags: part index (pid) out of range");
   return FCELIB_DeletePartTriags(&mesh_, pid, idxs.data(), static_cast<int>(idxs.size()));
 }
 
+bool Mesh::OpDeleteTriags(py::array_t<int, py::array::c_style | py::array::forcecast> pids,
+                          py::array_t<int, py::array::c_style | py::array::forcecast> idxs)
+{
+  py::buffer_info pbuf = pids.request();
+  py::buffer_info ibuf = idxs.request();
+  if (pbuf.ndim != 1 || ibuf.ndim != 1)
+    throw std::runtime_error("OpDeleteTriags: Number of dimensions must be 1");
+  if (pbuf.shape[0] != ibuf.shape[0])
+    throw std::runtime_error("OpDeleteTriags: Shapes must match (pids, idxs)");
+  RecordStep_(std::vector<int>((int *)pbuf.ptr, (int *)pbuf.ptr + pbuf.shape[0]));
+  if (!FCELIB_DeleteTriags(&mesh_, (int *)pbuf.ptr, (int *)ibuf.ptr, static_cast<int>(ibuf.shape[0])))
+    throw std::out_of_range("OpDeleteTriags: index out of range (pids, idxs)");
+  return 1;
+}
+
+bool Mesh::OpDeleteTriagsDict(const std::map<int, std::vector<int> > &triags)
+{
+  std::vector<int> pids;
+  std::vector<int> idxs;
+  std::vector<int> keys;
+  for (const auto &it : triags)
+  {
+    pids.insert(pids.end(), it.second.size(), it.first);
+    idxs.insert(idxs.end(), it.second.begin(), it.second.end());
+    keys.push_back(it.first);
+  }
+  RecordStep_(keys);
+  if (!FCELIB_DeleteTriags(&mesh_, pids.data(), idxs.data(), static_cast<int>(idxs.size())))
+    throw std::out_of_range("OpDeleteTriags: index out of range (triags)");
+  return 1;
+}
+
+int Mesh::TriagKey_(const std::string &key, const char *caller)
+{
+  if (key == "flag_mask")
+    return FCELIB_OP_SORTKEY_FLAG_MASK;
+  if (key == "flag")
+    return FCELIB_OP_SORTKEY_FLAG;
+  if (key == "texpage")
+    return FCELIB_OP_SORTKEY_TEXPAGE;
+  throw std::runtime_error(std::string(caller) + ": key must be 'flag_mask', 'flag', or 'texpage'");
+}
+
+bool Mesh::OpSortPartTriags(const int pid, const std::string &key, const int mask)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpSortPartTriags: part index (pid) out of range");
+  return FCELIB_SortPartTriags(&mesh_, pid, TriagKey_(key, "OpSortPartTriags"), mask);
+}
+
+bool Mesh::OpOptimizeVertexCache(const int pid, const bool reorder_verts)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpOptimizeVertexCache: part index (pid) out of range");
+  return FCELIB_OptimizeVertexCache(&mesh_, pid, static_cast<int>(reorder_verts));
+}
+
+int Mesh::OpSplitPart(const int pid, const int mask, const int value, const std::string &key)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpSplitPart: part index (pid) out of range");
+  const int pid_new = FCELIB_SplitPart(&mesh_, pid, TriagKey_(key, "OpSplitPart"), mask, value);
+  if (pid_new < 0)
+    throw std::runtime_error("OpSplitPart");
+  return pid_new;
+}
+
+int Mesh::OpSplitComponents(const int pid)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpSplitComponents: part index (pid) out of range");
+  const int retv = FCELIB_SplitComponents(&mesh_, pid);
+  if (retv < 0)
+    throw std::runtime_error("OpSplitComponents");
+  return retv;
+}
+
+bool Mesh::OpDelUnrefdVerts(const bool compact)
+{
+  RecordStep_();
+  return FCELIB_DeleteUnrefdVerts(&mesh_, static_cast<int>(compact));
+}
+
+bool Mesh::OpDelPartUnrefdVerts(const int pid, const bool compact)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpDelPartUnrefdVerts: part index (pid) out of range");
+  return FCELIB_DeletePartUnrefdVerts(&mesh_, pid, static_cast<int>(compact));
+}
+
+int Mesh::OpWeldVertices(const int pid, const float epsilon, const bool compare_normals, const bool compare_damage)
+{
+  RecordStep_({pid});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpWeldVertices: part index (pid) out of range");
+  const int retv = FCELIB_WeldVertices(&mesh_, pid, epsilon, static_cast<int>(compare_normals), static_cast<int>(compare_damage));
+  if (retv < 0)
+    throw std::runtime_error("OpWeldVertices");
+  return retv;
+}
+
+int Mesh::OpDecimatePart(const int pid, const int target_triags, const bool preserve_uv_seams)
+{
+  RecordStep_({});
+  if (pid >= mesh_.hdr.NumParts || pid < 0)
+    throw std::out_of_range("OpDecimatePart: part index (pid) out of range");
+  const int pid_new = FCELIB_DecimatePart(&mesh_, pid, target_triags, static_cast<int>(preserve_uv_seams));
+  if (pid_new < 0)
+    throw std::runtime_error("OpDecimatePart");
+  return pid_new;
+}
+
 int Mesh::OpMergeParts(const int pid1, const int pid2)
 {
+  RecordStep_({});
   if (pid1 > mesh_.hdr.NumParts || pid1 < 0)
     throw std::out_of_range("OpMergeParts: part index (pid1) out of range");
   if (pid2 > mesh_.hdr.NumParts || pid2 < 0)
@@ -1117,13 +1762,38 @@ int Mesh::OpMergeParts(const int pid1, const int pid2)
   return pid_new;
 }
 
+int Mesh::OpMergePartsList(const std::vector<int> &pids)
+{
+  RecordStep_(pids);
+  for (const int pid : pids)
+  {
+    if (pid >= mesh_.hdr.NumParts || pid < 0)
+      throw std::out_of_range("OpMergeParts: part index (pids) out of range");
+  }
+  const int pid_new = FCELIB_MergeParts(&mesh_, pids.data(), static_cast<int>(pids.size()));
+  if (pid_new < 0)
+    throw std::runtime_error("OpMergeParts");
+  return pid_new;
+}
+
 int Mesh::OpMovePart(const int pid)
 {
+  RecordStep_({});
   if (pid > mesh_.hdr.NumParts || pid < 0)
     throw std::out_of_range("OpMovePart: part index (pid) out of range");
   return FCELIB_MeshMoveUpPart(&mesh_, pid);
 }
 
+bool Mesh::OpReorderParts(const std::vector<int> &new_order)
+{
+  RecordStep_({});
+  if (static_cast<int>(new_order.size()) != mesh_.hdr.NumParts)
+    throw std::runtime_error("OpReorderParts: Expects permutation of length MNumParts");
+  if (!FCELIB_ReorderParts(&mesh_, new_order.data(), static_cast<int>(new_order.size())))
+    throw std::runtime_error("OpReorderParts: Expects permutation of part indexes");
+  return 1;
+}
+
 /* wrappers ----------------------------------------------------------------- */
 
 // fcecodec.
@@ -1152,18 +1822,26 @@ PYBIND11_MODULE(fcecodec, fcecodec_module, py::mod_gil_not_used())
 {
   fcecodec_module.doc() = "FCE decoder/encoder";
 
+#ifdef PYMEM_MALLOC
+  FCELIB_SetAllocator(&FCECODECMODULE_Malloc, &FCECODECMODULE_Realloc, &FCECODECMODULE_Free, NULL);
+#endif
+  FCELIB_SetParallelFor(&FCECODECMODULE_ParallelFor, NULL);
+
   fcecodec_module.def("GetFceVersion", &FCECODECMODULE_GetFceVersion, py::arg("buf"), R"pbdoc( Returns 3 (FCE3), 4 (FCE4), 5 (FCE4M), negative (invalid) )pbdoc");
   fcecodec_module.def("PrintFceInfo", &FCECODECMODULE_PrintFceInfo, py::arg("buf"));
   fcecodec_module.def("ValidateFce", &FCECODECMODULE_ValidateFce, py::arg("buf"), R"pbdoc( DEPRECATED as of 1.15 Returns 1 for valid FCE data, 0 otherwise. )pbdoc");  /* DEPRECATED as of 1.15 */
 
   py::class_<Mesh>(fcecodec_module, "Mesh", py::buffer_protocol())
     .def(py::init<>())
+    .def("__copy__", &Mesh::MCopy, R"pbdoc( Returns deep copy: every part, triangle, and vertex is copied, nothing is shared, so time and memory are O(mesh). Part, triangle, and vertex order are kept. Journal is not copied. )pbdoc")
+    .def("__deepcopy__", &Mesh::MDeepCopy, py::arg("memo"), R"pbdoc( Same as __copy__(). )pbdoc")
 
 #if !defined(SCL_DEBUG) || SCL_DEBUG != 0
     .def("MValid", &Mesh::MValid)
 #endif
 
     .def("PrintInfo", &Mesh::PrintInfo)
+    .def("MMemoryStats", &Mesh::MMemoryStats, R"pbdoc( Returns dict of allocated bytes (parts, triangles, vertices, index arrays), live vs. allocated slots, and fragmentation ratio (share of unused slots). )pbdoc")
 #if !defined(SCL_DEBUG) || SCL_DEBUG != 0
     .def("PrintParts", &Mesh::PrintParts)
     .def("PrintTriags", &Mesh::PrintTriags)
@@ -1173,11 +1851,21 @@ PYBIND11_MODULE(fcecodec, fcecodec_module, py::mod_gil_not_used())
     .def_property_readonly("MNumTriags", &Mesh::MNumTriags)
     .def_property_readonly("MNumVerts", &Mesh::MNumVerts)
 
+    .def("JournalEnable", &Mesh::JournalEnable, py::arg("budget") = 64L << 20, R"pbdoc( Starts undo/redo journal, or sets memory budget (bytes) of running journal. Each mesh-modifying method call becomes one step, stored as compact delta of changed header, parts, triangles, and vertices. Oldest steps are dropped once deltas exceed budget. Recording costs O(parts touched by the call), no copy of the mesh is kept. )pbdoc")
+    .def("JournalDisable", &Mesh::JournalDisable, R"pbdoc( Stops journal, frees all steps. )pbdoc")
+    .def("MJournalStats", &Mesh::MJournalStats, R"pbdoc( Returns dict of journal state: enabled, undo_steps, redo_steps, bytes (held in deltas), budget. )pbdoc")
+    .def("Undo", &Mesh::Undo, R"pbdoc( Reverts last step. Returns False if there is nothing to undo. Raises RuntimeError if journal is not enabled. )pbdoc")
+    .def("Redo", &Mesh::Redo, R"pbdoc( Re-applies last undone step. Any mesh-modifying call after Undo() drops redo steps. Returns False if there is nothing to redo. Raises RuntimeError if journal is not enabled. )pbdoc")
+
     .def("IoDecode", &Mesh::IoDecode)
     .def("IoEncode_Fce3", &Mesh::IoEncode_Fce3, py::arg("center_parts") = true)
     .def("IoEncode_Fce4", &Mesh::IoEncode_Fce4, py::arg("center_parts") = true)
     .def("IoEncode_Fce4M", &Mesh::IoEncode_Fce4M, py::arg("center_parts") = true)
+    .def("IoDecode_Snapshot", &Mesh::IoDecode_Snapshot, py::arg("buf"), R"pbdoc( Loads fcecodec mesh snapshot, see IoEncode_Snapshot(). )pbdoc")
+    .def("IoEncode_Snapshot", &Mesh::IoEncode_Snapshot, R"pbdoc( Returns fcecodec-specific snapshot of decoded mesh state (not an FCE file). Part, triangle, and vertex order are kept. Loads without re-decoding FCE data. )pbdoc")
     .def("IoExportObj", &Mesh::IoExportObj, py::arg("objpath"), py::arg("mtlpath"), py::arg("texname"), py::arg("print_damage") = 0, py::arg("print_dummies") = 0, py::arg("use_part_positions") = 1, py::arg("print_part_positions") = 0, py::arg("filter_triagflags_0xfff") = 1)
+    .def("IoEncode_Obj", &Mesh::IoEncode_Obj, py::arg("objname"), py::arg("mtlname"), py::arg("texname"), py::arg("print_damage") = 0, py::arg("print_dummies") = 0, py::arg("use_part_positions") = 1, py::arg("print_part_positions") = 0, py::arg("filter_triagflags_0xfff") = 1,
+      R"pbdoc( Same as IoExportObj(), but returns tuple (obj, mtl) of bytes instead of writing files. objname, mtlname are only used in OBJ/MTL text. )pbdoc")
     .def("IoGeomDataToNewPart", &Mesh::IoGeomDataToNewPart,
       py::arg("vert_idxs"), py::arg("vert_texcoords"), py::arg("vert_pos"), py::arg("normals"),
       R"pbdoc( vert_idxs: 012..., vert_texcoords: uuuvvv... , vert_pos: xyzxyzxyz..., normals: xyzxyzxyz... )pbdoc")
@@ -1208,6 +1896,16 @@ PYBIND11_MODULE(fcecodec, fcecodec_module, py::mod_gil_not_used())
     .def("PGetTriagsTexpages", &Mesh::PGetTriagsTexpages, py::arg("pid"))
     .def("PSetTriagsTexpages", &Mesh::PSetTriagsTexpages, py::arg("pid"), py::arg("arr"), R"pbdoc( Expects (N, ) numpy array for N triangles )pbdoc")
 
+    .def("PGetTriagsNeighbors", &Mesh::PGetTriagsNeighbors, py::arg("pid"), R"pbdoc( Triangle neighbors across edges, from cached part adjacency (built on first call, invalidated by ops that change part topology). Edge k of a triangle runs from corner k to corner (k + 1) % 3. Returns (N*3, ) numpy array for N triangles: neighbor triangle index, -1 if boundary edge, -2 if edge is shared by more than 2 triangles. )pbdoc")
+    .def("PGetVertTriags", &Mesh::PGetVertTriags, py::arg("pid"), R"pbdoc( Vertex to triangles map, from cached part adjacency (see PGetTriagsNeighbors()). Returns tuple of numpy arrays (offsets (V+1, ), triangle indexes (N*3, )) for V part vertices and N triangles; triangles of part vertex i (in part vertex order) are triags[offsets[i]:offsets[i+1]], ascending. )pbdoc")
+    .def("PGetBoundaryEdges", &Mesh::PGetBoundaryEdges, py::arg("pid"), R"pbdoc( Boundary edges, from cached part adjacency (see PGetTriagsNeighbors()). Returns (B, ) numpy array of half-edge indexes 3 * t + k, ascending. Index PGetTriagsVidx() with h and 3 * (h // 3) + (h + 1) % 3 to get edge vertices. )pbdoc")
+    .def("PGetComponents", &Mesh::PGetComponents, py::arg("pid"), R"pbdoc( Label connected components of part triangles (triangles sharing vertices), by union-find. Labels are numbered from 0 in order of first triangle. Returns (N, ) numpy array for N triangles. )pbdoc")
+    .def("PFindSymmetry", &Mesh::PFindSymmetry, py::arg("pid_a"), py::arg("pid_b"), py::arg("eps") = 1e-3f, py::arg("axis") = 0, R"pbdoc( Match vertices of part pid_a, mirrored at the global plane normal to axis (0: x, 1: y, 2: z), to vertices of part pid_b within distance eps, by spatial hash. pid_a and pid_b may be the same part. Returns (N, ) numpy array for N vertices of pid_a: index of the nearest vertex in pid_b, -1 if none. )pbdoc")
+    .def("PRaycast", &Mesh::PRaycast, py::arg("pid"), py::arg("origin"), py::arg("dir"), R"pbdoc( Nearest hit of ray origin + t * dir, t >= 0, on either side of part triangles, in global coordinates. BVH over part triangles is built on first query and cached until the part is modified. Returns tuple (triangle index, t), (-1, -1.0) if no hit. )pbdoc")
+    .def("PRaycastBatch", &Mesh::PRaycastBatch, py::arg("pid"), py::arg("origins"), py::arg("dirs"), R"pbdoc( Expects (N*3, ) numpy arrays for N rays. Uses cached BVH of part. Returns tuple of (N, ) numpy arrays (triangle indexes, t). )pbdoc")
+    .def("PClosestPoint", &Mesh::PClosestPoint, py::arg("pid"), py::arg("point"), R"pbdoc( Closest point on part triangles, in global coordinates. BVH over part triangles is built on first query and cached until the part is modified. Returns tuple (triangle index, (3, ) numpy array, distance), triangle index -1 if part has no triangles. )pbdoc")
+    .def("PClosestPointBatch", &Mesh::PClosestPointBatch, py::arg("pid"), py::arg("points"), R"pbdoc( Expects (N*3, ) numpy array for N points. Uses cached BVH of part. Returns tuple of numpy arrays (triangle indexes (N, ), closest points (N*3, ), distances (N, )). )pbdoc")
+
     .def_property_readonly("MVertsGetMap_idx2order", &Mesh::MVertsGetMap_idx2order, R"pbdoc( Maps from global vert indexes (contained in triangles) to global vertex order. )pbdoc")
     .def_property("MVertsPos", &Mesh::MGetVertsPos, &Mesh::MSetVertsPos, R"pbdoc( Local vertice positions. Returns (N*3, ) numpy array for N vertices. )pbdoc")
     .def_property("MVertsNorms", &Mesh::MGetVertsNorms, &Mesh::MSetVertsNorms, R"pbdoc( Returns (N*3, ) numpy array for N vertices. )pbdoc")
@@ -1218,13 +1916,30 @@ PYBIND11_MODULE(fcecodec, fcecodec_module, py::mod_gil_not_used())
     .def("OpAddHelperPart", &Mesh::OpAddHelperPart, py::arg("name"), py::arg("new_center") = std::array<float, 3>({0.0f, 0.0f, 0.0f}), R"pbdoc( Add diamond-shaped part at coordinate origin or at optionally given position. )pbdoc")
     .def("OpCenterPart", &Mesh::OpCenterPart, py::arg("pid"), R"pbdoc( Center specified part to local centroid. Does not move part w.r.t. to global coordinates. )pbdoc")
     .def("OpSetPartCenter", &Mesh::OpSetPartCenter, py::arg("pid"), py::arg("new_center"), R"pbdoc( Center specified part to given position. Does not move part w.r.t. to global coordinates. )pbdoc")
+    .def("OpComputeNormals", &Mesh::OpComputeNormals, py::arg("pid") = -1, py::arg("mode") = "area", py::arg("crease_angle") = py::none(), py::arg("apply_to_damage") = true, R"pbdoc( Recompute vertex normals of part pid, or of all parts if pid < 0. mode: 'area' or 'angle' weighted face normals. Coincident part vertices (e.g., split at texture seams) share normals within crease_angle (degrees); None disables sharing. If apply_to_damage, damaged normals are recomputed from damaged vertice positions. )pbdoc")
+    .def("OpTransform", &Mesh::OpTransform, py::arg("matrix"), py::arg("pids") = py::none(), py::arg("apply_to_damage") = true, py::arg("transform_normals") = true, R"pbdoc( Affine transform by 4x4 matrix (row-major, column vectors). If pids is None, transforms all parts and dummies; else listed parts only. Part positions get the full transform, local vertex positions the linear part. Normals are transformed by the inverse transpose, keeping their length. Mirroring flips triangle winding. )pbdoc")
+    .def("OpGenerateDamage", &Mesh::OpGenerateDamage, py::arg("pids"), py::arg("impact_points"), py::arg("radius"), py::arg("strength"), py::arg("seed") = 0, py::arg("crease_angle") = py::none(), R"pbdoc( Generate damaged vertice positions of parts pids (all parts if None). impact_points: (N*3, ) or (N, 3) numpy array of N points in global coordinates. Vertices within radius of an impact point are pushed inwards along their normals by strength * (1 - d^2 / radius^2)^2, jittered by seed; impacts add up. Other vertices are undamaged. Damaged normals are recomputed where damaged positions changed, with crease_angle as in OpComputeNormals(); other damaged normals are kept. )pbdoc")
+    .def("OpMirrorPart", &Mesh::OpMirrorPart, py::arg("pid"), py::arg("axis") = 0, py::arg("new_name") = "", R"pbdoc( Append a copy of part pid, mirrored at the global plane normal to axis (0: x, 1: y, 2: z), e.g. to make a right-hand part from a left-hand part. Part position, vertices, normals, and damaged positions/normals are mirrored; triangle winding is reversed. Empty new_name keeps the name of pid. Returns new part index. )pbdoc")
     .def("OpCopyPart", &Mesh::OpCopyPart, py::arg("pid_src"), R"pbdoc( Copy specified part. Returns new part index. )pbdoc")
     .def("OpInsertPart", &Mesh::OpInsertPart, py::arg("mesh_src"), py::arg("pid_src"), R"pbdoc( Insert (copy) specified part from mesh_src. Returns new part index. )pbdoc")
     .def("OpDeletePart", &Mesh::OpDeletePart, py::arg("pid"))
     .def("OpDeletePartTriags", &Mesh::OpDeletePartTriags, py::arg("pid"), py::arg("idxs"))
-    .def("OpDelUnrefdVerts", &Mesh::OpDelUnrefdVerts, R"pbdoc( Delete all vertices that are not referenced by any triangle. This is a very expensive operation. Unreferenced vertices occur after triangles are deleted or they are otherwise present in data. )pbdoc")
+    .def("OpDeleteTriags", &Mesh::OpDeleteTriags, py::arg("pids"), py::arg("idxs"), R"pbdoc( Delete triangles idxs[i] of parts pids[i] in one pass. Indexes are by order, as for OpDeletePartTriags(). Nothing is deleted if any index is out of range. )pbdoc")
+    .def("OpDeleteTriags", &Mesh::OpDeleteTriagsDict, py::arg("triags"), R"pbdoc( triags: {pid: [idx, ...], ...} )pbdoc")
+    .def("OpSortPartTriags", &Mesh::OpSortPartTriags, py::arg("pid"), py::arg("key") = "flag_mask", py::arg("mask") = 0x8, R"pbdoc( Stable sort of part triangles. key='flag_mask': triangles with (flag & mask) != 0 go last, e.g. semi-transparent (0x8). key='flag': by (flag & mask). key='texpage': by texpage. Vertices are unchanged. )pbdoc")
+    .def("OpOptimizeVertexCache", &Mesh::OpOptimizeVertexCache, py::arg("pid"), py::arg("reorder_verts") = false, R"pbdoc( Reorder part triangles for GPU post-transform vertex cache hits (Forsyth). Semi-transparent (flag 0x8) triangles keep their positions, as their draw order matters. If reorder_verts, part vertices are also reordered by first use; this permutes vertex order, so that arrays from MVertsPos, MVertsNorms, etc. and vert indexes from PGetTriagsVidx() taken before no longer line up (see MVertsGetMap_idx2order). Geometry is unchanged. )pbdoc")
+    .def("OpSplitComponents", &Mesh::OpSplitComponents, py::arg("pid"), R"pbdoc( Split part into its connected components (see PGetComponents()), in one pass. Part pid keeps component 0; components 1.. are appended as new parts with name and position of pid. Returns number of components. )pbdoc")
+    .def("OpSplitPart", &Mesh::OpSplitPart, py::arg("pid"), py::arg("mask"), py::arg("value"), py::arg("key") = "flag", R"pbdoc( Move matching part triangles to a new part, in one pass. key='flag': (flag & mask) == value. key='texpage': (texpage & mask) == value. key='flag_mask': (flag & mask) != 0, value is ignored. Vertices shared with remaining triangles are duplicated. New part is appended with name and position of pid. Returns new part index. )pbdoc")
+    .def("OpDelUnrefdVerts", &Mesh::OpDelUnrefdVerts, py::arg("compact") = false, R"pbdoc( Delete all vertices that are not referenced by any triangle. Linear in the number of vertices and triangles. Unreferenced vertices occur after triangles are deleted or they are otherwise present in data. If compact, also closes gaps in part index arrays left by deleted vertices and triangles; part, triangle, and vertex order are kept. )pbdoc")
+    .def("OpDelPartUnrefdVerts", &Mesh::OpDelPartUnrefdVerts, py::arg("pid"), py::arg("compact") = false, R"pbdoc( Same as OpDelUnrefdVerts() for specified part only. Cheap enough to call after each triangle deletion. )pbdoc")
+    .def("OpWeldVertices", &Mesh::OpWeldVertices, py::arg("pid"), py::arg("epsilon") = 1e-5f, py::arg("compare_normals") = true, py::arg("compare_damage") = true, R"pbdoc( Merge part vertices within distance epsilon, e.g. after IoGeomDataToNewPart(). Optionally, normals and damaged positions/normals must be within epsilon, too. Returns number of deleted vertices. )pbdoc")
+    .def("OpDecimatePart", &Mesh::OpDecimatePart, py::arg("pid"), py::arg("target_triags"), py::arg("preserve_uv_seams") = true, R"pbdoc( Simplify part pid towards target_triags triangles by quadric error edge collapses, e.g. to generate LODs. Result is appended as new part with name and position of pid; pid is unchanged. Triangle flags, texpages, texture coordinates, and damaged positions are kept. If preserve_uv_seams, vertices on texture seams are not moved. Collapses that flip a triangle or duplicate an existing one are rejected, and decimation stops early if no valid collapse is left. So target_triags is a lower bound; e.g., a closed part keeps at least 4 triangles. Raises RuntimeError if target_triags < 1. Returns new part index. )pbdoc")
     .def("OpMergeParts", &Mesh::OpMergeParts, py::arg("pid1"), py::arg("pid2"), R"pbdoc( Returns new part index. )pbdoc")
+    .def("OpMergeParts", &Mesh::OpMergePartsList, py::arg("pids"), R"pbdoc( Merge all parts in pids into part pids[0], in one pass. Vertices and triangles are moved in given part order. Merged part keeps name and order position of pids[0]; other parts are removed. Returns new part index. )pbdoc")
     .def("OpMovePart", &Mesh::OpMovePart, py::arg("pid"), R"pbdoc( Move up specified part towards order 0. Returns new part index. )pbdoc")
+    .def("OpReorderParts", &Mesh::OpReorderParts, py::arg("new_order"), R"pbdoc( Reorder all parts in one call. new_order[i] is the current index of the part that is moved to index i. )pbdoc")
+    .def("OpSortPartsToFce3Order", &Mesh::OpSortPartsToFce3Order, R"pbdoc( Sort parts to canonical FCE3 order by name. Recognizes FCE3, FCE4, and FCE4M names of the same parts. Other parts are moved to the end, keeping their relative order. )pbdoc")
+    .def("OpSortPartsToFce4Order", &Mesh::OpSortPartsToFce4Order, R"pbdoc( Sort parts to canonical FCE4 high body order by name (:HB, :OT, :OL, ..., :HRRW). Recognizes FCE3 names of the same parts. Other parts, e.g. medium and low LOD parts, are moved to the end, keeping their relative order. )pbdoc")
     ;
 
 #ifdef VERSION_INFO
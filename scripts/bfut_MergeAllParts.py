@@ -62,15 +62,9 @@ def main():
 
     # merge
     if mesh.MNumParts > 1:
-        pid1 = mesh.MNumParts - 1
-        for pid2 in reversed(range(mesh.MNumParts - 1)):
-            print("merging parts", pid1, pid2)
-            pid1 = mesh.OpMergeParts(pid1, pid2)
-
-    # cleanup
-    while mesh.MNumParts > 1:
-        print("deleting part", mesh.PGetName(0))
-        mesh.OpDeletePart(0)
+        pids = list(reversed(range(mesh.MNumParts)))
+        print("merging parts", pids)
+        mesh.OpMergeParts(pids)
 
     if fce_outversion == "4":
         mesh.PSetName(0, ":HB")
@@ -118,11 +118,18 @@ def main():
     del partnames  # list outdated and no longer needed
 
     # Sort
-    for target_pid in range(len(partnames_source)):
-        pname = partnames_source[target_pid]
-        current_pid = GetMeshPartnameIdx(mesh, pname)
-        while current_pid > target_pid:
-            current_pid = mesh.OpMovePart(current_pid)
+    partnames = GetMeshPartnames(mesh)
+    used = [False] * len(partnames)
+    new_order = []
+    for pname in partnames_source:
+        # duplicate names map to distinct parts, in order; surplus names are skipped
+        pid = next((pid for pid in range(len(partnames)) if not used[pid] and partnames[pid] == pname), -1)
+        if pid < 0:
+            continue
+        used[pid] = True
+        new_order += [pid]
+    new_order += [pid for pid in range(len(partnames)) if not used[pid]]
+    mesh.OpReorderParts(new_order)
     AssertPartsOrder(mesh, partnames_source)
 
     # Output FCE
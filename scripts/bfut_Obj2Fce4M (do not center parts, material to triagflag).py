@@ -51,6 +51,7 @@ CONFIG = {
     "material2texpage"    : 0,  # maps OBJ face materials to FCE texpages (expects 0|1)
     "material2triagflag"  : 1,  # maps OBJ face materials to FCE triangles flag (expects 0|1)
     "normals2vertices"    : 0,  #  (expects 0|1)
+    "recompute_normals"   : 0,  # area-weighted vertice normals, ignores OBJ normals (expects 0|1)
 }
 
 # Parse command-line
@@ -508,6 +509,8 @@ def main():
     mesh = SetAnimatedVerts(mesh)
     if CONFIG["center_parts"] == 1:
         mesh = CenterParts(mesh)
+    if CONFIG["recompute_normals"] == 1:
+        mesh.OpComputeNormals()
     if CONFIG["normals2vertices"] == 1:
         # replace verts with normals, preserve part positions
         mesh.MVertsPos = mesh.MVertsNorms
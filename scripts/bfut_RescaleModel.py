@@ -33,6 +33,7 @@ import argparse
 import pathlib
 
 import fcecodec as fc
+import numpy as np
 
 from bfut_mywrappers import *  # fcecodec/scripts/bfut_mywrappers.py
 
@@ -85,12 +86,8 @@ def main():
     if rescale_factor >= 0.01:
         for pid in reversed(range(mesh.MNumParts)):
             mesh.OpCenterPart(pid)
-            ppos = mesh.PGetPos(pid)  # xyz
-            mesh.PSetPos(pid, ppos * rescale_factor)
-        v = mesh.MVertsPos  # xyzxyzxyz...
-        mesh.MVertsPos = v * rescale_factor
-        dv = mesh.MGetDummyPos()  # xyzxyzxyz...
-        mesh.MSetDummyPos(dv * rescale_factor)
+        # scales part positions, vertices, damaged vertices, and dummies in place
+        mesh.OpTransform(np.diag([rescale_factor, rescale_factor, rescale_factor, 1.0]).astype(np.float32))
 
     # Write FCE
     WriteFce(fce_outversion, mesh, filepath_fce_output, CONFIG["center_parts"])
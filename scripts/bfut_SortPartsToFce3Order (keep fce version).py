@@ -46,20 +46,6 @@ if len(args.path) < 2:
 else:
     filepath_fce_output = pathlib.Path(args.path[1])
 
-#
-def PrintMeshParts_order(mesh, part_names_sorted):
-    print("pid  IS                          SHOULD")
-    for pid in range(mesh.MNumParts):
-        print(f"{pid:<2} {mesh.PGetName(pid):<12} {part_names_sorted[pid]:<12}")
-
-def AssertPartsOrder(mesh, part_names_sorted, onlywarn=False):
-    for pid in range(mesh.MNumParts):
-        if mesh.PGetName(pid) != part_names_sorted[pid]:
-            PrintMeshParts_order(mesh, part_names_sorted)
-            if not onlywarn:
-                raise AssertionError (f"pid={pid} {mesh.PGetName(pid)} != {part_names_sorted[pid]}")
-            print(f"AssertPartsOrder: Warning pid={pid} {mesh.PGetName(pid)} != {part_names_sorted[pid]}")
-
 #
 def main():
     if CONFIG["fce_version"] == "keep":
@@ -73,51 +59,9 @@ def main():
 
     # sort
     if mesh.MNumParts > 1:
-        priority_dic = {  # NB1: front wheel order differs for high body/medium body
-            "high body": 0,
-            "left front wheel": 1,
-            "right front wheel": 2,
-            "left rear wheel": 3,
-            "right rear wheel": 4,
-            "medium body": 5,
-            "medium r front wheel": 6,
-            "medium l front wheel": 7,
-            "medium r rear wheel": 8,
-            "medium l rear wheel": 9,
-            "small body": 10,
-            "tiny body": 11,
-            "high headlights": 12,
-
-            ":HB": 0,
-            ":HLFW": 1,
-            ":HRFW": 2,
-            ":HLRW": 3,
-            ":HRRW": 4,
-            ":MB": 5,
-            ":MRFW": 6,
-            ":MLFW": 7,
-            ":MRRW": 8,
-            ":MLRW": 9,
-            ":LB": 10,
-            ":TB": 11,
-            ":OL": 12,
-
-            ":Hbody": 0,
-        }
-
-        part_names = []
-        for pid in reversed(range(mesh.MNumParts)):
-            part_names += [mesh.PGetName(pid)]
-        part_names_sorted = sorted(part_names, key=lambda x: priority_dic.get(x, 64))
-
-        for target_idx in range(0, len(part_names_sorted)):
-            pname = part_names_sorted[target_idx]
-            current_idx = GetMeshPartnameIdx(mesh, pname)
-            # print(f" {pname} {current_idx} -> {target_idx}")
-            while current_idx > target_idx:
-                current_idx = mesh.OpMovePart(current_idx)
-        AssertPartsOrder(mesh, part_names_sorted, onlywarn=True)
-        # PrintMeshParts(mesh, part_names_sorted)
+        mesh.OpSortPartsToFce3Order()
+        for pid in range(mesh.MNumParts):
+            print(f"{pid:<2} {mesh.PGetName(pid):<12}")
 
     WriteFce(fce_outversion, mesh, filepath_fce_output)
     PrintFceInfo(filepath_fce_output)
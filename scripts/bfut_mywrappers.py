@@ -24,34 +24,22 @@ import pathlib
 import fcecodec as fc
 import numpy as np
 
-def ReorderTriagsTransparentDetachedAndToLast(mesh, pid_opaq):
-    """ Copy original part, delete semi-transparent triags in original,
-        delete opaque triags in copy, clean-up unreferenced verts, merge parts,
-        delete temporary & original, move merged part to original index """
-    pid_transp = mesh.OpCopyPart(pid_opaq)
-    mesh.OpDeletePartTriags(pid_opaq, np.where(mesh.PGetTriagsFlags(pid_opaq) & 0x8 == 0x8)[0])
-    mesh.OpDeletePartTriags(pid_transp, np.where(mesh.PGetTriagsFlags(pid_transp) & 0x8 < 0x8)[0])
-    mesh.OpDelUnrefdVerts()
-    new_pid = mesh.OpMergeParts(pid_opaq, pid_transp)  # last part idx
-    mesh.PSetName(new_pid, mesh.PGetName(pid_opaq))
-    mesh.OpDeletePart(pid_transp)
-    mesh.OpDeletePart(pid_opaq)
-    new_pid -= 2  # last part idx is now smaller
-    while new_pid > pid_opaq:
-        new_pid = mesh.OpMovePart(new_pid)  # move merged part to original index
+def ReorderTriagsTransparentToLast(mesh, pid):
+    """ Move semi-transparent triags (flag 0x8) to the end of part, keeping order """
+    mesh.OpSortPartTriags(pid, "flag_mask", 0x8)
     return mesh
 
 def HiBody_ReorderTriagsTransparentToLast(mesh, version):
     """ Not implemented for FCE4M because windows are separate parts """
     if version in ("3", 3):
-        mesh = ReorderTriagsTransparentDetachedAndToLast(mesh, 0)  # high body
+        mesh = ReorderTriagsTransparentToLast(mesh, 0)  # high body
         if mesh.MNumParts > 12:
-            mesh = ReorderTriagsTransparentDetachedAndToLast(mesh, 12)  # high headlights
+            mesh = ReorderTriagsTransparentToLast(mesh, 12)  # high headlights
     elif version in ("4", 4):
         for partname in (":HB", ":OT", ":OL"):
             pid = GetMeshPartnameIdx(mesh, partname)
             if pid >= 0:
-                mesh = ReorderTriagsTransparentDetachedAndToLast(mesh, pid)
+                mesh = ReorderTriagsTransparentToLast(mesh, pid)
     return mesh
 
 def GetFceVersion(path):
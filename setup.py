@@ -57,7 +57,7 @@ if "PYMEM_MALLOC" in os.environ:
     extra_compile_args += [ "-DPYMEM_MALLOC" ]
 if "FCELIB_PYTHON_DEBUG" in os.environ:
     print(f'FCELIB_PYTHON_DEBUG={os.environ["FCELIB_PYTHON_DEBUG"]}')
-    extra_compile_args += [ "-FCELIB_PYTHON_DEBUG" ]
+    extra_compile_args += [ "-DFCELIB_PYTHON_DEBUG" ]
 if platform.system().lower() == "windows":
     extra_compile_args += [
         ("/D_CRT_NONSTDC_NO_WARNINGS"),
@@ -59,8 +59,10 @@ static void SCL_printf(const char *format, ...) { (void)format; }
 #if defined(SCL_DEBUG) && SCL_DEBUG > 0
 #include "./fcelib_diagnostics.h"
 #endif
+#include "./fcelib_bvh.h"
 #include "./fcelib_fcetypes.h"
 #include "./fcelib_io.h"
+#include "./fcelib_journal.h"
 #include "./fcelib_op.h"
 #include "./fcelib_types.h"
 
@@ -72,23 +74,70 @@ extern "C" {
 
 void (*FCELIB_MeshRelease)(FcelibMesh *mesh) = FCELIB_TYPES_MeshRelease;
 FcelibMesh *(*FCELIB_MeshInit)(FcelibMesh *mesh) = FCELIB_TYPES_MeshInit;
+FcelibMesh *(*FCELIB_MeshClone)(FcelibMesh *mesh, const FcelibMesh *mesh_src) = FCELIB_TYPES_MeshClone;
 void (*FCELIB_PrintMeshInfo)(const FcelibMesh *mesh) = FCELIB_TYPES_PrintMeshInfo;
+int (*FCELIB_MeshValidateSummary)(const FcelibMesh *mesh) = FCELIB_TYPES_ValidateMeshSummary;
+int (*FCELIB_MeshMemoryStats)(const FcelibMesh *mesh, FcelibMemoryStats *stats) = FCELIB_TYPES_MeshMemoryStats;
+void (*FCELIB_PartInvalidateCaches)(FcelibPart *part) = FCELIB_TYPES_PartInvalidateCaches;  /* call after writing to part, triags, verts directly */
 
 /* mesh: operations ------------------------------------------------------------------------------------------------- */
 
 int (*FCELIB_AddHelperPart)(FcelibMesh *mesh) = FCELIB_OP_AddHelperPart;
 int (*FCELIB_CenterPart)(FcelibMesh *mesh, int pid) = FCELIB_OP_CenterPart;
 int (*FCELIB_SetPartCenter)(FcelibMesh *mesh, int pid, const float new_center[3]) = FCELIB_OP_SetPartCenter;
+int (*FCELIB_Transform)(FcelibMesh *mesh, const float matrix[16], const int *pids, const int pids_len, const int apply_to_damage, const int transform_normals) = FCELIB_OP_Transform;
+int (*FCELIB_MirrorPart)(FcelibMesh *mesh, const int pid, const int axis, const char *new_name) = FCELIB_OP_MirrorPart;
+int (*FCELIB_ComputeNormals)(FcelibMesh *mesh, const int pid, const int mode, const float crease_cos, const int apply_to_damage) = FCELIB_OP_ComputeNormals;
+int (*FCELIB_GenerateDamage)(FcelibMesh *mesh, const int *pids, const int pids_len, const float *impacts, const int num_impacts, const float radius, const float strength, const unsigned long seed, const float crease_cos) = FCELIB_OP_GenerateDamage;
 int (*FCELIB_CopyPartToMesh)(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src) = FCELIB_OP_CopyPartToMesh;
 void (*FCELIB_DeletePart)(FcelibMesh *mesh, int pid) = FCELIB_OP_DeletePart;
+int (*FCELIB_DeleteTriags)(FcelibMesh *mesh, const int *pids, const int *idxs, int idxs_len) = FCELIB_OP_DeleteTriags;
 int (*FCELIB_DeletePartTriags)(FcelibMesh *mesh, const int pid, const int *idxs, int idxs_len) = FCELIB_OP_DeletePartTriags;
-int (*FCELIB_DeleteUnrefdVerts)(FcelibMesh *mesh) = FCELIB_OP_DeleteUnrefdVerts;
+int (*FCELIB_SortPartTriags)(FcelibMesh *mesh, const int pid, const int key, const int mask) = FCELIB_OP_SortPartTriags;
+int (*FCELIB_OptimizeVertexCache)(FcelibMesh *mesh, const int pid, const int reorder_verts) = FCELIB_OP_OptimizeVertexCache;
+int (*FCELIB_DeleteUnrefdVerts)(FcelibMesh *mesh, const int compact) = FCELIB_OP_DeleteUnrefdVerts;
+int (*FCELIB_DeletePartUnrefdVerts)(FcelibMesh *mesh, const int pid, const int compact) = FCELIB_OP_DeletePartUnrefdVerts;
+int (*FCELIB_WeldVertices)(FcelibMesh *mesh, const int pid, const float epsilon, const int compare_normals, const int compare_damage) = FCELIB_OP_WeldVertices;
+int (*FCELIB_DecimatePart)(FcelibMesh *mesh, const int pid, const int target_triags, const int preserve_uv_seams) = FCELIB_OP_DecimatePart;
 int (*FCELIB_MergePartsToNew)(FcelibMesh *mesh, int pid1, int pid2) = FCELIB_OP_MergePartsToNew;
+int (*FCELIB_MergeParts)(FcelibMesh *mesh, const int *pids, const int pids_len) = FCELIB_OP_MergeParts;
+int (*FCELIB_SplitPart)(FcelibMesh *mesh, const int pid, const int key, const int mask, const int value) = FCELIB_OP_SplitPart;
+int (*FCELIB_SplitComponents)(FcelibMesh *mesh, const int pid) = FCELIB_OP_SplitComponents;
 /* void (*FCELIB_MeshSwapParts)(FcelibMesh *mesh, const int pid1, const int pid2) = FCELIB_OP_SwapParts; */
 int (*FCELIB_MeshMoveUpPart)(FcelibMesh *mesh, const int pid) = FCELIB_OP_MoveUpPart;
+int (*FCELIB_ReorderParts)(FcelibMesh *mesh, const int *new_order, const int new_order_len) = FCELIB_OP_ReorderParts;
+int (*FCELIB_SortPartsToFce3Order)(FcelibMesh *mesh) = FCELIB_OP_SortPartsToFce3Order;
+int (*FCELIB_SortPartsToFce4Order)(FcelibMesh *mesh) = FCELIB_OP_SortPartsToFce4Order;
+
+/* mesh: queries ---------------------------------------------------------------------------------------------------- */
+
+const FcelibAdjacency *(*FCELIB_GetPartAdjacency)(FcelibMesh *mesh, const int pid) = FCELIB_OP_GetPartAdjacency;
+int (*FCELIB_GetPartComponents)(const FcelibMesh *mesh, const int pid, int *labels) = FCELIB_OP_GetPartComponents;
+int (*FCELIB_FindSymmetry)(const FcelibMesh *mesh, const int pid_a, const int pid_b, const int axis, const float epsilon, int *matches) = FCELIB_OP_FindSymmetry;
+const FcelibBvh *(*FCELIB_GetPartBvh)(FcelibMesh *mesh, const int pid) = FCELIB_BVH_GetPartBvh;
+int (*FCELIB_BvhBuild)(FcelibBvh *bvh, const FcelibMesh *mesh, const int pid) = FCELIB_BVH_Build;
+void (*FCELIB_BvhRelease)(FcelibBvh *bvh) = FCELIB_BVH_Release;
+int (*FCELIB_BvhRaycast)(const FcelibBvh *bvh, const float origin[3], const float dir[3], float *t) = FCELIB_BVH_Raycast;
+int (*FCELIB_BvhClosestPoint)(const FcelibBvh *bvh, const float point[3], float closest[3], float *dist2) = FCELIB_BVH_ClosestPoint;
+
+/* mesh: journal --------------------------------------------------------------------------------------------------- */
+
+void (*FCELIB_JournalInit)(FcelibJournal *journal, const long budget) = FCELIB_JOURNAL_Init;
+void (*FCELIB_JournalRelease)(FcelibJournal *journal) = FCELIB_JOURNAL_Release;
+void (*FCELIB_JournalSetBudget)(FcelibJournal *journal, const long budget) = FCELIB_JOURNAL_SetBudget;
+int (*FCELIB_JournalBegin)(FcelibJournal *journal, const FcelibMesh *mesh, const int *pids, const int pids_len) = FCELIB_JOURNAL_Begin;
+int (*FCELIB_JournalRecord)(FcelibJournal *journal, const FcelibMesh *mesh) = FCELIB_JOURNAL_Record;
+int (*FCELIB_JournalUndo)(FcelibJournal *journal, FcelibMesh *mesh) = FCELIB_JOURNAL_Undo;
+int (*FCELIB_JournalRedo)(FcelibJournal *journal, FcelibMesh *mesh) = FCELIB_JOURNAL_Redo;
 
 /* util  ------------------------------------------------------------------------------------------------------------ */
 
+void (*FCELIB_SetAllocator)(FcelibMallocFn malloc_fn, FcelibReallocFn realloc_fn, FcelibFreeFn free_fn, void *ctx) = FCELIB_UTIL_SetAllocator;
+void (*FCELIB_SetParallelFor)(FcelibParallelForFn parallel_for_fn, void *ctx) = FCELIB_UTIL_SetParallelFor;
+void *(*FCELIB_Malloc)(size_t size) = FCELIB_UTIL_Malloc;
+void *(*FCELIB_Realloc)(void *ptr, size_t size) = FCELIB_UTIL_Realloc;
+void (*FCELIB_Free)(void *ptr) = FCELIB_UTIL_Free;
+
 int (*FCELIB_FceComputeSize)(const FcelibMesh *mesh, const int target_fce_version) = FCELIB_TYPES_FceComputeSize;
 int (*FCELIB_GetFceVersion)(const void * const buf, const int bufsz) = FCELIB_FCETYPES_GetFceVersion;
 void (*FCELIB_PrintFceInfo)(const void *buf, int bufsz) = FCELIB_FCETYPES_PrintHeaderFce;
@@ -113,6 +162,10 @@ int FCELIB_EncodeFce4M(const FcelibMesh *mesh, unsigned char **outbuf, int outbu
   return FCELIB_IO_EncodeFce4(mesh, outbuf, outbufsz, center_parts, 0x00101015);
 }
 
+int (*FCELIB_DecodeSnapshot)(FcelibMesh *mesh, const void *inbuf, int inbufsz) = FCELIB_IO_DecodeSnapshot;
+int (*FCELIB_EncodeSnapshot)(const FcelibMesh *mesh, unsigned char **outbuf, int outbufsz) = FCELIB_IO_EncodeSnapshot;
+int (*FCELIB_SnapshotComputeSize)(const FcelibMesh *mesh) = FCELIB_IO_SnapshotComputeSize;
+
 int (*FCELIB_ExportObj)(const FcelibMesh *mesh,
                         const char *objpath, const char *mtlpath,
                         const char *texture_name,
@@ -120,6 +173,15 @@ int (*FCELIB_ExportObj)(const FcelibMesh *mesh,
                         int use_part_positions,
                         int print_part_positions,
                         int filter_triagflags_0xfff) = FCELIB_IO_ExportObj;
+int (*FCELIB_ExportObjToMemory)(const FcelibMesh *mesh,
+                                char **objbuf, int *objbufsz, int *objlen,
+                                char **mtlbuf, int *mtlbufsz, int *mtllen,
+                                const char *objname, const char *mtlname,
+                                const char *texture_name,
+                                int print_damage, int print_dummies,
+                                int use_part_positions,
+                                int print_part_positions,
+                                int filter_triagflags_0xfff) = FCELIB_IO_ExportObjToMemory;
 
 /* DEPRECATED from 2.0 */
 int (*FCELIB_GeomDataToNewPart)(FcelibMesh *mesh,
@@ -0,0 +1,555 @@
+/*
+  fcelib_bvh.h
+  fcecodec Copyright (C) 2021 and later Benjamin Futasz <https://github.com/bfut>
+
+  You may not redistribute this program without its source code.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/**
+  implements bounding volume hierarchy over part triangles, for ray and
+  closest point queries
+
+  A FcelibBvh is a snapshot: it holds copies of triangle positions in global
+  coordinates (vertice position + part position) and does not refer back to
+  the mesh. Rebuild after modifying the part.
+
+  FCELIB_BVH_GetPartBvh() builds on demand and caches the BVH in the part.
+  The cache is invalidated by ops that change part topology, vertice
+  positions, or part position.
+
+  usage:
+    const FcelibBvh *bvh = FCELIB_BVH_GetPartBvh(&mesh, pid);
+    if (!bvh)  return EXIT_FAILURE;
+    // queries
+
+  or, as uncached snapshot:
+    FcelibBvh bvh;
+    if (!FCELIB_BVH_Build(&bvh, &mesh, pid))  return EXIT_FAILURE;
+    // queries
+    FCELIB_BVH_Release(&bvh);
+**/
+
+#ifndef FCELIB_BVH_H_
+#define FCELIB_BVH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./fcelib_types.h"
+#include "./fcelib_util.h"
+
+#define FCELIB_BVH_LEAFSIZE 4
+#define FCELIB_BVH_STACKSIZE 64
+
+/* build -------------------------------------------------------------------- */
+
+struct __FcelibBvhItem {
+  float c[3];  /* centroid */
+  int   t;     /* triangle index (order) in part */
+};
+
+int __FCELIB_BVH_CompareItems(const void *a, const void *b, const int axis)
+{
+  const float arg1 = ((const struct __FcelibBvhItem *)a)->c[axis];
+  const float arg2 = ((const struct __FcelibBvhItem *)b)->c[axis];
+  return (arg1 > arg2) - (arg1 < arg2);
+}
+int __FCELIB_BVH_CompareItemsX(const void *a, const void *b) { return __FCELIB_BVH_CompareItems(a, b, 0); }
+int __FCELIB_BVH_CompareItemsY(const void *a, const void *b) { return __FCELIB_BVH_CompareItems(a, b, 1); }
+int __FCELIB_BVH_CompareItemsZ(const void *a, const void *b) { return __FCELIB_BVH_CompareItems(a, b, 2); }
+
+/* Builds subtree of node over items[first, first + count), median split on longest centroid axis. */
+void __FCELIB_BVH_BuildNode(FcelibBvh *bvh, const float *tri, struct __FcelibBvhItem *items,
+                            const int node, const int first, const int count)
+{
+  int i;
+  int k;
+  int axis;
+  float cmin[3];
+  float cmax[3];
+  float *b = bvh->bounds + 6 * node;
+
+  for (k = 0; k < 3; ++k)
+  {
+    b[k] = b[3 + k] = tri[9 * items[first].t + k];
+    cmin[k] = cmax[k] = items[first].c[k];
+  }
+  for (i = first; i < first + count; ++i)
+  {
+    const float *v = tri + 9 * items[i].t;
+    for (k = 0; k < 9; ++k)
+    {
+      b[k % 3] = SCL_min(b[k % 3], v[k]);
+      b[3 + k % 3] = SCL_max(b[3 + k % 3], v[k]);
+    }
+    for (k = 0; k < 3; ++k)
+    {
+      cmin[k] = SCL_min(cmin[k], items[i].c[k]);
+      cmax[k] = SCL_max(cmax[k], items[i].c[k]);
+    }
+  }
+
+  if (count <= FCELIB_BVH_LEAFSIZE)
+  {
+    bvh->nodes[2 * node] = first;
+    bvh->nodes[2 * node + 1] = count;
+    return;
+  }
+
+  axis = 0;
+  if (cmax[1] - cmin[1] > cmax[axis] - cmin[axis])
+    axis = 1;
+  if (cmax[2] - cmin[2] > cmax[axis] - cmin[axis])
+    axis = 2;
+  switch (axis)
+  {
+    case 0: qsort(items + first, count, sizeof(*items), __FCELIB_BVH_CompareItemsX); break;
+    case 1: qsort(items + first, count, sizeof(*items), __FCELIB_BVH_CompareItemsY); break;
+    default: qsort(items + first, count, sizeof(*items), __FCELIB_BVH_CompareItemsZ); break;
+  }
+
+  i = bvh->nodes_len;
+  bvh->nodes_len += 2;
+  bvh->nodes[2 * node] = i;
+  bvh->nodes[2 * node + 1] = 0;
+  __FCELIB_BVH_BuildNode(bvh, tri, items, i, first, count / 2);
+  __FCELIB_BVH_BuildNode(bvh, tri, items, i + 1, first + count / 2, count - count / 2);
+}
+
+void FCELIB_BVH_Release(FcelibBvh *bvh)
+{
+  FCELIB_UTIL_Free(bvh->bounds);
+  FCELIB_UTIL_Free(bvh->nodes);
+  FCELIB_UTIL_Free(bvh->triags);
+  FCELIB_UTIL_Free(bvh->order);
+  memset(bvh, 0, sizeof(*bvh));
+}
+
+/*
+  Builds BVH over triangles of part pid. Call FCELIB_BVH_Release() afterwards,
+  also on failure. A part without triangles gives an empty BVH.
+  Returns bool.
+*/
+int FCELIB_BVH_Build(FcelibBvh *bvh, const FcelibMesh *mesh, const int pid)
+{
+  int retv = 0;
+  int internal_pid;
+  int i;
+  int j;
+  int k;
+  int n;
+  float *tri = NULL;  /* per triag: vert positions, in part order */
+  struct __FcelibBvhItem *items = NULL;
+  const FcelibPart *part;
+  const FcelibTriangle *triag;
+  const FcelibVertex *vert;
+
+  memset(bvh, 0, sizeof(*bvh));
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "BVH_Build: Invalid index (internal_pid)\n");
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    n = part->PNumTriangles;
+    if (n < 1)
+    {
+      retv = 1;
+      break;
+    }
+
+    tri = (float *)FCELIB_UTIL_Malloc(9 * n * sizeof(*tri));
+    items = (struct __FcelibBvhItem *)FCELIB_UTIL_Malloc(n * sizeof(*items));
+    bvh->bounds = (float *)FCELIB_UTIL_Malloc(2 * n * 6 * sizeof(*bvh->bounds));
+    bvh->nodes = (int *)FCELIB_UTIL_Malloc(2 * n * 2 * sizeof(*bvh->nodes));
+    bvh->triags = (float *)FCELIB_UTIL_Malloc(9 * n * sizeof(*bvh->triags));
+    bvh->order = (int *)FCELIB_UTIL_Malloc(n * sizeof(*bvh->order));
+    if (!tri || !items || !bvh->bounds || !bvh->nodes || !bvh->triags || !bvh->order)
+    {
+      fprintf(stderr, "BVH_Build: Cannot allocate memory\n");
+      break;
+    }
+
+    for (j = 0, i = 0; j < part->ptriangles_len && i < n; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        vert = mesh->vertices[ triag->vidx[k] ];
+        tri[9 * i + 3 * k + 0] = vert->VertPos.x + part->PartPos.x;
+        tri[9 * i + 3 * k + 1] = vert->VertPos.y + part->PartPos.y;
+        tri[9 * i + 3 * k + 2] = vert->VertPos.z + part->PartPos.z;
+      }
+      for (k = 0; k < 3; ++k)
+        items[i].c[k] = (tri[9 * i + k] + tri[9 * i + 3 + k] + tri[9 * i + 6 + k]) * (1.0f / 3.0f);
+      items[i].t = i;
+      ++i;
+    }
+    n = i;
+
+    bvh->nodes_len = 1;
+    __FCELIB_BVH_BuildNode(bvh, tri, items, 0, 0, n);
+
+    /* Store triags in leaf order */
+    for (i = 0; i < n; ++i)
+    {
+      memcpy(bvh->triags + 9 * i, tri + 9 * items[i].t, 9 * sizeof(*tri));
+      bvh->order[i] = items[i].t;
+    }
+    bvh->triags_len = n;
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(tri);
+  FCELIB_UTIL_Free(items);
+
+  return retv;
+}
+
+/*
+  Returns cached BVH of part pid, builds it if necessary. The pointer is
+  valid until the part is modified.
+  Returns NULL on failure.
+*/
+const FcelibBvh *FCELIB_BVH_GetPartBvh(FcelibMesh *mesh, const int pid)
+{
+  int internal_pid;
+  FcelibPart *part;
+  FcelibBvh *bvh;
+
+  internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+  if (internal_pid < 0)
+  {
+    fprintf(stderr, "BVH_GetPartBvh: Invalid index (internal_pid)\n");
+    return NULL;
+  }
+  part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+  if (part->bvh)
+    return part->bvh;
+
+  bvh = (FcelibBvh *)FCELIB_UTIL_Malloc(sizeof(*bvh));
+  if (!bvh)
+  {
+    fprintf(stderr, "BVH_GetPartBvh: Cannot allocate memory\n");
+    return NULL;
+  }
+  if (!FCELIB_BVH_Build(bvh, mesh, pid))
+  {
+    FCELIB_BVH_Release(bvh);
+    FCELIB_UTIL_Free(bvh);
+    return NULL;
+  }
+  part->bvh = bvh;
+  return part->bvh;
+}
+
+/* queries ------------------------------------------------------------------ */
+
+/* Slab test. Returns 1 if ray hits box before tmax. */
+int __FCELIB_BVH_RayBox(const float *b, const float o[3], const float inv_d[3], const float tmax)
+{
+  float t0 = 0.0f;
+  float t1 = tmax;
+  int k;
+  for (k = 0; k < 3; ++k)
+  {
+    float tn = (b[k] - o[k]) * inv_d[k];
+    float tf = (b[3 + k] - o[k]) * inv_d[k];
+    if (tn > tf)
+    {
+      const float tmp = tn;
+      tn = tf;
+      tf = tmp;
+    }
+    if (tn > t0)
+      t0 = tn;
+    if (tf < t1)
+      t1 = tf;
+    if (t0 > t1)
+      return 0;
+  }
+  return 1;
+}
+
+/* Moller-Trumbore, two-sided. Returns t >= 0, or -1 if no hit. */
+float __FCELIB_BVH_RayTriag(const float *v, const float o[3], const float d[3])
+{
+  float e1[3];
+  float e2[3];
+  float p[3];
+  float s[3];
+  float q[3];
+  float det;
+  float inv;
+  float u;
+  float w;
+  float t;
+  int k;
+  for (k = 0; k < 3; ++k)
+  {
+    e1[k] = v[3 + k] - v[k];
+    e2[k] = v[6 + k] - v[k];
+    s[k] = o[k] - v[k];
+  }
+  p[0] = d[1] * e2[2] - d[2] * e2[1];
+  p[1] = d[2] * e2[0] - d[0] * e2[2];
+  p[2] = d[0] * e2[1] - d[1] * e2[0];
+  det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  if (det == 0.0f)
+    return -1.0f;
+  inv = 1.0f / det;
+  u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+  if (u < 0.0f || u > 1.0f)
+    return -1.0f;
+  q[0] = s[1] * e1[2] - s[2] * e1[1];
+  q[1] = s[2] * e1[0] - s[0] * e1[2];
+  q[2] = s[0] * e1[1] - s[1] * e1[0];
+  w = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+  if (w < 0.0f || u + w > 1.0f)
+    return -1.0f;
+  t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+  return t >= 0.0f ? t : -1.0f;
+}
+
+/*
+  Nearest hit of ray origin + t * dir, t >= 0, on either triangle side. dir
+  need not be normalized; t is in units of dir.
+  Returns triangle index (order) in part, -1 if no hit. Sets t on hit.
+*/
+int FCELIB_BVH_Raycast(const FcelibBvh *bvh, const float origin[3], const float dir[3], float *t)
+{
+  int hit = -1;
+  int stack[FCELIB_BVH_STACKSIZE];
+  int sp = 0;
+  int i;
+  int k;
+  float best = 3.0e38f;
+  float inv_d[3];
+
+  if (bvh->triags_len < 1)
+    return -1;
+  for (k = 0; k < 3; ++k)
+    inv_d[k] = dir[k] != 0.0f ? 1.0f / dir[k] : (dir[k] < 0.0f ? -3.0e38f : 3.0e38f);
+
+  stack[sp++] = 0;
+  while (sp > 0)
+  {
+    const int node = stack[--sp];
+    const int *nd = bvh->nodes + 2 * node;
+    if (!__FCELIB_BVH_RayBox(bvh->bounds + 6 * node, origin, inv_d, best))
+      continue;
+    if (nd[1] > 0)
+    {
+      for (i = nd[0]; i < nd[0] + nd[1]; ++i)
+      {
+        const float ti = __FCELIB_BVH_RayTriag(bvh->triags + 9 * i, origin, dir);
+        if (ti >= 0.0f && ti < best)
+        {
+          best = ti;
+          hit = i;
+        }
+      }
+    }
+    else if (sp + 2 <= FCELIB_BVH_STACKSIZE)
+    {
+      stack[sp++] = nd[0] + 1;
+      stack[sp++] = nd[0];
+    }
+  }
+
+  if (hit < 0)
+    return -1;
+  *t = best;
+  return bvh->order[hit];
+}
+
+/* Squared distance of p to box, 0 if inside. */
+float __FCELIB_BVH_BoxDist2(const float *b, const float p[3])
+{
+  float d2 = 0.0f;
+  int k;
+  for (k = 0; k < 3; ++k)
+  {
+    float d = 0.0f;
+    if (p[k] < b[k])
+      d = b[k] - p[k];
+    else if (p[k] > b[3 + k])
+      d = p[k] - b[3 + k];
+    d2 += d * d;
+  }
+  return d2;
+}
+
+/* Closest point on triangle v to p (Ericson, Real-Time Collision Detection, 5.1.5). Result in c. */
+void __FCELIB_BVH_ClosestPtTriag(const float *v, const float p[3], float c[3])
+{
+  const float *a = v;
+  const float *b = v + 3;
+  const float *cc = v + 6;
+  float ab[3];
+  float ac[3];
+  float ap[3];
+  float bp[3];
+  float cp[3];
+  float d1;
+  float d2;
+  float d3;
+  float d4;
+  float d5;
+  float d6;
+  float va;
+  float vb;
+  float vc;
+  float s;
+  float w;
+  int k;
+
+  for (k = 0; k < 3; ++k)
+  {
+    ab[k] = b[k] - a[k];
+    ac[k] = cc[k] - a[k];
+    ap[k] = p[k] - a[k];
+  }
+  d1 = ab[0] * ap[0] + ab[1] * ap[1] + ab[2] * ap[2];
+  d2 = ac[0] * ap[0] + ac[1] * ap[1] + ac[2] * ap[2];
+  if (d1 <= 0.0f && d2 <= 0.0f)
+  {
+    memcpy(c, a, 3 * sizeof(*c));
+    return;
+  }
+
+  for (k = 0; k < 3; ++k)
+    bp[k] = p[k] - b[k];
+  d3 = ab[0] * bp[0] + ab[1] * bp[1] + ab[2] * bp[2];
+  d4 = ac[0] * bp[0] + ac[1] * bp[1] + ac[2] * bp[2];
+  if (d3 >= 0.0f && d4 <= d3)
+  {
+    memcpy(c, b, 3 * sizeof(*c));
+    return;
+  }
+
+  vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+  {
+    s = d1 / (d1 - d3);
+    for (k = 0; k < 3; ++k)
+      c[k] = a[k] + s * ab[k];
+    return;
+  }
+
+  for (k = 0; k < 3; ++k)
+    cp[k] = p[k] - cc[k];
+  d5 = ab[0] * cp[0] + ab[1] * cp[1] + ab[2] * cp[2];
+  d6 = ac[0] * cp[0] + ac[1] * cp[1] + ac[2] * cp[2];
+  if (d6 >= 0.0f && d5 <= d6)
+  {
+    memcpy(c, cc, 3 * sizeof(*c));
+    return;
+  }
+
+  vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+  {
+    w = d2 / (d2 - d6);
+    for (k = 0; k < 3; ++k)
+      c[k] = a[k] + w * ac[k];
+    return;
+  }
+
+  va = d3 * d6 - d5 * d4;
+  if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+  {
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    for (k = 0; k < 3; ++k)
+      c[k] = b[k] + w * (cc[k] - b[k]);
+    return;
+  }
+
+  s = 1.0f / (va + vb + vc);
+  w = vc * s;
+  s = vb * s;
+  for (k = 0; k < 3; ++k)
+    c[k] = a[k] + ab[k] * s + ac[k] * w;
+}
+
+/*
+  Closest point on part surface to point.
+  Returns triangle index (order) in part, -1 if BVH is empty. Sets closest
+  and squared distance dist2 on success.
+*/
+int FCELIB_BVH_ClosestPoint(const FcelibBvh *bvh, const float point[3], float closest[3], float *dist2)
+{
+  int hit = -1;
+  int stack[FCELIB_BVH_STACKSIZE];
+  int sp = 0;
+  int i;
+  int k;
+  float best = 3.0e38f;
+  float c[3];
+
+  if (bvh->triags_len < 1)
+    return -1;
+
+  stack[sp++] = 0;
+  while (sp > 0)
+  {
+    const int node = stack[--sp];
+    const int *nd = bvh->nodes + 2 * node;
+    if (__FCELIB_BVH_BoxDist2(bvh->bounds + 6 * node, point) >= best)
+      continue;
+    if (nd[1] > 0)
+    {
+      for (i = nd[0]; i < nd[0] + nd[1]; ++i)
+      {
+        float d2 = 0.0f;
+        __FCELIB_BVH_ClosestPtTriag(bvh->triags + 9 * i, point, c);
+        for (k = 0; k < 3; ++k)
+          d2 += (c[k] - point[k]) * (c[k] - point[k]);
+        if (d2 < best)
+        {
+          best = d2;
+          hit = i;
+          memcpy(closest, c, sizeof(c));
+        }
+      }
+    }
+    else if (sp + 2 <= FCELIB_BVH_STACKSIZE)
+    {
+      /* Visit nearer child first */
+      const int near_first = __FCELIB_BVH_BoxDist2(bvh->bounds + 6 * nd[0], point) <=
+                             __FCELIB_BVH_BoxDist2(bvh->bounds + 6 * (nd[0] + 1), point);
+      stack[sp++] = nd[0] + near_first;
+      stack[sp++] = nd[0] + !near_first;
+    }
+  }
+
+  if (hit < 0)
+    return -1;
+  *dist2 = best;
+  return bvh->order[hit];
+}
+
+#endif  /* FCELIB_BVH_H_ */
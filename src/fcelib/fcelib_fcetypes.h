@@ -236,6 +236,24 @@ const char *kFce3PartsNames[FCELIB_UTIL_Fce3PartsImplemented] = {
   "high headlights"
 };
 
+/* FCE4 names of FCE3 parts, in FCE3 order */
+static
+const char *kFce4PartsNamesInFce3Order[FCELIB_UTIL_Fce3PartsImplemented] = {
+  ":HB",
+  ":HLFW",
+  ":HRFW",
+  ":HLRW",
+  ":HRRW",
+  ":MB",
+  ":MRFW",
+  ":MLFW",
+  ":MRRW",
+  ":MLRW",
+  ":LB",
+  ":TB",
+  ":OL"
+};
+
 /*
 car.fce (FCE3)
 Part role is determined by order, listed names are canonical but optional (and
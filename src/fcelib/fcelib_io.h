@@ -20,7 +20,7 @@
 */
 
 /**
-  import/export FCE3, FCE4, FCE4M, export OBJ/MTL, import geometric data
+  import/export FCE3, FCE4, FCE4M, mesh snapshot, export OBJ/MTL, import geometric data
 **/
 
 #ifndef FCELIB_IO_H_
@@ -68,7 +68,7 @@ int __FCELIB_IO_DECODE_GETPARTS(FcelibMesh *mesh, const char *header_PartNames,
 
   for (;;)
   {
-    mesh->hdr.Parts = (int *)malloc(mesh->parts_len * sizeof(*mesh->hdr.Parts));
+    mesh->hdr.Parts = (int *)FCELIB_UTIL_Malloc(mesh->parts_len * sizeof(*mesh->hdr.Parts));
     if (!mesh->hdr.Parts)
     {
       fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -78,7 +78,7 @@ int __FCELIB_IO_DECODE_GETPARTS(FcelibMesh *mesh, const char *header_PartNames,
       mesh->hdr.Parts[i] = i;
 
     /* Parts ------------------------------------------------------------ */
-    mesh->parts = (FcelibPart **)malloc(mesh->parts_len * sizeof(*mesh->parts));
+    mesh->parts = (FcelibPart **)FCELIB_UTIL_Malloc(mesh->parts_len * sizeof(*mesh->parts));
     if (!mesh->parts)
     {
       fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -88,7 +88,7 @@ int __FCELIB_IO_DECODE_GETPARTS(FcelibMesh *mesh, const char *header_PartNames,
 
     for (i = 0; i < mesh->hdr.NumParts; ++i)
     {
-      mesh->parts[i] = (FcelibPart *)malloc(sizeof(**mesh->parts));
+      mesh->parts[i] = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(**mesh->parts));
       if (!mesh->parts[i])
       {
         fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -108,12 +108,14 @@ int __FCELIB_IO_DECODE_GETPARTS(FcelibMesh *mesh, const char *header_PartNames,
       mesh->parts[i]->PNumTriangles = header_PNumTriangles[i];
       mesh->parts[i]->ptriangles_len = mesh->parts[i]->PNumTriangles;
       mesh->parts[i]->PTriangles = NULL;
+      mesh->parts[i]->adj = NULL;
+      mesh->parts[i]->bvh = NULL;
 
       /* update global counts */
       mesh->vertices_len += mesh->parts[i]->pvertices_len;
       mesh->triangles_len += mesh->parts[i]->ptriangles_len;
 
-      mesh->parts[i]->PVertices = (int *)malloc(mesh->parts[i]->pvertices_len * sizeof(*mesh->parts[i]->PVertices));
+      mesh->parts[i]->PVertices = (int *)FCELIB_UTIL_Malloc(mesh->parts[i]->pvertices_len * sizeof(*mesh->parts[i]->PVertices));
       if (!mesh->parts[i]->PVertices)
       {
         fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -121,7 +123,7 @@ int __FCELIB_IO_DECODE_GETPARTS(FcelibMesh *mesh, const char *header_PartNames,
       }
       memset(mesh->parts[i]->PVertices, 0xFF, mesh->parts[i]->pvertices_len * sizeof(*mesh->parts[i]->PVertices));
 
-      mesh->parts[i]->PTriangles = (int *)malloc(mesh->parts[i]->ptriangles_len * sizeof(*mesh->parts[i]->PTriangles));
+      mesh->parts[i]->PTriangles = (int *)FCELIB_UTIL_Malloc(mesh->parts[i]->ptriangles_len * sizeof(*mesh->parts[i]->PTriangles));
       if (!mesh->parts[i]->PTriangles)
       {
         fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -239,7 +241,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           break;
         }
 
-        mesh->triangles = (FcelibTriangle **)malloc(mesh->triangles_len * sizeof(*mesh->triangles));
+        mesh->triangles = (FcelibTriangle **)FCELIB_UTIL_Malloc(mesh->triangles_len * sizeof(*mesh->triangles));
         if (!mesh->triangles)
         {
           fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -256,7 +258,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           {
             mesh->parts[i]->PTriangles[j] = mesh->hdr.NumTriangles;
 
-            mesh->triangles[mesh->hdr.NumTriangles] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
+            mesh->triangles[mesh->hdr.NumTriangles] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
             if (!mesh->triangles[mesh->hdr.NumTriangles])
             {
               fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -288,7 +290,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
 
         /* Vertices --------------------------------------------------------- */
         /* We already know that (mesh->vertices_len > 0) */
-        mesh->vertices = (FcelibVertex **)malloc(mesh->vertices_len * sizeof(*mesh->vertices));
+        mesh->vertices = (FcelibVertex **)FCELIB_UTIL_Malloc(mesh->vertices_len * sizeof(*mesh->vertices));
         if (!mesh->vertices)
         {
           fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -305,7 +307,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           {
             mesh->parts[i]->PVertices[j] = mesh->hdr.NumVertices;
 
-            mesh->vertices[mesh->hdr.NumVertices] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
+            mesh->vertices[mesh->hdr.NumVertices] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
             if (!mesh->vertices[mesh->hdr.NumVertices])
             {
               fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -388,7 +390,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           break;
         }
 
-        mesh->triangles = (FcelibTriangle **)malloc(mesh->triangles_len * sizeof(*mesh->triangles));
+        mesh->triangles = (FcelibTriangle **)FCELIB_UTIL_Malloc(mesh->triangles_len * sizeof(*mesh->triangles));
         if (!mesh->triangles)
         {
           fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -405,7 +407,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           {
             mesh->parts[i]->PTriangles[j] = mesh->hdr.NumTriangles;
 
-            mesh->triangles[mesh->hdr.NumTriangles] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
+            mesh->triangles[mesh->hdr.NumTriangles] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
             if (!mesh->triangles[mesh->hdr.NumTriangles])
             {
               fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -431,7 +433,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
 
         /* Vertices --------------------------------------------------------- */
         /* We already know that (mesh->vertices_len > 0) */
-        mesh->vertices = (FcelibVertex **)malloc(mesh->vertices_len * sizeof(*mesh->vertices));
+        mesh->vertices = (FcelibVertex **)FCELIB_UTIL_Malloc(mesh->vertices_len * sizeof(*mesh->vertices));
         if (!mesh->vertices)
         {
           fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -448,7 +450,7 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
           {
             mesh->parts[i]->PVertices[j] = mesh->hdr.NumVertices;
 
-            mesh->vertices[mesh->hdr.NumVertices] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
+            mesh->vertices[mesh->hdr.NumVertices] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
             if (!mesh->vertices[mesh->hdr.NumVertices])
             {
               fprintf(stderr, "DecodeFce: Cannot allocate memory\n");
@@ -504,515 +506,1069 @@ int FCELIB_IO_DecodeFce(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
   return retv;
 }
 
-/* encode ------------------------------------------------------------------- */
+/*
+  fcecodec mesh snapshot: decoded FcelibMesh state, not an FCE file.
+  Little endian, 4-byte fields, no padding. Capacities and internal indexes
+  are kept, as in FCELIB_TYPES_MeshClone(). Triangle and vertex data are
+  stored as structure-of-arrays over all slots (unused slots are zero'd),
+  hence each field is a single contiguous copy.
+
+  0x0000  char[4]   magic "FCSN"
+  0x0004  int       version
+  0x0008  int[3]    parts_len, triangles_len, vertices_len
+  0x0014  int[8]    Unknown3, NumTriangles, NumVertices, NumArts,
+                    NumParts, NumDummies, NumColors, NumSecColors
+  0x0034  tColor4   PriColors[16], IntColors[16], SecColors[16], DriColors[16]
+  0x0134  tVector   Dummies[16]
+  0x01F4  char      DummyNames[16 * 64]
+  0x05F4  int[2]    sum of pvertices_len, sum of ptriangles_len (live parts)
+  0x05FC  int       hdr.Parts[parts_len]
+          per live part, in hdr.Parts order:
+            int[4]  PNumVertices, pvertices_len, PNumTriangles, ptriangles_len
+            char    PartName[64]
+            tVector PartPos
+            int     PVertices[pvertices_len]
+            int     PTriangles[ptriangles_len]
+          triangles: tex_page[T], vidx[3T], flag[T], U[3T], V[3T]
+          vertices: VertPos[3V], NormPos[3V], DamgdVertPos[3V],
+                    DamgdNormPos[3V], Animation[V]
+*/
+static const char kSnapshotMagic[4] = { 'F', 'C', 'S', 'N' };
+#define FCELIB_IO_SNAPSHOT_VERSION 1
+#define FCELIB_IO_SNAPSHOT_HDRSIZE 0x05FC
+#define FCELIB_IO_SNAPSHOT_PARTSIZE (4 * 4 + 64 + 12)
 
 /*
-  FCE triangle flags are written to material names. Returns boolean.
-  Assumes *objpath, *mtlpath, and *texture_name are strings.
+  Params: snapshot buffer, FcelibMesh. Returns bool.
+  Assumes (mesh != NULL). Silently releases and re-initializes existing mesh.
+  Checks sizes, index bounds, that triangles reference vertices of their own
+  part, and header counts. On failure, mesh is empty.
 */
-int FCELIB_IO_ExportObj(const FcelibMesh *mesh,
-                        const char *objpath, const char *mtlpath,
-                        const char *texture_name,
-                        int print_damage, int print_dummies,
-                        int use_part_positions,
-                        int print_part_positions,
-                        int filter_triagflags_0xfff)
+int FCELIB_IO_DecodeSnapshot(FcelibMesh *mesh, const void *inbuf_, int inbufsz)
 {
-  int retv = 1;
+  int retv = 0;
   int i;
   int j;
-  int n;
   int k;
-  FILE *outf = NULL;
-  int sum_verts = 0;
-  int sum_triags = 0;
-  int *global_mesh_to_global_obj_idxs;
+  int version;
+  int lens[3];
+  int sums[2];
+  int count_parts = 0;
+  int count_verts = 0;
+  int count_triags = 0;
+  int *vert_owners = NULL;  /* per vertex slot: part index, -1 if unused */
+  long sz;
+  const unsigned char *inbuf = (const unsigned char *)inbuf_;
+  const unsigned char *p;
+  const unsigned char *tbuf;
+  const unsigned char *vbuf;
   FcelibPart *part;
   FcelibTriangle *triag;
-
-  global_mesh_to_global_obj_idxs = (int *)malloc(mesh->vertices_len * sizeof(*global_mesh_to_global_obj_idxs));
-  if (!global_mesh_to_global_obj_idxs)
-  {
-    fprintf(stderr, "ExportObj: Cannot allocate memory\n");
-    return 0;
-  }
+  FcelibVertex *vert;
 
   for (;;)
   {
-    /* Print mtl (used triangle 12-bit flags as materials) ------------------ */
+    if (mesh->release == &FCELIB_TYPES_MeshRelease)
+    {
+      mesh->release(mesh);
+      FCELIB_TYPES_MeshInit(mesh);
+    }
+#ifndef FCELIB_PYTHON_BINDINGS
+    else if (!mesh->release || mesh->release != &FCELIB_TYPES_MeshRelease)
+    {
+      FCELIB_TYPES_MeshInit(mesh);
+    }
+#endif
+
+    if (!inbuf || inbufsz <= 0)
+    {
+      fprintf(stderr, "DecodeSnapshot: inbuf is NULL\n");
+      break;
+    }
+
+    if (inbufsz < FCELIB_IO_SNAPSHOT_HDRSIZE || memcmp(inbuf, kSnapshotMagic, 4) != 0)
     {
-      char mtls[4096] = {0};
-      int count_mtls = 0;
+      fprintf(stderr, "DecodeSnapshot: Format error: not a snapshot\n");
+      break;
+    }
+    memcpy(&version, inbuf + 0x04, 4);
+    if (version != FCELIB_IO_SNAPSHOT_VERSION)
+    {
+      fprintf(stderr, "DecodeSnapshot: Unsupported version %d\n", version);
+      break;
+    }
+    memcpy(lens, inbuf + 0x08, 3 * 4);
+    memcpy(sums, inbuf + 0x05F4, 2 * 4);
+    if (lens[0] < 0 || lens[1] < 0 || lens[2] < 0 || sums[0] < 0 || sums[1] < 0 ||
+        lens[0] > (1 << 24) || lens[1] > (1 << 24) || lens[2] > (1 << 24) ||
+        sums[0] > (1 << 24) || sums[1] > (1 << 24))
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: invalid lengths\n");
+      break;
+    }
 
-      for (i = 0; i < mesh->triangles_len; ++i)
+    /* Header ------------------------------------------------------------- */
+    memcpy(&mesh->hdr.Unknown3, inbuf + 0x14, 4);
+    memcpy(&mesh->hdr.NumTriangles, inbuf + 0x18, 4);
+    memcpy(&mesh->hdr.NumVertices, inbuf + 0x1C, 4);
+    memcpy(&mesh->hdr.NumArts, inbuf + 0x20, 4);
+    memcpy(&mesh->hdr.NumParts, inbuf + 0x24, 4);
+    memcpy(&mesh->hdr.NumDummies, inbuf + 0x28, 4);
+    memcpy(&mesh->hdr.NumColors, inbuf + 0x2C, 4);
+    memcpy(&mesh->hdr.NumSecColors, inbuf + 0x30, 4);
+    memcpy(mesh->hdr.PriColors, inbuf + 0x0034, 16 * 4);
+    memcpy(mesh->hdr.IntColors, inbuf + 0x0074, 16 * 4);
+    memcpy(mesh->hdr.SecColors, inbuf + 0x00B4, 16 * 4);
+    memcpy(mesh->hdr.DriColors, inbuf + 0x00F4, 16 * 4);
+    memcpy(mesh->hdr.Dummies, inbuf + 0x0134, 16 * 12);
+    memcpy(mesh->hdr.DummyNames, inbuf + 0x01F4, 16 * 64);
+    FCELIB_UTIL_EnsureStrings(mesh->hdr.DummyNames, 16, 64);
+    mesh->hdr.NumDummies = SCL_clamp(mesh->hdr.NumDummies, 0, 16);
+    mesh->hdr.NumColors = SCL_clamp(mesh->hdr.NumColors, 0, 16);
+    mesh->hdr.NumSecColors = SCL_clamp(mesh->hdr.NumSecColors, 0, 16);
+
+    if ((long)inbufsz < FCELIB_IO_SNAPSHOT_HDRSIZE + 4L * lens[0])
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: unexpected end of data\n");
+      break;
+    }
+    p = inbuf + FCELIB_IO_SNAPSHOT_HDRSIZE;
+    for (i = 0; i < lens[0]; ++i)
+    {
+      memcpy(&k, p + i * 4, 4);
+      if (k >= lens[0])
+        break;
+      if (k >= 0)
+        ++count_parts;
+    }
+    if (i < lens[0])
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: part index out of range\n");
+      break;
+    }
+
+    sz = FCELIB_IO_SNAPSHOT_HDRSIZE + 4L * lens[0] + (long)FCELIB_IO_SNAPSHOT_PARTSIZE * count_parts
+         + 4L * (sums[0] + sums[1]) + 44L * lens[1] + 52L * lens[2];
+    if ((long)inbufsz < sz)
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: unexpected end of data\n");
+      break;
+    }
+
+    /* Slot arrays -------------------------------------------------------- */
+    if (lens[0] > 0)
+    {
+      mesh->hdr.Parts = (int *)FCELIB_UTIL_Malloc(lens[0] * sizeof(*mesh->hdr.Parts));
+      if (!mesh->hdr.Parts)
       {
-        if (mesh->triangles[i])
-        {
-          if (mtls[mesh->triangles[i]->flag & 0xFFF] != '1')
-          {
-            mtls[mesh->triangles[i]->flag & 0xFFF] = '1';
-            ++count_mtls;
-          }
-        }
+        fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (hdr.Parts)\n");
+        break;
       }
-
-      outf = fopen(mtlpath, "wb");
-      if (!outf)
+      /* for signed int, -1 is represented as 0xFFFFFFFF */
+      memset(mesh->hdr.Parts, 0xFF, lens[0] * sizeof(*mesh->hdr.Parts));
+      mesh->parts = (FcelibPart **)FCELIB_UTIL_Malloc(lens[0] * sizeof(*mesh->parts));
+      if (!mesh->parts)
       {
-        fprintf(stderr, "ExportObj: cannot create file '%s'\n", mtlpath);
-        retv = 0;
+        fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (parts)\n");
         break;
       }
-
-      fprintf(outf,
-              "# fcecodec MTL File: '%s'\n"
-              "# Material Count: %d\n",
-              FCELIB_UTIL_GetFileName(objpath), count_mtls);
-
-      for (i = 0; i < 4096; ++i)
+      memset(mesh->parts, 0, lens[0] * sizeof(*mesh->parts));
+      mesh->parts_len = lens[0];
+    }
+    if (lens[1] > 0)
+    {
+      mesh->triangles = (FcelibTriangle **)FCELIB_UTIL_Malloc(lens[1] * sizeof(*mesh->triangles));
+      if (!mesh->triangles)
       {
-        if (mtls[i] == '1')
-        {
-          fprintf(outf,
-                  "\n"
-                  "newmtl 0x%03x\n"
-                  "Ka 1.000 1.000 1.000\n"
-                  "Kd 1.000 1.000 1.000\n"
-                  "Ks 0.000 0.000 0.000\n"
-                  "d 0.7\n"
-                  /* "Tr 0.3\n" */
-                  "illum 2\n"
-                  "map_Kd %s\n",
-                  i, texture_name);
-        }
+        fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (triangles)\n");
+        break;
       }
-      fflush(outf);
-
-      if (fclose(outf) != 0)
+      memset(mesh->triangles, 0, lens[1] * sizeof(*mesh->triangles));
+      mesh->triangles_len = lens[1];
+    }
+    if (lens[2] > 0)
+    {
+      mesh->vertices = (FcelibVertex **)FCELIB_UTIL_Malloc(lens[2] * sizeof(*mesh->vertices));
+      if (!mesh->vertices)
       {
-        fprintf(stderr, "ExportObj: cannot close file '%s'\n", mtlpath);
-        retv = 0;
+        fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (vertices)\n");
         break;
       }
-      outf = NULL;
+      memset(mesh->vertices, 0, lens[2] * sizeof(*mesh->vertices));
+      mesh->vertices_len = lens[2];
     }
-
-    /* Print obj ------------------------------------------------------------ */
-    outf = fopen(objpath, "wb");
-    if (!outf)
+    vert_owners = (int *)FCELIB_UTIL_Malloc((lens[2] + 1) * sizeof(*vert_owners));
+    if (!vert_owners)
     {
-      fprintf(stderr, "ExportObj: cannot create file '%s'\n", objpath);
-      retv = 0;
+      fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (vert_owners)\n");
       break;
     }
+    memset(vert_owners, 0xFF, (lens[2] + 1) * sizeof(*vert_owners));
 
-    fprintf(outf,
-            "# fcecodec OBJ File: '%s'\n"
-            "# github.com/bfut/fcecodec\n"
-            "mtllib %s\n", FCELIB_UTIL_GetFileName(objpath), FCELIB_UTIL_GetFileName(mtlpath));
-    fflush(outf);
+    tbuf = inbuf + sz - 44L * lens[1] - 52L * lens[2];
+    vbuf = inbuf + sz - 52L * lens[2];
 
+    /* Parts -------------------------------------------------------------- */
+    /*
+      An index is set only after its element is allocated, hence on failure,
+      mesh can be released safely. Duplicate indexes are rejected.
+    */
+    p = inbuf + FCELIB_IO_SNAPSHOT_HDRSIZE + 4 * lens[0];
     for (i = 0; i < mesh->parts_len; ++i)
     {
-      if (mesh->hdr.Parts[i] < 0)
+      int pid;
+      int part_lens[4];
+
+      memcpy(&pid, inbuf + FCELIB_IO_SNAPSHOT_HDRSIZE + i * 4, 4);
+      if (pid < 0)
         continue;
+      if (mesh->parts[pid])
+      {
+        fprintf(stderr, "DecodeSnapshot: Format error: duplicate part index\n");
+        break;
+      }
 
-      part = mesh->parts[ mesh->hdr.Parts[i] ];
-      if (!part)
+      memcpy(part_lens, p, 4 * 4);
+      if (part_lens[0] < 0 || part_lens[1] < 0 || part_lens[2] < 0 || part_lens[3] < 0 ||
+          part_lens[1] > sums[0] || part_lens[3] > sums[1])
       {
-        fprintf(stderr, "ExportObj: unexpected NULL pointer (mesh->parts[mesh->hdr.Parts[i]]\n");
-        retv = 0;
+        fprintf(stderr, "DecodeSnapshot: Format error: invalid part lengths\n");
         break;
       }
+      sums[0] -= part_lens[1];
+      sums[1] -= part_lens[3];
 
-      /* BEGIN printing undamaged part */
-      fprintf(outf, "\no %s\n", part->PartName);
+      part = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part));
+      if (!part)
+      {
+        fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (part)\n");
+        break;
+      }
+      memset(part, 0, sizeof(*part));
+      mesh->parts[pid] = part;
+      mesh->hdr.Parts[i] = pid;
 
-      fprintf(outf, "#part position %f %f %f\n",
-                    part->PartPos.x,
-                    part->PartPos.y,
-                    part->PartPos.z);
-      fprintf(outf, "\n");
-      fflush(outf);
+      memcpy(part->PartName, p + 0x10, 64);
+      part->PartName[63] = '\0';
+      memcpy(&part->PartPos, p + 0x50, 12);
+      p += FCELIB_IO_SNAPSHOT_PARTSIZE;
 
-      /* Verts */
-      fprintf(outf, "#%d verts\n", part->PNumVertices);
-      if (use_part_positions)
+      if (part_lens[1] > 0)
       {
-        for (j = 0; j < part->pvertices_len; ++j)
+        part->PVertices = (int *)FCELIB_UTIL_Malloc(part_lens[1] * sizeof(*part->PVertices));
+        if (!part->PVertices)
         {
-          if (part->PVertices[j] < 0)
-            continue;
-
-          fprintf(outf,
-                  "v %f %f %f\n",
-                  mesh->vertices[ part->PVertices[j] ]->VertPos.x + part->PartPos.x,
-                  mesh->vertices[ part->PVertices[j] ]->VertPos.y + part->PartPos.y,
-                  - ( mesh->vertices[ part->PVertices[j] ]->VertPos.z + part->PartPos.z )  /* flip sign in Z-coordinate */
-          );
+          fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (PVertices)\n");
+          break;
         }
+        memset(part->PVertices, 0xFF, part_lens[1] * sizeof(*part->PVertices));
+        part->pvertices_len = part_lens[1];
       }
-      else
+      if (part_lens[3] > 0)
       {
-        for (j = 0; j < part->pvertices_len; ++j)
+        part->PTriangles = (int *)FCELIB_UTIL_Malloc(part_lens[3] * sizeof(*part->PTriangles));
+        if (!part->PTriangles)
         {
-          if (part->PVertices[j] < 0)
-            continue;
-
-          fprintf(outf,
-                  "v %f %f %f\n",
-                  mesh->vertices[ part->PVertices[j] ]->VertPos.x,
-                  mesh->vertices[ part->PVertices[j] ]->VertPos.y,
-                  - ( mesh->vertices[ part->PVertices[j] ]->VertPos.z )  /* flip sign in Z-coordinate */
-          );
+          fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (PTriangles)\n");
+          break;
         }
-      }  /* if (use_part_positions) */
-      fprintf(outf, "\n");
-      fflush(outf);
+        memset(part->PTriangles, 0xFF, part_lens[3] * sizeof(*part->PTriangles));
+        part->ptriangles_len = part_lens[3];
+      }
 
-      /* Texture coordinates */
-      fprintf(outf, "#%d vt\n", 3 * part->PNumTriangles);
-      for (j = 0; j < part->ptriangles_len; ++j)
+      for (j = 0; j < part->pvertices_len; ++j)
       {
-        if (part->PTriangles[j] < 0)
+        memcpy(&k, p + j * 4, 4);
+        if (k < 0)
           continue;
-
-        for (n = 0; n < 3; ++n)
+        if (k >= mesh->vertices_len || mesh->vertices[k])
         {
-          fprintf(outf,
-                  "vt %f %f\n",
-                  mesh->triangles[ part->PTriangles[j] ]->U[n],
-                  mesh->triangles[ part->PTriangles[j] ]->V[n]
-          );
-        }  /* for n */
+          fprintf(stderr, "DecodeSnapshot: Format error: invalid vertex index\n");
+          break;
+        }
+        vert = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(*vert));
+        if (!vert)
+        {
+          fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (vert)\n");
+          break;
+        }
+        memcpy(&vert->VertPos,      vbuf + (0L * lens[2] + k * 3) * 4, 12);
+        memcpy(&vert->NormPos,      vbuf + (3L * lens[2] + k * 3) * 4, 12);
+        memcpy(&vert->DamgdVertPos, vbuf + (6L * lens[2] + k * 3) * 4, 12);
+        memcpy(&vert->DamgdNormPos, vbuf + (9L * lens[2] + k * 3) * 4, 12);
+        memcpy(&vert->Animation,    vbuf + (12L * lens[2] + k) * 4, 4);
+        mesh->vertices[k] = vert;
+        vert_owners[k] = pid;
+        part->PVertices[j] = k;
+        ++part->PNumVertices;
       }
-      fprintf(outf, "\n");
-      fflush(outf);
+      if (j < part->pvertices_len)
+        break;
+      p += 4 * part->pvertices_len;
 
-      /* Normals */
-      fprintf(outf, "#%d normals\n", part->PNumVertices);
-      for (j = 0; j < part->pvertices_len; ++j)
+      for (j = 0; j < part->ptriangles_len; ++j)
       {
-        if (part->PVertices[j] < 0)
+        memcpy(&k, p + j * 4, 4);
+        if (k < 0)
           continue;
-
-        fprintf(outf,
-                "vn %f %f %f\n",
-                mesh->vertices[ part->PVertices[j] ]->NormPos.x,
-                mesh->vertices[ part->PVertices[j] ]->NormPos.y,
-                - ( mesh->vertices[ part->PVertices[j] ]->NormPos.z )  /* flip sign in Z-coordinate */
-        );
+        if (k >= mesh->triangles_len || mesh->triangles[k])
+        {
+          fprintf(stderr, "DecodeSnapshot: Format error: invalid triangle index\n");
+          break;
+        }
+        triag = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(*triag));
+        if (!triag)
+        {
+          fprintf(stderr, "DecodeSnapshot: Cannot allocate memory (triag)\n");
+          break;
+        }
+        memcpy(&triag->tex_page, tbuf + (0L * lens[1] + k) * 4, 4);
+        memcpy(triag->vidx,      tbuf + (1L * lens[1] + k * 3) * 4, 12);
+        memcpy(&triag->flag,     tbuf + (4L * lens[1] + k) * 4, 4);
+        memcpy(triag->U,         tbuf + (5L * lens[1] + k * 3) * 4, 12);
+        memcpy(triag->V,         tbuf + (8L * lens[1] + k * 3) * 4, 12);
+        mesh->triangles[k] = triag;
+        part->PTriangles[j] = k;
+        ++part->PNumTriangles;
+        if (triag->vidx[0] < 0 || triag->vidx[0] >= mesh->vertices_len || vert_owners[ triag->vidx[0] ] != pid ||
+            triag->vidx[1] < 0 || triag->vidx[1] >= mesh->vertices_len || vert_owners[ triag->vidx[1] ] != pid ||
+            triag->vidx[2] < 0 || triag->vidx[2] >= mesh->vertices_len || vert_owners[ triag->vidx[2] ] != pid)
+        {
+          fprintf(stderr, "DecodeSnapshot: Format error: triangle references vertex outside part\n");
+          break;
+        }
       }
-      fprintf(outf, "\n");
-      fflush(outf);
+      if (j < part->ptriangles_len)
+        break;
+      p += 4 * part->ptriangles_len;
 
-      /* Triangles */
-      /* Create map: global vert index to global obj idx (of used-in-this-part verts) */
-      memset(global_mesh_to_global_obj_idxs, 0xFF, mesh->vertices_len * sizeof(*global_mesh_to_global_obj_idxs));
-      for (n = 0, k = 0; n < part->pvertices_len && k < part->PNumVertices; ++n)
+      if (part->PNumVertices != part_lens[0] || part->PNumTriangles != part_lens[2])
       {
-        if (part->PVertices[n] < 0)
-          continue;
-        global_mesh_to_global_obj_idxs[ part->PVertices[n] ] = k + 1 + sum_verts;
-        ++k;
+        fprintf(stderr, "DecodeSnapshot: Format error: part counts mismatch\n");
+        break;
       }
+      count_verts += part->PNumVertices;
+      count_triags += part->PNumTriangles;
+    }  /* for i */
+    if (i < mesh->parts_len)
+      break;
 
-      fprintf(outf, "#%d faces (verts: %d..%d)\n", part->PNumTriangles, sum_verts + 1, sum_verts + part->PNumVertices);
-      for (n = 0, k = 0; n < part->ptriangles_len && k < part->PNumTriangles; ++n)
-      {
-        if (part->PTriangles[n] < 0)
-          continue;
-        triag = mesh->triangles[ part->PTriangles[n] ];
+    if (count_parts != mesh->hdr.NumParts)
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: NumParts mismatch\n");
+      break;
+    }
+    if (count_verts != mesh->hdr.NumVertices || count_triags != mesh->hdr.NumTriangles)
+    {
+      fprintf(stderr, "DecodeSnapshot: Format error: NumVertices or NumTriangles mismatch\n");
+      break;
+    }
 
-        if (filter_triagflags_0xfff == 1)
-        {
-          fprintf(outf,
-                  "usemtl 0x%03x\n"
-                  "s 1\n",
-                  triag->flag & 0xfff);
-        }
-        else
-        {
-          fprintf(outf,
-                  "usemtl 0x%08x\n"
-                  "s 1\n",
-                  triag->flag);
-        }
+    retv = 1;
+    break;
+  }  /* for (;;) */
 
-        fprintf(outf,
-                "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                global_mesh_to_global_obj_idxs[ triag->vidx[0] ],
-                3 * (sum_triags + k) + 1 + 0,
-                global_mesh_to_global_obj_idxs[ triag->vidx[0] ],
+  FCELIB_UTIL_Free(vert_owners);
+  if (retv != 1)
+  {
+    FCELIB_TYPES_MeshRelease(mesh);
+    FCELIB_TYPES_MeshInit(mesh);
+  }
 
-                global_mesh_to_global_obj_idxs[ triag->vidx[1] ],
-                3 * (sum_triags + k) + 1 + 1,
-                global_mesh_to_global_obj_idxs[ triag->vidx[1] ],
+  return retv;
+}
 
-                global_mesh_to_global_obj_idxs[ triag->vidx[2] ],
-                3 * (sum_triags + k) + 1 + 2,
-                global_mesh_to_global_obj_idxs[ triag->vidx[2] ]
-        );
-        ++k;
-      }  /* for n,k triangles */
-      fprintf(outf, "\n");
-      fflush(outf);
+/* encode ------------------------------------------------------------------- */
 
-      sum_verts  += part->PNumVertices;
-      sum_triags += part->PNumTriangles;
-      /* END printing undamaged part */
+/*
+  Text output for OBJ/MTL export. Collects output in a user-space buffer,
+  which is written to outf (if any) once it holds FCELIB_IO_WRITER_FLUSHSIZE
+  bytes. On failure, err is set and further writes are no-ops.
+*/
+#define FCELIB_IO_WRITER_FLUSHSIZE (1 << 20)
 
+struct __FcelibIoWriter {
+  char *buf;
+  long  len;
+  long  cap;
+  FILE *outf;  /* NULL: in-memory only */
+  int   err;
+};
 
-      /* BEGIN printing damaged part */
-      if (print_damage)
-      {
-        fprintf(outf, "\no DAMAGE_%s\n", part->PartName);
-
-        fprintf(outf, "#part position %f %f %f\n",
-                      part->PartPos.x,
-                      part->PartPos.y,
-                      part->PartPos.z);
-        fprintf(outf, "\n");
-        fflush(outf);
-
-        /* Verts */
-        fprintf(outf, "#%d verts\n", part->PNumVertices);
-        if (use_part_positions)
-        {
-          for (j = 0; j < part->pvertices_len; ++j)
-          {
-            if (part->PVertices[j] < 0)
-              continue;
-
-            fprintf(outf,
-                    "v %f %f %f\n",
-                    mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.x + part->PartPos.x,
-                    mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.y + part->PartPos.y,
-                    - ( mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.z + part->PartPos.z )  /* flip sign in Z-coordinate */
-            );
-          }
-        }
-        else
-        {
-          for (j = 0; j < part->pvertices_len; ++j)
-          {
-            if (part->PVertices[j] < 0)
-              continue;
-
-            fprintf(outf,
-                    "v %f %f %f\n",
-                    mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.x,
-                    mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.y,
-                    - ( mesh->vertices[ part->PVertices[j] ]->DamgdVertPos.z )  /* flip sign in Z-coordinate */
-            );
-          }
-        }  /* if (use_part_positions) */
-        fprintf(outf, "\n");
-        fflush(outf);
+int __FCELIB_IO_WriterFlush(struct __FcelibIoWriter *w)
+{
+  if (w->outf && w->len > 0 && !w->err)
+  {
+    if (fwrite(w->buf, 1, w->len, w->outf) != (size_t)w->len)
+      w->err = 1;
+    w->len = 0;
+  }
+  return !w->err;
+}
 
-        /* Texture coordinates */
-        fprintf(outf, "#%d vt\n", 3 * part->PNumTriangles);
-        for (j = 0; j < part->ptriangles_len; ++j)
-        {
-          if (part->PTriangles[j] < 0)
-            continue;
+/* Returns pointer to n writable bytes at end of buffer, NULL on failure. */
+char *__FCELIB_IO_WriterReserve(struct __FcelibIoWriter *w, const long n)
+{
+  void *ptr;
+  long cap;
 
-          for (n = 0; n < 3; ++n)
-          {
-            fprintf(outf,
-                    "vt %f %f\n",
-                    mesh->triangles[ part->PTriangles[j] ]->U[n],
-                    mesh->triangles[ part->PTriangles[j] ]->V[n]
-            );
-          }  /* for n */
-        }
-        fprintf(outf, "\n");
-        fflush(outf);
+  if (w->err)
+    return NULL;
+  if (w->outf && w->len + n > FCELIB_IO_WRITER_FLUSHSIZE)
+  {
+    if (!__FCELIB_IO_WriterFlush(w))
+      return NULL;
+  }
+  if (w->len + n > w->cap)
+  {
+    cap = SCL_max(w->cap, 4096);
+    while (cap < w->len + n)
+      cap *= 2;
+    ptr = FCELIB_UTIL_Realloc(w->buf, cap);
+    if (!ptr)
+    {
+      w->err = 1;
+      return NULL;
+    }
+    w->buf = (char *)ptr;
+    w->cap = cap;
+  }
+  return w->buf + w->len;
+}
 
-        /* Normals */
-        fprintf(outf, "#%d normals\n", part->PNumVertices);
-        for (j = 0; j < part->pvertices_len; ++j)
-        {
-          if (part->PVertices[j] < 0)
-            continue;
+void __FCELIB_IO_WriteBytes(struct __FcelibIoWriter *w, const void *data, const long n)
+{
+  char *p;
+  if (w->outf && n >= FCELIB_IO_WRITER_FLUSHSIZE)
+  {
+    /* large blocks bypass the buffer */
+    if (__FCELIB_IO_WriterFlush(w) && fwrite(data, 1, n, w->outf) != (size_t)n)
+      w->err = 1;
+    return;
+  }
+  p = __FCELIB_IO_WriterReserve(w, n);
+  if (!p)
+    return;
+  memcpy(p, data, n);
+  w->len += n;
+}
 
-          fprintf(outf,
-                  "vn %f %f %f\n",
-                  mesh->vertices[ part->PVertices[j] ]->DamgdNormPos.x,
-                  mesh->vertices[ part->PVertices[j] ]->DamgdNormPos.y,
-                  - ( mesh->vertices[ part->PVertices[j] ]->DamgdNormPos.z )  /* flip sign in Z-coordinate */
-          );
-        }
-        fprintf(outf, "\n");
-        fflush(outf);
+void __FCELIB_IO_WriteStr(struct __FcelibIoWriter *w, const char *s)
+{
+  __FCELIB_IO_WriteBytes(w, s, (long)strlen(s));
+}
 
-        /* Triangles */
-        /* Create map: global vert index to local part idx (of used-in-this-part verts) */
-        memset(global_mesh_to_global_obj_idxs, 0xFF, mesh->vertices_len * sizeof(*global_mesh_to_global_obj_idxs));
-        for (n = 0, k = 0; n < part->pvertices_len && k < part->PNumVertices; ++n)
-        {
-          if (part->PVertices[n] < 0)
-            continue;
-          global_mesh_to_global_obj_idxs[ part->PVertices[n] ] = k + 1 + sum_verts;
-          ++k;
-        }
-        fprintf(outf, "#%d faces (verts: %d..%d)\n", part->PNumTriangles, sum_verts + 1, sum_verts + part->PNumVertices);
-        for (n = 0, k = 0; n < part->ptriangles_len && k < part->PNumTriangles; ++n)
-      {
-        if (part->PTriangles[n] < 0)
-          continue;
-        triag = mesh->triangles[ part->PTriangles[n] ];
+/* Same as "%d". */
+void __FCELIB_IO_WriteInt(struct __FcelibIoWriter *w, const int x)
+{
+  char tmp[16];
+  int i = 16;
+  unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+  char *p;
 
-        if (filter_triagflags_0xfff == 1)
-        {
-          fprintf(outf,
-                  "usemtl 0x%03x\n"
-                  "s 1\n",
-                  triag->flag & 0xfff);
-        }
-        else
-        {
-          fprintf(outf,
-                  "usemtl 0x%08x\n"
-                  "s 1\n",
-                  triag->flag);
-        }
+  do
+  {
+    tmp[--i] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (x < 0)
+    tmp[--i] = '-';
+  p = __FCELIB_IO_WriterReserve(w, 16 - i);
+  if (!p)
+    return;
+  memcpy(p, tmp + i, 16 - i);
+  w->len += 16 - i;
+}
 
-        fprintf(outf,
-                "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                global_mesh_to_global_obj_idxs[ triag->vidx[0] ],
-                3 * (sum_triags + k) + 1 + 0,
-                global_mesh_to_global_obj_idxs[ triag->vidx[0] ],
+/* Same as "0x%0*x" with given width. */
+void __FCELIB_IO_WriteHex(struct __FcelibIoWriter *w, const unsigned int x, const int width)
+{
+  char tmp[16];
+  int i = 16;
+  unsigned int u = x;
+  char *p;
 
-                global_mesh_to_global_obj_idxs[ triag->vidx[1] ],
-                3 * (sum_triags + k) + 1 + 1,
-                global_mesh_to_global_obj_idxs[ triag->vidx[1] ],
+  do
+  {
+    tmp[--i] = "0123456789abcdef"[u & 0xF];
+    u >>= 4;
+  } while (u > 0);
+  while (16 - i < width && i > 2)
+    tmp[--i] = '0';
+  tmp[--i] = 'x';
+  tmp[--i] = '0';
+  p = __FCELIB_IO_WriterReserve(w, 16 - i);
+  if (!p)
+    return;
+  memcpy(p, tmp + i, 16 - i);
+  w->len += 16 - i;
+}
 
-                global_mesh_to_global_obj_idxs[ triag->vidx[2] ],
-                3 * (sum_triags + k) + 1 + 2,
-                global_mesh_to_global_obj_idxs[ triag->vidx[2] ]
-        );
-        ++k;
-      }  /* for n,k triangles */
-        fprintf(outf, "\n");
-        fflush(outf);
+/*
+  Same as "%f", i.e., 6 decimals, correctly rounded (ties to even).
 
-        sum_verts  += part->PNumVertices;
-        sum_triags += part->PNumTriangles;
-      }  /* if (print_damage) */
-      /* END printing undamaged part */
-    }  /* for i parts */
+  For float v, v * 1e6 has at most 24 + 14 significant bits and is exact in
+  double. Below 2^52, adding and subtracting 2^52 rounds it to an integer in
+  round-to-nearest-even mode, which is what printf does on glibc and msvc.
+  Falls back to sprintf() for nan, inf, and large values.
+*/
+void __FCELIB_IO_WriteFloat(struct __FcelibIoWriter *w, const float v)
+{
+  char tmp[64];
+  int i = 64;
+  int k;
+  int bits;
+  unsigned long hi;
+  unsigned long lo;
+  double s;
+  volatile double r;
+  char *p;
+
+  memcpy(&bits, &v, sizeof(bits));
+  s = (double)SCL_abs(v) * 1e6;
+  if (v != v || s >= 1e15)
+  {
+    sprintf(tmp, "%f", v);
+    __FCELIB_IO_WriteStr(w, tmp);
+    return;
+  }
+
+  r = s + 4503599627370496.0;
+  r = r - 4503599627370496.0;
+  s = r;
+  hi = (unsigned long)(s * 1e-6);
+  s -= (double)hi * 1e6;
+  if (s < 0)
+  {
+    --hi;
+    s += 1e6;
+  }
+  else if (s >= 1e6)
+  {
+    ++hi;
+    s -= 1e6;
+  }
+  lo = (unsigned long)s;
+
+  for (k = 0; k < 6; ++k)
+  {
+    tmp[--i] = (char)('0' + lo % 10);
+    lo /= 10;
+  }
+  tmp[--i] = '.';
+  do
+  {
+    tmp[--i] = (char)('0' + hi % 10);
+    hi /= 10;
+  } while (hi > 0);
+  if (bits < 0)
+    tmp[--i] = '-';
+
+  p = __FCELIB_IO_WriterReserve(w, 64 - i);
+  if (!p)
+    return;
+  memcpy(p, tmp + i, 64 - i);
+  w->len += 64 - i;
+}
+
+/* prefix, then "%f %f %f\n" */
+void __FCELIB_IO_Write3f(struct __FcelibIoWriter *w, const char *prefix, const float x, const float y, const float z)
+{
+  __FCELIB_IO_WriteStr(w, prefix);
+  __FCELIB_IO_WriteFloat(w, x);
+  __FCELIB_IO_WriteStr(w, " ");
+  __FCELIB_IO_WriteFloat(w, y);
+  __FCELIB_IO_WriteStr(w, " ");
+  __FCELIB_IO_WriteFloat(w, z);
+  __FCELIB_IO_WriteStr(w, "\n");
+}
+
+/*
+  Prints undamaged or damaged part: header, verts, texcoords, normals, faces.
+  OBJ indexes start after sum_verts, sum_triags. Reads mesh only, hence
+  parts can be printed to separate writers concurrently.
+*/
+void __FCELIB_IO_ObjWritePart(struct __FcelibIoWriter *w, const FcelibMesh *mesh, const FcelibPart *part,
+                              const int damaged, const int use_part_positions, const int filter_triagflags_0xfff,
+                              const int sum_verts, const int sum_triags)
+{
+  int j;
+  int n;
+  int k;
+  struct __FcelibVertMap map;  /* global vert idx to vert order in part */
+  const FcelibVertex *vert;
+  const FcelibTriangle *triag;
+  const tVector *v;
+
+  __FCELIB_IO_WriteStr(w, damaged ? "\no DAMAGE_" : "\no ");
+  __FCELIB_IO_WriteStr(w, part->PartName);
+  __FCELIB_IO_Write3f(w, "\n#part position ", part->PartPos.x, part->PartPos.y, part->PartPos.z);
+  __FCELIB_IO_WriteStr(w, "\n");
+
+  /* Verts */
+  __FCELIB_IO_WriteStr(w, "#");
+  __FCELIB_IO_WriteInt(w, part->PNumVertices);
+  __FCELIB_IO_WriteStr(w, " verts\n");
+  for (j = 0; j < part->pvertices_len; ++j)
+  {
+    if (part->PVertices[j] < 0)
+      continue;
+    vert = mesh->vertices[ part->PVertices[j] ];
+    v = damaged ? &vert->DamgdVertPos : &vert->VertPos;
+
+    if (use_part_positions)
+      __FCELIB_IO_Write3f(w, "v ", v->x + part->PartPos.x, v->y + part->PartPos.y,
+                          - ( v->z + part->PartPos.z ));  /* flip sign in Z-coordinate */
+    else
+      __FCELIB_IO_Write3f(w, "v ", v->x, v->y, - ( v->z ));  /* flip sign in Z-coordinate */
+  }
+  __FCELIB_IO_WriteStr(w, "\n");
+
+  /* Texture coordinates */
+  __FCELIB_IO_WriteStr(w, "#");
+  __FCELIB_IO_WriteInt(w, 3 * part->PNumTriangles);
+  __FCELIB_IO_WriteStr(w, " vt\n");
+  for (j = 0; j < part->ptriangles_len; ++j)
+  {
+    if (part->PTriangles[j] < 0)
+      continue;
+    triag = mesh->triangles[ part->PTriangles[j] ];
 
-    if (print_dummies)
+    for (n = 0; n < 3; ++n)
     {
-      for (i = 0; i < mesh->hdr.NumDummies; ++i)
-      {
-        /* unique shape names */
-        fprintf(outf, "\no DUMMY_%02d_%s\n", i, mesh->hdr.DummyNames + (i * 64));
+      __FCELIB_IO_WriteStr(w, "vt ");
+      __FCELIB_IO_WriteFloat(w, triag->U[n]);
+      __FCELIB_IO_WriteStr(w, " ");
+      __FCELIB_IO_WriteFloat(w, triag->V[n]);
+      __FCELIB_IO_WriteStr(w, "\n");
+    }  /* for n */
+  }
+  __FCELIB_IO_WriteStr(w, "\n");
 
-        /* Vertices */
-        fprintf(outf,
-                "#position %f %f %f\n",
-                mesh->hdr.Dummies[i].x,
-                mesh->hdr.Dummies[i].y,
-                mesh->hdr.Dummies[i].z);
+  /* Normals */
+  __FCELIB_IO_WriteStr(w, "#");
+  __FCELIB_IO_WriteInt(w, part->PNumVertices);
+  __FCELIB_IO_WriteStr(w, " normals\n");
+  for (j = 0; j < part->pvertices_len; ++j)
+  {
+    if (part->PVertices[j] < 0)
+      continue;
+    vert = mesh->vertices[ part->PVertices[j] ];
+    v = damaged ? &vert->DamgdNormPos : &vert->NormPos;
 
-        for (j = 0; j < 6; ++j)
-        {
-          fprintf(outf,
-                  "v %f %f %f\n",
-                  0.1f * kVertDiamond[3 * j + 0] + mesh->hdr.Dummies[i].x,
-                  0.1f * kVertDiamond[3 * j + 1] + mesh->hdr.Dummies[i].y,
-                  0.1f * kVertDiamond[3 * j + 2] + mesh->hdr.Dummies[i].z * (-1)
-          );
-        }
+    __FCELIB_IO_Write3f(w, "vn ", v->x, v->y, - ( v->z ));  /* flip sign in Z-coordinate */
+  }
+  __FCELIB_IO_WriteStr(w, "\n");
 
-        /* Triangles */
-        fprintf(outf, "\n#f %d..%d (%d)\n", sum_triags + 1, sum_triags + 8, 8);
+  /* Triangles */
+  /* Map global vert index to obj idx (of used-in-this-part verts) */
+  if (!FCELIB_TYPES_VertMapInit(&map, part))
+  {
+    w->err = 1;
+    return;
+  }
 
-        for (j = 0; j < 8; ++j)
-        {
-          fprintf(outf,
-                  "f %d %d %d\n",
-                  kTrianglesDiamond[3 * j + 0] + sum_verts,
-                  kTrianglesDiamond[3 * j + 1] + sum_verts,
-                  kTrianglesDiamond[3 * j + 2] + sum_verts);
-        }
-        fflush(outf);
+  __FCELIB_IO_WriteStr(w, "#");
+  __FCELIB_IO_WriteInt(w, part->PNumTriangles);
+  __FCELIB_IO_WriteStr(w, " faces (verts: ");
+  __FCELIB_IO_WriteInt(w, sum_verts + 1);
+  __FCELIB_IO_WriteStr(w, "..");
+  __FCELIB_IO_WriteInt(w, sum_verts + part->PNumVertices);
+  __FCELIB_IO_WriteStr(w, ")\n");
+  for (n = 0, k = 0; n < part->ptriangles_len && k < part->PNumTriangles; ++n)
+  {
+    if (part->PTriangles[n] < 0)
+      continue;
+    triag = mesh->triangles[ part->PTriangles[n] ];
 
-        sum_verts  += 6;
-        sum_triags += 8;
-      }
-    }  /* if (print_dummies) */
+    __FCELIB_IO_WriteStr(w, "usemtl ");
+    if (filter_triagflags_0xfff == 1)
+      __FCELIB_IO_WriteHex(w, (unsigned int)(triag->flag & 0xfff), 3);
+    else
+      __FCELIB_IO_WriteHex(w, (unsigned int)triag->flag, 8);
+    __FCELIB_IO_WriteStr(w, "\ns 1\nf");
 
-    if (print_part_positions)
+    for (j = 0; j < 3; ++j)
     {
-      for (i = 0; i < mesh->parts_len; ++i)
-      {
-        if (mesh->hdr.Parts[i] < 0)
-        continue;
+      int v = FCELIB_TYPES_VertMapGet(&map, triag->vidx[j]);
+      v = v >= 0 ? v + 1 + sum_verts : -1;
+      __FCELIB_IO_WriteStr(w, " ");
+      __FCELIB_IO_WriteInt(w, v);
+      __FCELIB_IO_WriteStr(w, "/");
+      __FCELIB_IO_WriteInt(w, 3 * (sum_triags + k) + 1 + j);
+      __FCELIB_IO_WriteStr(w, "/");
+      __FCELIB_IO_WriteInt(w, v);
+    }
+    __FCELIB_IO_WriteStr(w, "\n");
+    ++k;
+  }  /* for n,k triangles */
+  __FCELIB_IO_WriteStr(w, "\n");
 
-        part = mesh->parts[ mesh->hdr.Parts[i] ];
-        if (!part)
-        {
-          fprintf(stderr, "ExportObj: unexpected NULL pointer (mesh->parts[mesh->hdr.Parts[i]]\n");
-          retv = 0;
-          break;
-        }
+  FCELIB_TYPES_VertMapRelease(&map);
+}
 
-        /* unique shape names */
-        fprintf(outf, "\no POSITION_%s\n", part->PartName);
+/* One part chunk of OBJ export, printed to its own writer. */
+struct __FcelibIoObjChunk {
+  const FcelibMesh *mesh;
+  const FcelibPart *part;
+  int damaged;
+  int use_part_positions;
+  int filter_triagflags_0xfff;
+  int sum_verts;
+  int sum_triags;
+  struct __FcelibIoWriter w;
+};
+
+void __FCELIB_IO_ObjWriteChunk(void *arg, const int i)
+{
+  struct __FcelibIoObjChunk *chunk = (struct __FcelibIoObjChunk *)arg + i;
+  __FCELIB_IO_ObjWritePart(&chunk->w, chunk->mesh, chunk->part, chunk->damaged, chunk->use_part_positions,
+                           chunk->filter_triagflags_0xfff, chunk->sum_verts, chunk->sum_triags);
+}
 
-        fprintf(outf, "#part position %f %f %f\n",
-                    part->PartPos.x,
-                    part->PartPos.y,
-                    part->PartPos.z);
-        fprintf(outf, "\n");
-        fflush(outf);
+/* Prints diamond shape at pos: 6 verts, 8 faces. */
+void __FCELIB_IO_ObjWriteDiamond(struct __FcelibIoWriter *w, const tVector *pos, const int sum_verts, const int sum_triags)
+{
+  int j;
+  int n;
 
-        /* Vertices */
-        for (j = 0; j < 6; ++j)
-        {
-          fprintf(outf,
-                  "v %f %f %f\n",
-                  0.1f * kVertDiamond[3 * j + 0] + part->PartPos.x,
-                  0.1f * kVertDiamond[3 * j + 1] + part->PartPos.y,
-                  0.1f * kVertDiamond[3 * j + 2] + part->PartPos.z * (-1)
-          );
-        }
+  /* Vertices */
+  for (j = 0; j < 6; ++j)
+  {
+    __FCELIB_IO_Write3f(w, "v ",
+                        0.1f * kVertDiamond[3 * j + 0] + pos->x,
+                        0.1f * kVertDiamond[3 * j + 1] + pos->y,
+                        0.1f * kVertDiamond[3 * j + 2] + pos->z * (-1));
+  }
 
-        /* Triangles */
-        fprintf(outf, "\n#f %d..%d (%d)\n", sum_triags + 1, sum_triags + 8, 8);
+  /* Triangles */
+  __FCELIB_IO_WriteStr(w, "\n#f ");
+  __FCELIB_IO_WriteInt(w, sum_triags + 1);
+  __FCELIB_IO_WriteStr(w, "..");
+  __FCELIB_IO_WriteInt(w, sum_triags + 8);
+  __FCELIB_IO_WriteStr(w, " (8)\n");
 
-        for (j = 0; j < 8; ++j)
-        {
-          fprintf(outf,
-                  "f %d %d %d\n",
-                  kTrianglesDiamond[3 * j + 0] + sum_verts,
-                  kTrianglesDiamond[3 * j + 1] + sum_verts,
-                  kTrianglesDiamond[3 * j + 2] + sum_verts);
-        }
-        fflush(outf);
+  for (j = 0; j < 8; ++j)
+  {
+    __FCELIB_IO_WriteStr(w, "f");
+    for (n = 0; n < 3; ++n)
+    {
+      __FCELIB_IO_WriteStr(w, " ");
+      __FCELIB_IO_WriteInt(w, kTrianglesDiamond[3 * j + n] + sum_verts);
+    }
+    __FCELIB_IO_WriteStr(w, "\n");
+  }
+}
+
+/* Closes outf. Returns boolean. */
+int __FCELIB_IO_WriterClose(struct __FcelibIoWriter *w, const char *path)
+{
+  int retv = __FCELIB_IO_WriterFlush(w);
+  if (!retv)
+    fprintf(stderr, "ExportObj: cannot write file '%s'\n", path);
+  if (fclose(w->outf) != 0)
+  {
+    fprintf(stderr, "ExportObj: cannot close file '%s'\n", path);
+    retv = 0;
+  }
+  w->outf = NULL;
+  return retv;
+}
+
+/* Prints MTL (used triangle 12-bit flags as materials). Returns boolean. */
+int __FCELIB_IO_MtlWrite(struct __FcelibIoWriter *w, const FcelibMesh *mesh,
+                         const char *objname, const char *texture_name)
+{
+  int i;
+  char mtls[4096] = {0};
+  int count_mtls = 0;
 
-        sum_verts  += 6;
-        sum_triags += 8;
+  for (i = 0; i < mesh->triangles_len; ++i)
+  {
+    if (mesh->triangles[i])
+    {
+      if (mtls[mesh->triangles[i]->flag & 0xFFF] != '1')
+      {
+        mtls[mesh->triangles[i]->flag & 0xFFF] = '1';
+        ++count_mtls;
       }
-    }  /* if (print_part_positions) */
+    }
+  }
+
+  __FCELIB_IO_WriteStr(w, "# fcecodec MTL File: '");
+  __FCELIB_IO_WriteStr(w, FCELIB_UTIL_GetFileName(objname));
+  __FCELIB_IO_WriteStr(w, "'\n# Material Count: ");
+  __FCELIB_IO_WriteInt(w, count_mtls);
+  __FCELIB_IO_WriteStr(w, "\n");
 
-    if (fclose(outf) != 0)
+  for (i = 0; i < 4096; ++i)
+  {
+    if (mtls[i] == '1')
+    {
+      __FCELIB_IO_WriteStr(w, "\nnewmtl ");
+      __FCELIB_IO_WriteHex(w, (unsigned int)i, 3);
+      __FCELIB_IO_WriteStr(w,
+                           "\n"
+                           "Ka 1.000 1.000 1.000\n"
+                           "Kd 1.000 1.000 1.000\n"
+                           "Ks 0.000 0.000 0.000\n"
+                           "d 0.7\n"
+                           /* "Tr 0.3\n" */
+                           "illum 2\n"
+                           "map_Kd ");
+      __FCELIB_IO_WriteStr(w, texture_name);
+      __FCELIB_IO_WriteStr(w, "\n");
+    }
+  }
+
+  return !w->err;
+}
+
+/*
+  Prints OBJ. Returns boolean.
+
+  Parts are printed as independent chunks. If a parallel for is set (see
+  FCELIB_UTIL_SetParallelFor), chunks are formatted in memory concurrently,
+  then written in order; otherwise, they are streamed to w.
+*/
+int __FCELIB_IO_ObjWrite(struct __FcelibIoWriter *w, const FcelibMesh *mesh,
+                         const char *objname, const char *mtlname,
+                         int print_damage, int print_dummies,
+                         int use_part_positions,
+                         int print_part_positions,
+                         int filter_triagflags_0xfff)
+{
+  int retv = 1;
+  int i;
+  int j;
+  int sum_verts = 0;
+  int sum_triags = 0;
+  int num_chunks = 0;
+  struct __FcelibIoObjChunk *chunks;
+  FcelibPart *part;
+
+  chunks = (struct __FcelibIoObjChunk *)FCELIB_UTIL_Malloc(SCL_max(1, 2 * mesh->parts_len) * sizeof(*chunks));
+  if (!chunks)
+  {
+    fprintf(stderr, "ExportObj: Cannot allocate memory\n");
+    return 0;
+  }
+  memset(chunks, 0, SCL_max(1, 2 * mesh->parts_len) * sizeof(*chunks));
+
+  __FCELIB_IO_WriteStr(w, "# fcecodec OBJ File: '");
+  __FCELIB_IO_WriteStr(w, FCELIB_UTIL_GetFileName(objname));
+  __FCELIB_IO_WriteStr(w, "'\n# github.com/bfut/fcecodec\nmtllib ");
+  __FCELIB_IO_WriteStr(w, FCELIB_UTIL_GetFileName(mtlname));
+  __FCELIB_IO_WriteStr(w, "\n");
+
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+
+    part = mesh->parts[ mesh->hdr.Parts[i] ];
+    if (!part)
     {
-      fprintf(stderr, "ExportObj: cannot close file '%s'\n", objpath);
+      fprintf(stderr, "ExportObj: unexpected NULL pointer (mesh->parts[mesh->hdr.Parts[i]]\n");
       retv = 0;
       break;
     }
 
+    for (j = 0; j <= (print_damage != 0); ++j)
+    {
+      chunks[num_chunks].mesh = mesh;
+      chunks[num_chunks].part = part;
+      chunks[num_chunks].damaged = j;
+      chunks[num_chunks].use_part_positions = use_part_positions;
+      chunks[num_chunks].filter_triagflags_0xfff = filter_triagflags_0xfff;
+      chunks[num_chunks].sum_verts = sum_verts;
+      chunks[num_chunks].sum_triags = sum_triags;
+      ++num_chunks;
+      sum_verts  += part->PNumVertices;
+      sum_triags += part->PNumTriangles;
+    }
+  }  /* for i parts */
+
+  if (!FCELIB_UTIL_parallel_for_fn)
+  {
+    for (i = 0; i < num_chunks; ++i)
+    {
+      __FCELIB_IO_ObjWritePart(w, mesh, chunks[i].part, chunks[i].damaged, use_part_positions,
+                               filter_triagflags_0xfff, chunks[i].sum_verts, chunks[i].sum_triags);
+    }
+  }
+  else
+  {
+    FCELIB_UTIL_ParallelFor(num_chunks, __FCELIB_IO_ObjWriteChunk, chunks);
+    for (i = 0; i < num_chunks; ++i)
+    {
+      w->err |= chunks[i].w.err;
+      __FCELIB_IO_WriteBytes(w, chunks[i].w.buf, chunks[i].w.len);
+      FCELIB_UTIL_Free(chunks[i].w.buf);
+    }
+  }
+  FCELIB_UTIL_Free(chunks);
+
+  if (print_dummies)
+  {
+    for (i = 0; i < mesh->hdr.NumDummies; ++i)
+    {
+      /* unique shape names */
+      __FCELIB_IO_WriteStr(w, i < 10 ? "\no DUMMY_0" : "\no DUMMY_");
+      __FCELIB_IO_WriteInt(w, i);
+      __FCELIB_IO_WriteStr(w, "_");
+      __FCELIB_IO_WriteStr(w, mesh->hdr.DummyNames + (i * 64));
+      __FCELIB_IO_Write3f(w, "\n#position ", mesh->hdr.Dummies[i].x, mesh->hdr.Dummies[i].y, mesh->hdr.Dummies[i].z);
+
+      __FCELIB_IO_ObjWriteDiamond(w, &mesh->hdr.Dummies[i], sum_verts, sum_triags);
+      sum_verts  += 6;
+      sum_triags += 8;
+    }
+  }  /* if (print_dummies) */
+
+  if (print_part_positions)
+  {
+    for (i = 0; i < mesh->parts_len; ++i)
+    {
+      if (mesh->hdr.Parts[i] < 0)
+        continue;
+
+      part = mesh->parts[ mesh->hdr.Parts[i] ];
+      if (!part)
+      {
+        fprintf(stderr, "ExportObj: unexpected NULL pointer (mesh->parts[mesh->hdr.Parts[i]]\n");
+        retv = 0;
+        break;
+      }
+
+      /* unique shape names */
+      __FCELIB_IO_WriteStr(w, "\no POSITION_");
+      __FCELIB_IO_WriteStr(w, part->PartName);
+      __FCELIB_IO_Write3f(w, "\n#part position ", part->PartPos.x, part->PartPos.y, part->PartPos.z);
+      __FCELIB_IO_WriteStr(w, "\n");
+
+      __FCELIB_IO_ObjWriteDiamond(w, &part->PartPos, sum_verts, sum_triags);
+      sum_verts  += 6;
+      sum_triags += 8;
+    }
+  }  /* if (print_part_positions) */
+
+  return retv && !w->err;
+}
+
+/*
+  FCE triangle flags are written to material names. Returns boolean.
+  Assumes *objpath, *mtlpath, and *texture_name are strings.
+*/
+int FCELIB_IO_ExportObj(const FcelibMesh *mesh,
+                        const char *objpath, const char *mtlpath,
+                        const char *texture_name,
+                        int print_damage, int print_dummies,
+                        int use_part_positions,
+                        int print_part_positions,
+                        int filter_triagflags_0xfff)
+{
+  int retv = 0;
+  struct __FcelibIoWriter w;
+
+  memset(&w, 0, sizeof(w));
+
+  for (;;)
+  {
+    w.outf = fopen(mtlpath, "wb");
+    if (!w.outf)
+    {
+      fprintf(stderr, "ExportObj: cannot create file '%s'\n", mtlpath);
+      break;
+    }
+    __FCELIB_IO_MtlWrite(&w, mesh, objpath, texture_name);
+    if (!__FCELIB_IO_WriterClose(&w, mtlpath))
+      break;
+
+    w.outf = fopen(objpath, "wb");
+    if (!w.outf)
+    {
+      fprintf(stderr, "ExportObj: cannot create file '%s'\n", objpath);
+      break;
+    }
+    retv = __FCELIB_IO_ObjWrite(&w, mesh, objpath, mtlpath,
+                                print_damage, print_dummies, use_part_positions,
+                                print_part_positions, filter_triagflags_0xfff);
+    if (!__FCELIB_IO_WriterClose(&w, objpath))
+      retv = 0;
+
     break;
   }  /* for (;;) */
 
-  free(global_mesh_to_global_obj_idxs);
+  if (w.outf)
+    fclose(w.outf);
+  FCELIB_UTIL_Free(w.buf);
   return retv;
 }
 
+/*
+  Same as FCELIB_IO_ExportObj(), but writes OBJ and MTL text to memory.
+  objname, mtlname are used in comments and as mtllib reference only.
+
+  *objbuf is a caller-provided buffer of capacity *objbufsz bytes, may be
+  NULL with capacity 0. It is grown with FCELIB_UTIL_Realloc() as needed, and
+  *objbufsz is updated; the caller frees it with FCELIB_UTIL_Free(), also on
+  failure. On success, *objlen is the text length; text is null-terminated.
+  Same for mtl.
+
+  Returns boolean.
+*/
+int FCELIB_IO_ExportObjToMemory(const FcelibMesh *mesh,
+                                char **objbuf, int *objbufsz, int *objlen,
+                                char **mtlbuf, int *mtlbufsz, int *mtllen,
+                                const char *objname, const char *mtlname,
+                                const char *texture_name,
+                                int print_damage, int print_dummies,
+                                int use_part_positions,
+                                int print_part_positions,
+                                int filter_triagflags_0xfff)
+{
+  int retv;
+  char *p;
+  struct __FcelibIoWriter w;
+
+  memset(&w, 0, sizeof(w));
+  w.buf = *mtlbuf;
+  w.cap = *mtlbufsz;
+  retv = __FCELIB_IO_MtlWrite(&w, mesh, objname, texture_name);
+  p = __FCELIB_IO_WriterReserve(&w, 1);
+  if (p)
+    *p = '\0';
+  *mtlbuf = w.buf;
+  *mtlbufsz = (int)w.cap;
+  *mtllen = (int)w.len;
+  if (!retv || !p || w.cap > 0x7FFFFFFF)
+  {
+    fprintf(stderr, "ExportObjToMemory: Cannot write MTL\n");
+    return 0;
+  }
+
+  memset(&w, 0, sizeof(w));
+  w.buf = *objbuf;
+  w.cap = *objbufsz;
+  retv = __FCELIB_IO_ObjWrite(&w, mesh, objname, mtlname,
+                              print_damage, print_dummies, use_part_positions,
+                              print_part_positions, filter_triagflags_0xfff);
+  p = __FCELIB_IO_WriterReserve(&w, 1);
+  if (p)
+    *p = '\0';
+  *objbuf = w.buf;
+  *objbufsz = (int)w.cap;
+  *objlen = (int)w.len;
+  if (!retv || !p || w.cap > 0x7FFFFFFF)
+  {
+    fprintf(stderr, "ExportObjToMemory: Cannot write OBJ\n");
+    return 0;
+  }
+
+  return 1;
+}
+
 /*
   Limited to 64 parts. Returns boolean.
 
@@ -1044,7 +1600,7 @@ int FCELIB_IO_EncodeFce3(const FcelibMesh *mesh, unsigned char **outbuf, int out
       }
     }
 
-    global_mesh_to_local_fce_idxs = (int *)malloc(mesh->vertices_len * sizeof(*global_mesh_to_local_fce_idxs));
+    global_mesh_to_local_fce_idxs = (int *)FCELIB_UTIL_Malloc(mesh->vertices_len * sizeof(*global_mesh_to_local_fce_idxs));
     if (!global_mesh_to_local_fce_idxs)
     {
       fprintf(stderr, "EncodeFce3: Cannot allocate memory\n");
@@ -1098,7 +1654,7 @@ int FCELIB_IO_EncodeFce3(const FcelibMesh *mesh, unsigned char **outbuf, int out
       FcelibVertex *vert;
       int count_verts = 0;
 
-      x_array = (float *)malloc(3 * (mesh->vertices_len + 1) * sizeof(*x_array));
+      x_array = (float *)FCELIB_UTIL_Malloc(3 * (mesh->vertices_len + 1) * sizeof(*x_array));
       if (!x_array)
       {
         fprintf(stderr, "EncodeFce3: Cannot allocate memory\n");
@@ -1147,7 +1703,7 @@ int FCELIB_IO_EncodeFce3(const FcelibMesh *mesh, unsigned char **outbuf, int out
       memcpy(*outbuf + 0x002C, y_array, 4);
       memcpy(*outbuf + 0x0030, z_array, 4);
 
-      free(x_array);
+      FCELIB_UTIL_Free(x_array);
     }  /* Set HalfSizes */
 
     /* Dummies */
@@ -1298,7 +1854,7 @@ int FCELIB_IO_EncodeFce3(const FcelibMesh *mesh, unsigned char **outbuf, int out
     break;
   }  /* for (;;) */
 
-  free(global_mesh_to_local_fce_idxs);
+  FCELIB_UTIL_Free(global_mesh_to_local_fce_idxs);
 
   return retv;
 }
@@ -1334,7 +1890,7 @@ int FCELIB_IO_EncodeFce4(const FcelibMesh *mesh, unsigned char **outbuf, int out
       }
     }
 
-    global_mesh_to_local_fce_idxs = (int *)malloc(mesh->vertices_len * sizeof(*global_mesh_to_local_fce_idxs));
+    global_mesh_to_local_fce_idxs = (int *)FCELIB_UTIL_Malloc(mesh->vertices_len * sizeof(*global_mesh_to_local_fce_idxs));
     if (!global_mesh_to_local_fce_idxs)
     {
       fprintf(stderr, "EncodeFce4: Cannot allocate memory\n");
@@ -1417,7 +1973,7 @@ int FCELIB_IO_EncodeFce4(const FcelibMesh *mesh, unsigned char **outbuf, int out
       FcelibVertex *vert;
       int count_verts = 0;
 
-      x_array = (float *)malloc(3 * (mesh->vertices_len + 1) * sizeof(*x_array));
+      x_array = (float *)FCELIB_UTIL_Malloc(3 * (mesh->vertices_len + 1) * sizeof(*x_array));
       if (!x_array)
       {
         fprintf(stderr, "EncodeFce4: Cannot allocate memory\n");
@@ -1473,7 +2029,7 @@ int FCELIB_IO_EncodeFce4(const FcelibMesh *mesh, unsigned char **outbuf, int out
       memcpy(*outbuf + 0x0050, y_array, 4);
       memcpy(*outbuf + 0x0054, z_array, 4);
 
-      free(x_array);
+      FCELIB_UTIL_Free(x_array);
     }  /* Set HalfSizes */
 
     /* Dummies */
@@ -1706,11 +2262,147 @@ int FCELIB_IO_EncodeFce4(const FcelibMesh *mesh, unsigned char **outbuf, int out
     break;
   }  /* for (;;) */
 
-  free(global_mesh_to_local_fce_idxs);
+  FCELIB_UTIL_Free(global_mesh_to_local_fce_idxs);
 
   return retv;
 }
 
+/* Returns size in bytes. See FCELIB_IO_DecodeSnapshot() for the format. */
+int FCELIB_IO_SnapshotComputeSize(const FcelibMesh *mesh)
+{
+  int i;
+  int count_parts = 0;
+  int sum_pverts = 0;
+  int sum_ptriags = 0;
+  const FcelibPart *part;
+
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+    part = mesh->parts[ mesh->hdr.Parts[i] ];
+    ++count_parts;
+    sum_pverts += part->pvertices_len;
+    sum_ptriags += part->ptriangles_len;
+  }
+
+  return FCELIB_IO_SNAPSHOT_HDRSIZE + 4 * mesh->parts_len + FCELIB_IO_SNAPSHOT_PARTSIZE * count_parts
+         + 4 * (sum_pverts + sum_ptriags) + 44 * mesh->triangles_len + 52 * mesh->vertices_len;
+}
+
+/*
+  Writes fcecodec mesh snapshot to *outbuf, see FCELIB_IO_DecodeSnapshot().
+  Expects outbufsz >= FCELIB_IO_SnapshotComputeSize(mesh). Returns bool.
+*/
+int FCELIB_IO_EncodeSnapshot(const FcelibMesh *mesh, unsigned char **outbuf, int outbufsz)
+{
+  int i;
+  int j;
+  int k;
+  int sums[2] = { 0, 0 };
+  const int version = FCELIB_IO_SNAPSHOT_VERSION;
+  const int T = mesh->triangles_len;
+  const int V = mesh->vertices_len;
+  const int bufsz = FCELIB_IO_SnapshotComputeSize(mesh);
+  unsigned char *p;
+  unsigned char *tbuf;
+  unsigned char *vbuf;
+  const FcelibPart *part;
+  const FcelibTriangle *triag;
+  const FcelibVertex *vert;
+
+  if (!outbuf || !*outbuf || outbufsz < bufsz)
+  {
+    fprintf(stderr, "EncodeSnapshot: outbuf too small\n");
+    return 0;
+  }
+
+  memset(*outbuf, 0, bufsz);
+  p = *outbuf;
+
+  /* Header --------------------------------------------------------------- */
+  memcpy(p + 0x00, kSnapshotMagic, 4);
+  memcpy(p + 0x04, &version, 4);
+  memcpy(p + 0x08, &mesh->parts_len, 4);
+  memcpy(p + 0x0C, &mesh->triangles_len, 4);
+  memcpy(p + 0x10, &mesh->vertices_len, 4);
+  memcpy(p + 0x14, &mesh->hdr.Unknown3, 4);
+  memcpy(p + 0x18, &mesh->hdr.NumTriangles, 4);
+  memcpy(p + 0x1C, &mesh->hdr.NumVertices, 4);
+  memcpy(p + 0x20, &mesh->hdr.NumArts, 4);
+  memcpy(p + 0x24, &mesh->hdr.NumParts, 4);
+  memcpy(p + 0x28, &mesh->hdr.NumDummies, 4);
+  memcpy(p + 0x2C, &mesh->hdr.NumColors, 4);
+  memcpy(p + 0x30, &mesh->hdr.NumSecColors, 4);
+  memcpy(p + 0x0034, mesh->hdr.PriColors, 16 * 4);
+  memcpy(p + 0x0074, mesh->hdr.IntColors, 16 * 4);
+  memcpy(p + 0x00B4, mesh->hdr.SecColors, 16 * 4);
+  memcpy(p + 0x00F4, mesh->hdr.DriColors, 16 * 4);
+  memcpy(p + 0x0134, mesh->hdr.Dummies, 16 * 12);
+  memcpy(p + 0x01F4, mesh->hdr.DummyNames, 16 * 64);
+  if (mesh->parts_len > 0)
+    memcpy(p + FCELIB_IO_SNAPSHOT_HDRSIZE, mesh->hdr.Parts, 4 * mesh->parts_len);
+
+  tbuf = *outbuf + bufsz - 44 * T - 52 * V;
+  vbuf = *outbuf + bufsz - 52 * V;
+
+  /* Parts, triangles, vertices ------------------------------------------- */
+  p += FCELIB_IO_SNAPSHOT_HDRSIZE + 4 * mesh->parts_len;
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+    part = mesh->parts[ mesh->hdr.Parts[i] ];
+    sums[0] += part->pvertices_len;
+    sums[1] += part->ptriangles_len;
+
+    memcpy(p + 0x00, &part->PNumVertices, 4);
+    memcpy(p + 0x04, &part->pvertices_len, 4);
+    memcpy(p + 0x08, &part->PNumTriangles, 4);
+    memcpy(p + 0x0C, &part->ptriangles_len, 4);
+    memcpy(p + 0x10, part->PartName, 64);
+    memcpy(p + 0x50, &part->PartPos, 12);
+    p += FCELIB_IO_SNAPSHOT_PARTSIZE;
+
+    if (part->pvertices_len > 0)
+      memcpy(p, part->PVertices, 4 * part->pvertices_len);
+    p += 4 * part->pvertices_len;
+    if (part->ptriangles_len > 0)
+      memcpy(p, part->PTriangles, 4 * part->ptriangles_len);
+    p += 4 * part->ptriangles_len;
+
+    for (j = 0; j < part->pvertices_len; ++j)
+    {
+      k = part->PVertices[j];
+      if (k < 0)
+        continue;
+      vert = mesh->vertices[k];
+      memcpy(vbuf + (0 * V + k * 3) * 4, &vert->VertPos, 12);
+      memcpy(vbuf + (3 * V + k * 3) * 4, &vert->NormPos, 12);
+      memcpy(vbuf + (6 * V + k * 3) * 4, &vert->DamgdVertPos, 12);
+      memcpy(vbuf + (9 * V + k * 3) * 4, &vert->DamgdNormPos, 12);
+      memcpy(vbuf + (12 * V + k) * 4, &vert->Animation, 4);
+    }
+
+    for (j = 0; j < part->ptriangles_len; ++j)
+    {
+      k = part->PTriangles[j];
+      if (k < 0)
+        continue;
+      triag = mesh->triangles[k];
+      memcpy(tbuf + (0 * T + k) * 4, &triag->tex_page, 4);
+      memcpy(tbuf + (1 * T + k * 3) * 4, triag->vidx, 12);
+      memcpy(tbuf + (4 * T + k) * 4, &triag->flag, 4);
+      memcpy(tbuf + (5 * T + k * 3) * 4, triag->U, 12);
+      memcpy(tbuf + (8 * T + k * 3) * 4, triag->V, 12);
+    }
+  }  /* for i */
+
+  memcpy(*outbuf + 0x05F4, sums, 2 * 4);
+
+  return 1;
+}
+
 /*
   Assumes (mesh != NULL).
   Otherwise, expects non-NULL parameters.
@@ -1810,7 +2502,7 @@ int FCELIB_IO_GeomDataToNewPart(FcelibMesh *mesh,
       break;
     }
 
-    part = (FcelibPart *)malloc(sizeof(*part));
+    part = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part));
     if (!part)
     {
       fprintf(stderr, "GeomDataToNewPart: Cannot allocate memory (part)\n");
@@ -1850,7 +2542,7 @@ int FCELIB_IO_GeomDataToNewPart(FcelibMesh *mesh,
     {
       part->PTriangles[j] = tidx_1st + j;
 
-      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
+      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
       triag = mesh->triangles[tidx_1st + j];
       if (!triag)
       {
@@ -1892,7 +2584,7 @@ int FCELIB_IO_GeomDataToNewPart(FcelibMesh *mesh,
     {
       part->PVertices[j] = vidx_1st + j;
 
-      mesh->vertices[vidx_1st + j] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
+      mesh->vertices[vidx_1st + j] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
       vert = mesh->vertices[vidx_1st + j];
       if (!vert)
       {
@@ -0,0 +1,932 @@
+/*
+  fcelib_journal.h
+  fcecodec Copyright (C) 2021 and later Benjamin Futasz <https://github.com/bfut>
+
+  You may not redistribute this program without its source code.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/**
+  implements undo/redo journal for a mesh
+
+  Before each mesh-modifying call, FCELIB_JOURNAL_Begin() saves the header
+  and the parts in scope of the call, with their triangles and vertices.
+  FCELIB_JOURNAL_Record() compares the mesh against this saved state and
+  stores one step as a compact delta: header, changed part slots, and runs
+  of changed triangle and vertex slots, each with old and new contents.
+  Both are O(parts + parts in scope), not O(mesh); no copy of the mesh is
+  kept. Freed slots live on in the deltas until the step is trimmed. Mesh
+  capacities are never shrunk by undo/redo; slot indexes are restored
+  exactly.
+
+  The scope of a call is the parts it modifies or deletes; parts it adds
+  are found without. Changes to triangles and vertices outside the scope
+  are not recorded. Begin and Undo and Redo record the pending step first.
+  Recording a step drops all redo steps. Oldest steps are trimmed once the
+  deltas exceed the memory budget; the saved state is not counted.
+
+  usage:
+    FcelibJournal journal;
+    FCELIB_JOURNAL_Init(&journal, 64L << 20);
+    if (!FCELIB_JOURNAL_Begin(&journal, &mesh, &pid, 1))  return EXIT_FAILURE;
+    // modify part pid of mesh
+    FCELIB_JOURNAL_Record(&journal, &mesh);
+    FCELIB_JOURNAL_Undo(&journal, &mesh);
+    FCELIB_JOURNAL_Release(&journal);
+**/
+
+#ifndef FCELIB_JOURNAL_H_
+#define FCELIB_JOURNAL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./fcelib_types.h"
+#include "./fcelib_util.h"
+
+#define __FCELIB_JOURNAL_HEADER 1
+#define __FCELIB_JOURNAL_PART   2
+#define __FCELIB_JOURNAL_TRIAGS 3
+#define __FCELIB_JOURNAL_VERTS  4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __cplusplus
+typedef struct FcelibJournal FcelibJournal;
+#endif
+
+struct FcelibJournal {
+  /* mesh state before pending step, see FCELIB_JOURNAL_Begin() */
+  int             pending;      /* bool */
+  FcelibHeader    hdr;          /* hdr.Parts is NULL */
+  int             parts_len;
+  int            *parts;        /* hdr.Parts, parts_len items */
+  unsigned char  *scope;        /* per part slot: 0 if empty, 1 if out of scope, 2 if in scope */
+  FcelibPart    **scope_parts;  /* per part slot: copy if in scope, NULL othw */
+  int             num_triags;
+  int            *triags_idx;   /* global triag idxs of parts in scope, ascending */
+  FcelibTriangle *triags;       /* per triags_idx: contents */
+  int             num_verts;
+  int            *verts_idx;    /* global vert idxs of parts in scope, ascending */
+  FcelibVertex   *verts;        /* per verts_idx: contents */
+
+  unsigned char **steps;        /* per step: delta */
+  long           *steps_sz;     /* per step: delta size in bytes */
+  int             steps_len;    /* capacity: array length */
+  int             num_steps;
+  int             cursor;       /* steps [0, cursor) can be undone, steps [cursor, num_steps) redone */
+  long            bytes;        /* sum of steps_sz */
+  long            budget;       /* max bytes; oldest steps are trimmed beyond */
+};
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+/* delta encoding ----------------------------------------------------------- */
+
+struct __FcelibJournalBuf {
+  unsigned char *data;
+  long           len;
+  long           cap;
+};
+
+int __FCELIB_JOURNAL_Write(struct __FcelibJournalBuf *b, const void *src, const long n)
+{
+  void *ptr;
+  long cap = SCL_max(b->cap, 256);
+
+  while (cap < b->len + n)
+    cap *= 2;
+  if (cap > b->cap)
+  {
+    ptr = FCELIB_UTIL_Realloc(b->data, cap);
+    if (!ptr)
+    {
+      fprintf(stderr, "JournalRecord: Cannot reallocate memory\n");
+      return 0;
+    }
+    b->data = (unsigned char *)ptr;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, src, n);
+  b->len += n;
+  return 1;
+}
+
+int __FCELIB_JOURNAL_WriteInt(struct __FcelibJournalBuf *b, const int x)
+{
+  return __FCELIB_JOURNAL_Write(b, &x, sizeof(x));
+}
+
+int __FCELIB_JOURNAL_ReadInt(const unsigned char *data, long *pos)
+{
+  int x;
+  memcpy(&x, data + *pos, sizeof(x));
+  *pos += sizeof(x);
+  return x;
+}
+
+/* Returns slot i of triangles (kind __FCELIB_JOURNAL_TRIAGS) or vertices, NULL if unused or out of range. */
+const void *__FCELIB_JOURNAL_GetSlot(const FcelibMesh *mesh, const int kind, const int i)
+{
+  if (kind == __FCELIB_JOURNAL_TRIAGS)
+    return i < mesh->triangles_len ? mesh->triangles[i] : NULL;
+  return i < mesh->vertices_len ? mesh->vertices[i] : NULL;
+}
+
+/* Returns saved slot i of triangles or vertices, NULL if not saved. Binary search. */
+const void *__FCELIB_JOURNAL_GetSavedSlot(const FcelibJournal *journal, const int kind, const int i)
+{
+  const int *idx = kind == __FCELIB_JOURNAL_TRIAGS ? journal->triags_idx : journal->verts_idx;
+  int lo = 0;
+  int hi = kind == __FCELIB_JOURNAL_TRIAGS ? journal->num_triags : journal->num_verts;
+
+  while (lo < hi)
+  {
+    const int mid = lo + (hi - lo) / 2;
+    if (idx[mid] < i)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == (kind == __FCELIB_JOURNAL_TRIAGS ? journal->num_triags : journal->num_verts) || idx[lo] != i)
+    return NULL;
+  if (kind == __FCELIB_JOURNAL_TRIAGS)
+    return &journal->triags[lo];
+  return &journal->verts[lo];
+}
+
+int __FCELIB_JOURNAL_CompareInts(const void *a, const void *b)
+{
+  const int arg1 = *(const int *)a;
+  const int arg2 = *(const int *)b;
+  return (arg1 > arg2) - (arg1 < arg2);
+}
+
+/* Sorts idxs ascending, drops duplicates. Returns new length. */
+int __FCELIB_JOURNAL_SortUnique(int *idxs, const int n)
+{
+  int i;
+  int k = 0;
+
+  qsort(idxs, n, sizeof(*idxs), __FCELIB_JOURNAL_CompareInts);
+  for (i = 0; i < n; ++i)
+  {
+    if (k == 0 || idxs[i] != idxs[k - 1])
+      idxs[k++] = idxs[i];
+  }
+  return k;
+}
+
+int __FCELIB_JOURNAL_PartsEqual(const FcelibPart *a, const FcelibPart *b)
+{
+  if (!a || !b)
+    return a == b;
+  return a->PNumVertices == b->PNumVertices && a->pvertices_len == b->pvertices_len &&
+         a->PNumTriangles == b->PNumTriangles && a->ptriangles_len == b->ptriangles_len &&
+         memcmp(a->PartName, b->PartName, sizeof(a->PartName)) == 0 &&
+         memcmp(&a->PartPos, &b->PartPos, sizeof(a->PartPos)) == 0 &&
+         memcmp(a->PVertices, b->PVertices, a->pvertices_len * sizeof(*a->PVertices)) == 0 &&
+         memcmp(a->PTriangles, b->PTriangles, a->ptriangles_len * sizeof(*a->PTriangles)) == 0;
+}
+
+/* Part blob: present flag; if present, counts, name, position, index arrays. */
+int __FCELIB_JOURNAL_WritePart(struct __FcelibJournalBuf *b, const FcelibPart *part)
+{
+  if (!part)
+    return __FCELIB_JOURNAL_WriteInt(b, 0);
+  return __FCELIB_JOURNAL_WriteInt(b, 1) &&
+         __FCELIB_JOURNAL_WriteInt(b, part->PNumVertices) &&
+         __FCELIB_JOURNAL_WriteInt(b, part->pvertices_len) &&
+         __FCELIB_JOURNAL_WriteInt(b, part->PNumTriangles) &&
+         __FCELIB_JOURNAL_WriteInt(b, part->ptriangles_len) &&
+         __FCELIB_JOURNAL_Write(b, part->PartName, sizeof(part->PartName)) &&
+         __FCELIB_JOURNAL_Write(b, &part->PartPos, sizeof(part->PartPos)) &&
+         __FCELIB_JOURNAL_Write(b, part->PVertices, part->pvertices_len * sizeof(*part->PVertices)) &&
+         __FCELIB_JOURNAL_Write(b, part->PTriangles, part->ptriangles_len * sizeof(*part->PTriangles));
+}
+
+/* Slot blob: present flag; if present, triangle or vertex. */
+int __FCELIB_JOURNAL_WriteSlot(struct __FcelibJournalBuf *b, const void *slot, const long slotsz)
+{
+  if (!slot)
+    return __FCELIB_JOURNAL_WriteInt(b, 0);
+  return __FCELIB_JOURNAL_WriteInt(b, 1) && __FCELIB_JOURNAL_Write(b, slot, slotsz);
+}
+
+/*
+  Appends runs of consecutive changed slots: tag, first slot, count, old
+  slots, new slots. Compares saved slots and slots of parts in scope or
+  added since, only.
+*/
+int __FCELIB_JOURNAL_DiffSlots(struct __FcelibJournalBuf *b, const FcelibJournal *journal, const FcelibMesh *m,
+                               const int kind)
+{
+  int retv = 0;
+  int i;
+  int j;
+  int k;
+  int n;
+  int *idxs = NULL;  /* candidate slots */
+  const FcelibPart *part;
+  const long slotsz = kind == __FCELIB_JOURNAL_TRIAGS ? (long)sizeof(FcelibTriangle) : (long)sizeof(FcelibVertex);
+
+  for (;;)
+  {
+    n = kind == __FCELIB_JOURNAL_TRIAGS ? journal->num_triags : journal->num_verts;
+    for (i = 0; i < m->parts_len; ++i)
+    {
+      if (!m->parts[i] || (i < journal->parts_len && journal->scope[i] == 1))
+        continue;
+      n += kind == __FCELIB_JOURNAL_TRIAGS ? m->parts[i]->ptriangles_len : m->parts[i]->pvertices_len;
+    }
+
+    idxs = (int *)FCELIB_UTIL_Malloc((n + 1) * sizeof(*idxs));
+    if (!idxs)
+    {
+      fprintf(stderr, "JournalRecord: Cannot allocate memory\n");
+      break;
+    }
+    n = kind == __FCELIB_JOURNAL_TRIAGS ? journal->num_triags : journal->num_verts;
+    memcpy(idxs, kind == __FCELIB_JOURNAL_TRIAGS ? journal->triags_idx : journal->verts_idx, n * sizeof(*idxs));
+    for (i = 0; i < m->parts_len; ++i)
+    {
+      part = m->parts[i];
+      if (!part || (i < journal->parts_len && journal->scope[i] == 1))
+        continue;
+      if (kind == __FCELIB_JOURNAL_TRIAGS)
+      {
+        for (j = 0; j < part->ptriangles_len; ++j)
+          if (part->PTriangles[j] >= 0)
+            idxs[n++] = part->PTriangles[j];
+      }
+      else
+      {
+        for (j = 0; j < part->pvertices_len; ++j)
+          if (part->PVertices[j] >= 0)
+            idxs[n++] = part->PVertices[j];
+      }
+    }
+    n = __FCELIB_JOURNAL_SortUnique(idxs, n);
+
+    /* Keep changed slots only */
+    for (i = 0, k = 0; i < n; ++i)
+    {
+      const void *p = __FCELIB_JOURNAL_GetSavedSlot(journal, kind, idxs[i]);
+      const void *q = __FCELIB_JOURNAL_GetSlot(m, kind, idxs[i]);
+      if ((!p || !q) ? p != q : memcmp(p, q, slotsz) != 0)
+        idxs[k++] = idxs[i];
+    }
+    n = k;
+
+    for (i = 0; i < n; i = j)
+    {
+      for (j = i + 1; j < n && idxs[j] == idxs[j - 1] + 1; ++j)
+        continue;
+      if (!__FCELIB_JOURNAL_WriteInt(b, kind) || !__FCELIB_JOURNAL_WriteInt(b, idxs[i]) || !__FCELIB_JOURNAL_WriteInt(b, j - i))
+        break;
+      for (k = i; k < j; ++k)
+        if (!__FCELIB_JOURNAL_WriteSlot(b, __FCELIB_JOURNAL_GetSavedSlot(journal, kind, idxs[k]), slotsz))
+          break;
+      if (k < j)
+        break;
+      for (k = i; k < j; ++k)
+        if (!__FCELIB_JOURNAL_WriteSlot(b, __FCELIB_JOURNAL_GetSlot(m, kind, idxs[k]), slotsz))
+          break;
+      if (k < j)
+        break;
+    }
+    if (i < n)
+      break;
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(idxs);
+  return retv;
+}
+
+/* Encodes changes from saved state to mesh state m. Empty delta if equal. */
+int __FCELIB_JOURNAL_Diff(struct __FcelibJournalBuf *b, const FcelibJournal *journal, const FcelibMesh *m)
+{
+  int i;
+  int changed;
+  FcelibHeader hm;
+  const FcelibPart *pa;
+  const FcelibPart *pm;
+  const int n = SCL_max(journal->parts_len, m->parts_len);
+
+  /* header: tag, parts slots, old header, new header, old hdr.Parts, new hdr.Parts */
+  memcpy(&hm, &m->hdr, sizeof(hm));
+  hm.Parts = NULL;
+  changed = memcmp(&journal->hdr, &hm, sizeof(hm)) != 0;
+  for (i = 0; i < n && !changed; ++i)
+    changed = (i < journal->parts_len ? journal->parts[i] : -1) != (i < m->parts_len ? m->hdr.Parts[i] : -1);
+  if (changed)
+  {
+    if (!__FCELIB_JOURNAL_WriteInt(b, __FCELIB_JOURNAL_HEADER) || !__FCELIB_JOURNAL_WriteInt(b, n) ||
+        !__FCELIB_JOURNAL_Write(b, &journal->hdr, sizeof(hm)) || !__FCELIB_JOURNAL_Write(b, &hm, sizeof(hm)))
+      return 0;
+    for (i = 0; i < n; ++i)
+      if (!__FCELIB_JOURNAL_WriteInt(b, i < journal->parts_len ? journal->parts[i] : -1))
+        return 0;
+    for (i = 0; i < n; ++i)
+      if (!__FCELIB_JOURNAL_WriteInt(b, i < m->parts_len ? m->hdr.Parts[i] : -1))
+        return 0;
+  }
+
+  /* parts: tag, slot, old part, new part */
+  for (i = 0; i < n; ++i)
+  {
+    pm = i < m->parts_len ? m->parts[i] : NULL;
+    switch (i < journal->parts_len ? journal->scope[i] : 0)
+    {
+      case 1:
+        if (pm)
+          continue;
+        fprintf(stderr, "JournalRecord: Part slot %d deleted out of scope\n", i);
+        return 0;
+      case 2:
+        pa = journal->scope_parts[i];
+        break;
+      default:
+        pa = NULL;
+        break;
+    }
+    if (__FCELIB_JOURNAL_PartsEqual(pa, pm))
+      continue;
+    if (!__FCELIB_JOURNAL_WriteInt(b, __FCELIB_JOURNAL_PART) || !__FCELIB_JOURNAL_WriteInt(b, i) ||
+        !__FCELIB_JOURNAL_WritePart(b, pa) || !__FCELIB_JOURNAL_WritePart(b, pm))
+      return 0;
+  }
+
+  return __FCELIB_JOURNAL_DiffSlots(b, journal, m, __FCELIB_JOURNAL_TRIAGS) &&
+         __FCELIB_JOURNAL_DiffSlots(b, journal, m, __FCELIB_JOURNAL_VERTS);
+}
+
+/* delta decoding ----------------------------------------------------------- */
+
+void __FCELIB_JOURNAL_FreePart(FcelibPart *part)
+{
+  FCELIB_UTIL_Free(part->PVertices);
+  FCELIB_UTIL_Free(part->PTriangles);
+  FCELIB_TYPES_PartInvalidateCaches(part);
+  FCELIB_UTIL_Free(part);
+}
+
+/* Reads part blob at *pos; if (apply), sets mesh part slot idx to it. */
+int __FCELIB_JOURNAL_ReadPart(FcelibMesh *mesh, const int idx, const unsigned char *data, long *pos, const int apply)
+{
+  FcelibPart *part;
+  int PNumVertices;
+  int pvertices_len;
+  int PNumTriangles;
+  int ptriangles_len;
+  void *ptr;
+
+  if (!__FCELIB_JOURNAL_ReadInt(data, pos))
+  {
+    if (apply && mesh->parts[idx])
+    {
+      __FCELIB_JOURNAL_FreePart(mesh->parts[idx]);
+      mesh->parts[idx] = NULL;
+    }
+    return 1;
+  }
+
+  PNumVertices = __FCELIB_JOURNAL_ReadInt(data, pos);
+  pvertices_len = __FCELIB_JOURNAL_ReadInt(data, pos);
+  PNumTriangles = __FCELIB_JOURNAL_ReadInt(data, pos);
+  ptriangles_len = __FCELIB_JOURNAL_ReadInt(data, pos);
+  if (!apply)
+  {
+    *pos += sizeof(part->PartName) + sizeof(part->PartPos) + (pvertices_len + ptriangles_len) * (long)sizeof(int);
+    return 1;
+  }
+
+  part = mesh->parts[idx];
+  if (!part)
+  {
+    part = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part));
+    if (!part)
+    {
+      fprintf(stderr, "JournalApply: Cannot allocate memory (part)\n");
+      return 0;
+    }
+    memset(part, 0, sizeof(*part));
+    mesh->parts[idx] = part;
+  }
+  FCELIB_TYPES_PartInvalidateCaches(part);
+
+  if (pvertices_len != part->pvertices_len)
+  {
+    ptr = FCELIB_UTIL_Realloc(part->PVertices, SCL_max(1, pvertices_len) * sizeof(*part->PVertices));
+    if (!ptr)
+    {
+      fprintf(stderr, "JournalApply: Cannot reallocate memory (PVertices)\n");
+      return 0;
+    }
+    part->PVertices = (int *)ptr;
+    part->pvertices_len = pvertices_len;
+  }
+  if (ptriangles_len != part->ptriangles_len)
+  {
+    ptr = FCELIB_UTIL_Realloc(part->PTriangles, SCL_max(1, ptriangles_len) * sizeof(*part->PTriangles));
+    if (!ptr)
+    {
+      fprintf(stderr, "JournalApply: Cannot reallocate memory (PTriangles)\n");
+      return 0;
+    }
+    part->PTriangles = (int *)ptr;
+    part->ptriangles_len = ptriangles_len;
+  }
+
+  part->PNumVertices = PNumVertices;
+  part->PNumTriangles = PNumTriangles;
+  memcpy(part->PartName, data + *pos, sizeof(part->PartName));
+  *pos += sizeof(part->PartName);
+  memcpy(&part->PartPos, data + *pos, sizeof(part->PartPos));
+  *pos += sizeof(part->PartPos);
+  memcpy(part->PVertices, data + *pos, pvertices_len * sizeof(*part->PVertices));
+  *pos += pvertices_len * sizeof(*part->PVertices);
+  memcpy(part->PTriangles, data + *pos, ptriangles_len * sizeof(*part->PTriangles));
+  *pos += ptriangles_len * sizeof(*part->PTriangles);
+  return 1;
+}
+
+/* Reads count slot blobs at *pos; if (apply), sets mesh slots [first, first + count) to them. */
+int __FCELIB_JOURNAL_ReadSlots(FcelibMesh *mesh, const int kind, const int first, const int count,
+                               const unsigned char *data, long *pos, const int apply)
+{
+  int i;
+  void **slot;
+  const long slotsz = kind == __FCELIB_JOURNAL_TRIAGS ? (long)sizeof(FcelibTriangle) : (long)sizeof(FcelibVertex);
+
+  for (i = first; i < first + count; ++i)
+  {
+    const int present = __FCELIB_JOURNAL_ReadInt(data, pos);
+    if (!apply)
+    {
+      *pos += present ? slotsz : 0;
+      continue;
+    }
+
+    if (kind == __FCELIB_JOURNAL_TRIAGS)
+      slot = (void **)&mesh->triangles[i];
+    else
+      slot = (void **)&mesh->vertices[i];
+
+    if (!present)
+    {
+      FCELIB_UTIL_Free(*slot);
+      *slot = NULL;
+      continue;
+    }
+    if (!*slot)
+    {
+      *slot = FCELIB_UTIL_Malloc(slotsz);
+      if (!*slot)
+      {
+        fprintf(stderr, "JournalApply: Cannot allocate memory (slot)\n");
+        return 0;
+      }
+    }
+    memcpy(*slot, data + *pos, slotsz);
+    *pos += slotsz;
+  }
+
+  return 1;
+}
+
+/* Applies old (side == 0) or new (side == 1) contents of delta to mesh. */
+int __FCELIB_JOURNAL_Apply(FcelibMesh *mesh, const unsigned char *data, const long sz, const int side)
+{
+  int i;
+  int n;
+  int idx;
+  int count;
+  int *Parts;
+  long pos = 0;
+
+  while (pos < sz)
+  {
+    switch (__FCELIB_JOURNAL_ReadInt(data, &pos))
+    {
+      case __FCELIB_JOURNAL_HEADER:
+        n = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        if (n > mesh->parts_len && !FCELIB_TYPES_AddParts(mesh, n - mesh->parts_len))
+          return 0;
+        Parts = mesh->hdr.Parts;
+        memcpy(&mesh->hdr, data + pos + side * sizeof(mesh->hdr), sizeof(mesh->hdr));
+        mesh->hdr.Parts = Parts;
+        pos += 2 * sizeof(mesh->hdr);
+        memcpy(mesh->hdr.Parts, data + pos + side * n * sizeof(int), n * sizeof(int));
+        pos += 2 * n * sizeof(int);
+        for (i = n; i < mesh->parts_len; ++i)
+          mesh->hdr.Parts[i] = -1;
+        break;
+
+      case __FCELIB_JOURNAL_PART:
+        idx = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        if (idx >= mesh->parts_len && !FCELIB_TYPES_AddParts(mesh, idx + 1 - mesh->parts_len))
+          return 0;
+        if (!__FCELIB_JOURNAL_ReadPart(mesh, idx, data, &pos, side == 0) ||
+            !__FCELIB_JOURNAL_ReadPart(mesh, idx, data, &pos, side == 1))
+          return 0;
+        break;
+
+      case __FCELIB_JOURNAL_TRIAGS:
+        idx = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        count = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        if (idx + count > mesh->triangles_len && !FCELIB_TYPES_AddTrianglesToMesh(mesh, idx + count - mesh->triangles_len))
+          return 0;
+        if (!__FCELIB_JOURNAL_ReadSlots(mesh, __FCELIB_JOURNAL_TRIAGS, idx, count, data, &pos, side == 0) ||
+            !__FCELIB_JOURNAL_ReadSlots(mesh, __FCELIB_JOURNAL_TRIAGS, idx, count, data, &pos, side == 1))
+          return 0;
+        break;
+
+      case __FCELIB_JOURNAL_VERTS:
+        idx = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        count = __FCELIB_JOURNAL_ReadInt(data, &pos);
+        if (idx + count > mesh->vertices_len && !FCELIB_TYPES_AddVerticesToMesh(mesh, idx + count - mesh->vertices_len))
+          return 0;
+        if (!__FCELIB_JOURNAL_ReadSlots(mesh, __FCELIB_JOURNAL_VERTS, idx, count, data, &pos, side == 0) ||
+            !__FCELIB_JOURNAL_ReadSlots(mesh, __FCELIB_JOURNAL_VERTS, idx, count, data, &pos, side == 1))
+          return 0;
+        break;
+
+      default:
+        fprintf(stderr, "JournalApply: Invalid delta\n");
+        return 0;
+    }
+  }
+
+  /* triangles may have changed under any part */
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->parts[i])
+      FCELIB_TYPES_PartInvalidateCaches(mesh->parts[i]);
+  }
+
+  return 1;
+}
+
+/* journal ------------------------------------------------------------------ */
+
+/* Drops steps [first, num_steps). */
+void __FCELIB_JOURNAL_DropSteps(FcelibJournal *journal, const int first)
+{
+  int i;
+  for (i = first; i < journal->num_steps; ++i)
+  {
+    journal->bytes -= journal->steps_sz[i];
+    FCELIB_UTIL_Free(journal->steps[i]);
+  }
+  journal->num_steps = SCL_min(journal->num_steps, first);
+  journal->cursor = SCL_min(journal->cursor, first);
+}
+
+/* Trims oldest undo steps, then newest redo steps, until deltas fit the budget. */
+void __FCELIB_JOURNAL_Trim(FcelibJournal *journal)
+{
+  int i;
+  int k = 0;
+  long bytes;
+
+  while (k < journal->cursor && journal->bytes > journal->budget)
+  {
+    journal->bytes -= journal->steps_sz[k];
+    FCELIB_UTIL_Free(journal->steps[k]);
+    ++k;
+  }
+  for (i = k; i < journal->num_steps; ++i)
+  {
+    journal->steps[i - k] = journal->steps[i];
+    journal->steps_sz[i - k] = journal->steps_sz[i];
+  }
+  journal->num_steps -= k;
+  journal->cursor -= k;
+
+  bytes = journal->bytes;
+  for (i = journal->num_steps; i > journal->cursor && bytes > journal->budget; --i)
+    bytes -= journal->steps_sz[i - 1];
+  __FCELIB_JOURNAL_DropSteps(journal, i);
+}
+
+/* Frees saved state of pending step, if any. */
+void __FCELIB_JOURNAL_EndStep(FcelibJournal *journal)
+{
+  int i;
+  for (i = 0; journal->scope_parts && i < journal->parts_len; ++i)
+  {
+    if (journal->scope_parts[i])
+      __FCELIB_JOURNAL_FreePart(journal->scope_parts[i]);
+  }
+  FCELIB_UTIL_Free(journal->parts);
+  FCELIB_UTIL_Free(journal->scope);
+  FCELIB_UTIL_Free(journal->scope_parts);
+  FCELIB_UTIL_Free(journal->triags_idx);
+  FCELIB_UTIL_Free(journal->triags);
+  FCELIB_UTIL_Free(journal->verts_idx);
+  FCELIB_UTIL_Free(journal->verts);
+  journal->pending = 0;
+  journal->parts_len = 0;
+  journal->parts = NULL;
+  journal->scope = NULL;
+  journal->scope_parts = NULL;
+  journal->num_triags = 0;
+  journal->triags_idx = NULL;
+  journal->triags = NULL;
+  journal->num_verts = 0;
+  journal->verts_idx = NULL;
+  journal->verts = NULL;
+}
+
+void FCELIB_JOURNAL_Release(FcelibJournal *journal)
+{
+  __FCELIB_JOURNAL_EndStep(journal);
+  __FCELIB_JOURNAL_DropSteps(journal, 0);
+  FCELIB_UTIL_Free(journal->steps);
+  FCELIB_UTIL_Free(journal->steps_sz);
+#ifdef __cplusplus
+  *journal = {};
+#else
+  memset(journal, 0, sizeof(*journal));
+#endif
+}
+
+/*
+  Starts empty journal. budget: max bytes kept in deltas.
+  Assumes journal is uninitialized or released.
+*/
+void FCELIB_JOURNAL_Init(FcelibJournal *journal, const long budget)
+{
+#ifdef __cplusplus
+  *journal = {};
+#else
+  memset(journal, 0, sizeof(*journal));
+#endif
+  journal->budget = SCL_max(0, budget);
+}
+
+void FCELIB_JOURNAL_SetBudget(FcelibJournal *journal, const long budget)
+{
+  journal->budget = SCL_max(0, budget);
+  __FCELIB_JOURNAL_Trim(journal);
+}
+
+/*
+  Records changes of mesh since FCELIB_JOURNAL_Begin() as new step, if any.
+  Drops redo steps then.
+
+  Returns 1 if step was recorded, 0 if mesh is unchanged or no step is
+  pending, -1 on failure.
+*/
+int FCELIB_JOURNAL_Record(FcelibJournal *journal, const FcelibMesh *mesh)
+{
+  struct __FcelibJournalBuf b;
+  void *ptr;
+  int retv = -1;
+
+  if (!journal->pending)
+    return 0;
+
+  memset(&b, 0, sizeof(b));
+
+  for (;;)
+  {
+    if (!__FCELIB_JOURNAL_Diff(&b, journal, mesh))
+      break;
+    if (b.len == 0)
+    {
+      retv = 0;
+      break;
+    }
+
+    __FCELIB_JOURNAL_DropSteps(journal, journal->cursor);
+    if (journal->num_steps >= journal->steps_len)
+    {
+      const int steps_len = SCL_max(16, 2 * journal->steps_len);
+      ptr = FCELIB_UTIL_Realloc(journal->steps, steps_len * sizeof(*journal->steps));
+      if (!ptr)
+      {
+        fprintf(stderr, "JournalRecord: Cannot reallocate memory (steps)\n");
+        break;
+      }
+      journal->steps = (unsigned char **)ptr;
+      ptr = FCELIB_UTIL_Realloc(journal->steps_sz, steps_len * sizeof(*journal->steps_sz));
+      if (!ptr)
+      {
+        fprintf(stderr, "JournalRecord: Cannot reallocate memory (steps_sz)\n");
+        break;
+      }
+      journal->steps_sz = (long *)ptr;
+      journal->steps_len = steps_len;
+    }
+
+    /* shrink to fit */
+    ptr = FCELIB_UTIL_Realloc(b.data, b.len);
+    if (ptr)
+      b.data = (unsigned char *)ptr;
+    journal->steps[journal->num_steps] = b.data;
+    journal->steps_sz[journal->num_steps] = b.len;
+    journal->bytes += b.len;
+    ++journal->num_steps;
+    journal->cursor = journal->num_steps;
+    b.data = NULL;
+    __FCELIB_JOURNAL_Trim(journal);
+
+    retv = 1;
+    break;
+  }
+
+  __FCELIB_JOURNAL_EndStep(journal);
+  FCELIB_UTIL_Free(b.data);
+  return retv;
+}
+
+/*
+  Records the pending step, if any, then saves the state of mesh before the
+  next step: header, and parts pids (order) with their triangles and
+  vertices. pids == NULL saves all parts, i.e. the whole mesh. Parts added
+  by the step need not be in pids; invalid pids are ignored.
+
+  Returns 1 on success, 0 on failure.
+*/
+int FCELIB_JOURNAL_Begin(FcelibJournal *journal, const FcelibMesh *mesh, const int *pids, const int pids_len)
+{
+  int retv = 0;
+  int i;
+  int j;
+  int k;
+  int nt = 0;
+  int nv = 0;
+  const FcelibPart *part;
+  FcelibPart *copy;
+
+  if (FCELIB_JOURNAL_Record(journal, mesh) < 0)
+    return 0;
+
+  for (;;)
+  {
+    journal->pending = 1;
+    memcpy(&journal->hdr, &mesh->hdr, sizeof(journal->hdr));
+    journal->hdr.Parts = NULL;
+    journal->parts_len = mesh->parts_len;
+    journal->parts = (int *)FCELIB_UTIL_Malloc((mesh->parts_len + 1) * sizeof(*journal->parts));
+    journal->scope = (unsigned char *)FCELIB_UTIL_Malloc((mesh->parts_len + 1) * sizeof(*journal->scope));
+    journal->scope_parts = (FcelibPart **)FCELIB_UTIL_Malloc((mesh->parts_len + 1) * sizeof(*journal->scope_parts));
+    if (!journal->parts || !journal->scope || !journal->scope_parts)
+    {
+      fprintf(stderr, "JournalBegin: Cannot allocate memory\n");
+      break;
+    }
+    if (mesh->parts_len > 0)
+      memcpy(journal->parts, mesh->hdr.Parts, mesh->parts_len * sizeof(*journal->parts));
+    memset(journal->scope_parts, 0, (mesh->parts_len + 1) * sizeof(*journal->scope_parts));
+    for (i = 0; i < mesh->parts_len; ++i)
+      journal->scope[i] = mesh->parts[i] ? (pids ? 1 : 2) : 0;
+    for (i = 0; pids && i < pids_len; ++i)
+    {
+      if (pids[i] < 0 || pids[i] >= mesh->hdr.NumParts)
+        continue;
+      k = mesh->hdr.Parts[ FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pids[i]) ];
+      journal->scope[k] = 2;
+    }
+
+    /* Copy parts in scope */
+    for (i = 0; i < mesh->parts_len; ++i)
+    {
+      if (journal->scope[i] != 2)
+        continue;
+      part = mesh->parts[i];
+      copy = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*copy));
+      if (!copy)
+        break;
+      memcpy(copy, part, sizeof(*copy));
+      copy->adj = NULL;
+      copy->bvh = NULL;
+      copy->PVertices = (int *)FCELIB_UTIL_Malloc((part->pvertices_len + 1) * sizeof(*copy->PVertices));
+      copy->PTriangles = (int *)FCELIB_UTIL_Malloc((part->ptriangles_len + 1) * sizeof(*copy->PTriangles));
+      journal->scope_parts[i] = copy;
+      if (!copy->PVertices || !copy->PTriangles)
+        break;
+      memcpy(copy->PVertices, part->PVertices, part->pvertices_len * sizeof(*copy->PVertices));
+      memcpy(copy->PTriangles, part->PTriangles, part->ptriangles_len * sizeof(*copy->PTriangles));
+      nv += part->pvertices_len;
+      nt += part->ptriangles_len;
+    }
+    if (i < mesh->parts_len)
+    {
+      fprintf(stderr, "JournalBegin: Cannot allocate memory (parts)\n");
+      break;
+    }
+
+    /* Copy their triangles and vertices, by ascending slot */
+    journal->triags_idx = (int *)FCELIB_UTIL_Malloc((nt + 1) * sizeof(*journal->triags_idx));
+    journal->triags = (FcelibTriangle *)FCELIB_UTIL_Malloc((nt + 1) * sizeof(*journal->triags));
+    journal->verts_idx = (int *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*journal->verts_idx));
+    journal->verts = (FcelibVertex *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*journal->verts));
+    if (!journal->triags_idx || !journal->triags || !journal->verts_idx || !journal->verts)
+    {
+      fprintf(stderr, "JournalBegin: Cannot allocate memory (slots)\n");
+      break;
+    }
+    for (i = 0, nt = 0, nv = 0; i < mesh->parts_len; ++i)
+    {
+      part = journal->scope_parts[i];
+      if (!part)
+        continue;
+      for (j = 0; j < part->ptriangles_len; ++j)
+      {
+        k = part->PTriangles[j];
+        if (k >= 0 && k < mesh->triangles_len && mesh->triangles[k])
+          journal->triags_idx[nt++] = k;
+      }
+      for (j = 0; j < part->pvertices_len; ++j)
+      {
+        k = part->PVertices[j];
+        if (k >= 0 && k < mesh->vertices_len && mesh->vertices[k])
+          journal->verts_idx[nv++] = k;
+      }
+    }
+    journal->num_triags = __FCELIB_JOURNAL_SortUnique(journal->triags_idx, nt);
+    journal->num_verts = __FCELIB_JOURNAL_SortUnique(journal->verts_idx, nv);
+    for (i = 0; i < journal->num_triags; ++i)
+      memcpy(&journal->triags[i], mesh->triangles[ journal->triags_idx[i] ], sizeof(*journal->triags));
+    for (i = 0; i < journal->num_verts; ++i)
+      memcpy(&journal->verts[i], mesh->vertices[ journal->verts_idx[i] ], sizeof(*journal->verts));
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  if (!retv)
+    __FCELIB_JOURNAL_EndStep(journal);
+  return retv;
+}
+
+/*
+  Records the pending step, then reverts mesh to the state before the last step.
+
+  Returns 1 if step was undone, 0 if there is nothing to undo, -1 on failure.
+*/
+int FCELIB_JOURNAL_Undo(FcelibJournal *journal, FcelibMesh *mesh)
+{
+  int i;
+  if (FCELIB_JOURNAL_Record(journal, mesh) < 0)
+    return -1;
+  if (journal->cursor == 0)
+    return 0;
+  i = journal->cursor - 1;
+  if (!__FCELIB_JOURNAL_Apply(mesh, journal->steps[i], journal->steps_sz[i], 0))
+  {
+    fprintf(stderr, "JournalUndo: Cannot apply step\n");
+    return -1;
+  }
+  journal->cursor = i;
+  return 1;
+}
+
+/*
+  Records the pending step (dropping redo steps, if any), then re-applies
+  the next undone step.
+
+  Returns 1 if step was redone, 0 if there is nothing to redo, -1 on failure.
+*/
+int FCELIB_JOURNAL_Redo(FcelibJournal *journal, FcelibMesh *mesh)
+{
+  int i;
+  if (FCELIB_JOURNAL_Record(journal, mesh) < 0)
+    return -1;
+  if (journal->cursor >= journal->num_steps)
+    return 0;
+  i = journal->cursor;
+  if (!__FCELIB_JOURNAL_Apply(mesh, journal->steps[i], journal->steps_sz[i], 1))
+  {
+    fprintf(stderr, "JournalRedo: Cannot apply step\n");
+    return -1;
+  }
+  journal->cursor = i + 1;
+  return 1;
+}
+
+#endif  /* FCELIB_JOURNAL_H_ */
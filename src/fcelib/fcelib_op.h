@@ -127,6 +127,612 @@ int FCELIB_OP_SetPartCenter(FcelibMesh *mesh, int pid, const float new_center[3]
   return retv;
 }
 
+/* v = a * v, plus translation column of matrix if not NULL. a is 3x3 row-major. */
+void __FCELIB_OP_TransformVec(tVector *v, const float a[9], const float *matrix)
+{
+  const float x = v->x;
+  const float y = v->y;
+  const float z = v->z;
+  v->x = a[0] * x + a[1] * y + a[2] * z;
+  v->y = a[3] * x + a[4] * y + a[5] * z;
+  v->z = a[6] * x + a[7] * y + a[8] * z;
+  if (!matrix)
+    return;
+  v->x += matrix[3];
+  v->y += matrix[7];
+  v->z += matrix[11];
+}
+
+/* v = c * v, rescaled to previous length. Unchanged if result is zero. */
+void __FCELIB_OP_TransformNormal(tVector *v, const float c[9])
+{
+  const double len2 = (double)v->x * v->x + (double)v->y * v->y + (double)v->z * v->z;
+  double len2_new;
+  double scale;
+  tVector r;
+  r.x = c[0] * v->x + c[1] * v->y + c[2] * v->z;
+  r.y = c[3] * v->x + c[4] * v->y + c[5] * v->z;
+  r.z = c[6] * v->x + c[7] * v->y + c[8] * v->z;
+  len2_new = (double)r.x * r.x + (double)r.y * r.y + (double)r.z * r.z;
+  if (!(len2_new > 0.0))
+    return;
+  scale = FCELIB_UTIL_Sqrt(len2 / len2_new);
+  v->x = (float)(r.x * scale);
+  v->y = (float)(r.y * scale);
+  v->z = (float)(r.z * scale);
+}
+
+/*
+  Affine transform of specified parts, or of all parts and dummies if pids is
+  NULL. matrix is 4x4 row-major, applied to column vectors, i.e.,
+  x' = matrix[0] * x + matrix[1] * y + matrix[2] * z + matrix[3].
+
+  Part positions are transformed by the full matrix; local vertex positions
+  by its linear 3x3 block only, so parts keep their local frame. Normals are
+  transformed by the inverse transpose of the linear block, keeping their
+  length. If the linear block mirrors (det < 0), triangle winding is flipped.
+
+  Returns bool (on failure, mesh is unchanged).
+*/
+int FCELIB_OP_Transform(FcelibMesh *mesh, const float matrix[16], const int *pids, const int pids_len,
+                        const int apply_to_damage, const int transform_normals)
+{
+  int retv = 0;
+  int i;
+  int j;
+  int k;
+  int n;
+  int *internal_pids = NULL;
+  unsigned char *used = NULL;
+  float a[9];  /* linear block */
+  float c[9];  /* cofactor matrix of a, sign-corrected, i.e. proportional to a^-T */
+  float det;
+  float tmp;
+  FcelibPart *part;
+  FcelibTriangle *triag;
+
+  for (;;)
+  {
+    if (!matrix || (pids && pids_len < 0))
+    {
+      fprintf(stderr, "Transform: Unexpected NULL (matrix)\n");
+      break;
+    }
+
+    n = pids ? pids_len : mesh->hdr.NumParts;
+    internal_pids = (int *)FCELIB_UTIL_Malloc((n + 1) * sizeof(*internal_pids));
+    used = (unsigned char *)FCELIB_UTIL_Malloc(mesh->parts_len * sizeof(*used) + 1);
+    if (!internal_pids || !used)
+    {
+      fprintf(stderr, "Transform: Cannot allocate memory\n");
+      break;
+    }
+    memset(used, 0, mesh->parts_len * sizeof(*used) + 1);
+
+    if (pids)
+    {
+      for (i = 0; i < n; ++i)
+      {
+        internal_pids[i] = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pids[i]);
+        if (internal_pids[i] < 0)
+        {
+          fprintf(stderr, "Transform: Invalid index (pids[%d] = %d)\n", i, pids[i]);
+          break;
+        }
+        if (used[ internal_pids[i] ])
+        {
+          fprintf(stderr, "Transform: Duplicate index (pids[%d] = %d)\n", i, pids[i]);
+          break;
+        }
+        used[ internal_pids[i] ] = 1;
+      }
+      if (i < n)
+        break;
+    }
+    else
+    {
+      for (i = 0, n = 0; i < mesh->parts_len; ++i)
+      {
+        if (mesh->hdr.Parts[i] >= 0)
+          internal_pids[n++] = i;
+      }
+    }
+
+    a[0] = matrix[0]; a[1] = matrix[1]; a[2] = matrix[2];
+    a[3] = matrix[4]; a[4] = matrix[5]; a[5] = matrix[6];
+    a[6] = matrix[8]; a[7] = matrix[9]; a[8] = matrix[10];
+    c[0] = a[4] * a[8] - a[5] * a[7];
+    c[1] = a[5] * a[6] - a[3] * a[8];
+    c[2] = a[3] * a[7] - a[4] * a[6];
+    c[3] = a[2] * a[7] - a[1] * a[8];
+    c[4] = a[0] * a[8] - a[2] * a[6];
+    c[5] = a[1] * a[6] - a[0] * a[7];
+    c[6] = a[1] * a[5] - a[2] * a[4];
+    c[7] = a[2] * a[3] - a[0] * a[5];
+    c[8] = a[0] * a[4] - a[1] * a[3];
+    det = a[0] * c[0] + a[1] * c[1] + a[2] * c[2];
+    if (det < 0)
+    {
+      for (j = 0; j < 9; ++j)
+        c[j] = -c[j];
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+      part = mesh->parts[ mesh->hdr.Parts[internal_pids[i]] ];
+      __FCELIB_OP_TransformVec(&part->PartPos, a, matrix);
+      FCELIB_TYPES_PartInvalidateBvh(part);
+
+      for (j = 0; j < part->pvertices_len; ++j)
+      {
+        FcelibVertex *vert;
+        if (part->PVertices[j] < 0)
+          continue;
+        vert = mesh->vertices[ part->PVertices[j] ];
+        __FCELIB_OP_TransformVec(&vert->VertPos, a, NULL);
+        if (transform_normals)
+          __FCELIB_OP_TransformNormal(&vert->NormPos, c);
+        if (!apply_to_damage)
+          continue;
+        __FCELIB_OP_TransformVec(&vert->DamgdVertPos, a, NULL);
+        if (transform_normals)
+          __FCELIB_OP_TransformNormal(&vert->DamgdNormPos, c);
+      }
+
+      if (det >= 0)
+        continue;
+      FCELIB_TYPES_PartInvalidateCaches(part);
+      for (j = 0; j < part->ptriangles_len; ++j)
+      {
+        if (part->PTriangles[j] < 0)
+          continue;
+        triag = mesh->triangles[ part->PTriangles[j] ];
+        k = triag->vidx[1]; triag->vidx[1] = triag->vidx[2]; triag->vidx[2] = k;
+        tmp = triag->U[1]; triag->U[1] = triag->U[2]; triag->U[2] = tmp;
+        tmp = triag->V[1]; triag->V[1] = triag->V[2]; triag->V[2] = tmp;
+      }
+    }
+
+    if (!pids)
+    {
+      for (i = 0; i < mesh->hdr.NumDummies && i < 16; ++i)
+        __FCELIB_OP_TransformVec(&mesh->hdr.Dummies[i], a, matrix);
+    }
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(internal_pids);
+  FCELIB_UTIL_Free(used);
+
+  return retv;
+}
+
+#define FCELIB_OP_NORMALS_AREA  0  /* face normals weighted by triangle area */
+#define FCELIB_OP_NORMALS_ANGLE 1  /* unit face normals weighted by corner angle */
+
+struct __FcelibOpPosKey {
+  float pos[3];
+  int   idx;
+};
+
+int __FCELIB_OP_ComparePosKeys(const void *a, const void *b)
+{
+  const struct __FcelibOpPosKey *arg1 = (const struct __FcelibOpPosKey *)a;
+  const struct __FcelibOpPosKey *arg2 = (const struct __FcelibOpPosKey *)b;
+  int k;
+  for (k = 0; k < 3; ++k)
+  {
+    if (arg1->pos[k] != arg2->pos[k])
+      return (arg1->pos[k] > arg2->pos[k]) - (arg1->pos[k] < arg2->pos[k]);
+  }
+  return (arg1->idx > arg2->idx) - (arg1->idx < arg2->idx);
+}
+
+/*
+  Recomputes normals (or damaged normals from damaged positions) of part
+  vertices, see FCELIB_OP_ComputeNormals(). Per-vert accumulators are by
+  vert order in part.
+
+  If moved is not NULL (per vert, by vert order in part), only normals that
+  depend on moved verts are written: verts sharing a triangle with a moved
+  vert, and verts coincident with those.
+*/
+int __FCELIB_OP_ComputePartNormals(FcelibMesh *mesh, FcelibPart *part, const int mode, const float crease_cos,
+                                   const int damaged, const unsigned char *moved)
+{
+  int retv = 0;
+  int j;
+  int k;
+  int m;
+  int n;
+  int v[3];
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  double *acc = NULL;  /* per local vert: sum of weighted face normals */
+  double *out = NULL;  /* per local vert: acc, plus acc of coincident verts within crease angle */
+  unsigned char *upd = NULL;  /* per local vert: normal is written, if (moved) */
+  struct __FcelibOpPosKey *keys = NULL;
+  const tVector *p[3];
+  const FcelibTriangle *triag;
+  FcelibVertex *vert;
+
+  for (;;)
+  {
+    n = part->PNumVertices;
+    if (n < 1)
+    {
+      retv = 1;
+      break;
+    }
+
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    acc = (double *)FCELIB_UTIL_Malloc(2 * 3 * n * sizeof(*acc));
+    if (!acc)
+    {
+      fprintf(stderr, "ComputeNormals: Cannot allocate memory\n");
+      break;
+    }
+    memset(acc, 0, 2 * 3 * n * sizeof(*acc));
+    if (moved)
+    {
+      upd = (unsigned char *)FCELIB_UTIL_Malloc(n * sizeof(*upd));
+      if (!upd)
+      {
+        fprintf(stderr, "ComputeNormals: Cannot allocate memory (upd)\n");
+        break;
+      }
+      memcpy(upd, moved, n * sizeof(*upd));
+    }
+
+    /* Accumulate face normals */
+    for (j = 0; j < part->ptriangles_len; ++j)
+    {
+      double e1[3];
+      double e2[3];
+      double c[3];
+      double len;
+      double w;
+
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        v[k] = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (v[k] < 0)
+          break;
+        vert = mesh->vertices[ triag->vidx[k] ];
+        p[k] = damaged ? &vert->DamgdVertPos : &vert->VertPos;
+      }
+      if (k < 3)
+        continue;
+      if (upd && (moved[v[0]] || moved[v[1]] || moved[v[2]]))
+        upd[v[0]] = upd[v[1]] = upd[v[2]] = 1;
+
+      e1[0] = (double)p[1]->x - p[0]->x; e1[1] = (double)p[1]->y - p[0]->y; e1[2] = (double)p[1]->z - p[0]->z;
+      e2[0] = (double)p[2]->x - p[0]->x; e2[1] = (double)p[2]->y - p[0]->y; e2[2] = (double)p[2]->z - p[0]->z;
+      /* FCE triangles are clockwise, i.e., face normal is e2 x e1 */
+      c[0] = e2[1] * e1[2] - e2[2] * e1[1];
+      c[1] = e2[2] * e1[0] - e2[0] * e1[2];
+      c[2] = e2[0] * e1[1] - e2[1] * e1[0];
+      len = FCELIB_UTIL_Sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+      if (!(len > 0.0))
+        continue;
+
+      for (k = 0; k < 3; ++k)
+      {
+        const tVector *q0 = p[k];
+        const tVector *q1 = p[(k + 1) % 3];
+        const tVector *q2 = p[(k + 2) % 3];
+        m = 3 * v[k];
+        if (mode == FCELIB_OP_NORMALS_ANGLE)
+        {
+          /* |a x b| is twice the triangle area at each corner */
+          w = FCELIB_UTIL_Atan2(len, ((double)q1->x - q0->x) * ((double)q2->x - q0->x) +
+                                     ((double)q1->y - q0->y) * ((double)q2->y - q0->y) +
+                                     ((double)q1->z - q0->z) * ((double)q2->z - q0->z)) / len;
+        }
+        else
+          w = 1.0;
+        acc[m + 0] += w * c[0];
+        acc[m + 1] += w * c[1];
+        acc[m + 2] += w * c[2];
+      }
+    }
+
+    /* Share normals across coincident verts (e.g., at texture seams) */
+    out = acc + 3 * n;
+    memcpy(out, acc, 3 * n * sizeof(*out));
+    if (crease_cos <= 1.0f && part->PNumVertices > 1)
+    {
+      keys = (struct __FcelibOpPosKey *)FCELIB_UTIL_Malloc(part->PNumVertices * sizeof(*keys));
+      if (!keys)
+      {
+        fprintf(stderr, "ComputeNormals: Cannot allocate memory (keys)\n");
+        break;
+      }
+      for (j = 0, m = 0; j < part->pvertices_len && m < part->PNumVertices; ++j)
+      {
+        if (part->PVertices[j] < 0)
+          continue;
+        vert = mesh->vertices[ part->PVertices[j] ];
+        p[0] = damaged ? &vert->DamgdVertPos : &vert->VertPos;
+        keys[m].pos[0] = p[0]->x;
+        keys[m].pos[1] = p[0]->y;
+        keys[m].pos[2] = p[0]->z;
+        keys[m].idx = m;
+        ++m;
+      }
+      qsort(keys, m, sizeof(*keys), __FCELIB_OP_ComparePosKeys);
+
+      for (j = 0; j < m; j = k)
+      {
+        int a;
+        int b;
+        k = j + 1;
+        while (k < m && keys[k].pos[0] == keys[j].pos[0] &&
+               keys[k].pos[1] == keys[j].pos[1] && keys[k].pos[2] == keys[j].pos[2])
+          ++k;
+        if (upd)
+        {
+          for (a = j; a < k && !upd[keys[a].idx]; ++a)
+            continue;
+          if (a < k)
+          {
+            for (b = j; b < k; ++b)
+              upd[keys[b].idx] = 1;
+          }
+        }
+        for (a = j; a < k; ++a)
+        {
+          const double *na = acc + 3 * keys[a].idx;
+          const double la = na[0] * na[0] + na[1] * na[1] + na[2] * na[2];
+          for (b = j; b < k; ++b)
+          {
+            const double *nb = acc + 3 * keys[b].idx;
+            const double lb = nb[0] * nb[0] + nb[1] * nb[1] + nb[2] * nb[2];
+            const double d = na[0] * nb[0] + na[1] * nb[1] + na[2] * nb[2];
+            if (a == b || !(la > 0.0) || !(lb > 0.0))
+              continue;
+            if (d < crease_cos * FCELIB_UTIL_Sqrt(la * lb))
+              continue;
+            out[3 * keys[a].idx + 0] += nb[0];
+            out[3 * keys[a].idx + 1] += nb[1];
+            out[3 * keys[a].idx + 2] += nb[2];
+          }
+        }
+      }
+    }
+
+    /* Normalize, keep existing normal of unreferenced verts */
+    for (j = 0, m = 0; j < part->pvertices_len && m < n; ++j)
+    {
+      const double *o;
+      double len;
+      tVector *normal;
+      if (part->PVertices[j] < 0)
+        continue;
+      o = out + 3 * m++;
+      if (upd && !upd[m - 1])
+        continue;
+      len = FCELIB_UTIL_Sqrt(o[0] * o[0] + o[1] * o[1] + o[2] * o[2]);
+      if (!(len > 0.0))
+        continue;
+      vert = mesh->vertices[ part->PVertices[j] ];
+      normal = damaged ? &vert->DamgdNormPos : &vert->NormPos;
+      normal->x = (float)(o[0] / len);
+      normal->y = (float)(o[1] / len);
+      normal->z = (float)(o[2] / len);
+    }
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(acc);
+  FCELIB_UTIL_Free(upd);
+  FCELIB_UTIL_Free(keys);
+
+  return retv;
+}
+
+/*
+  Recomputes vertex normals of part pid, or of all parts if pid < 0, from
+  adjacent triangles (see FCELIB_OP_NORMALS_*). Damaged normals are
+  recomputed from damaged positions if apply_to_damage.
+
+  Each vertex has one normal. Coincident vertices of a part (e.g., split at
+  texture seams) share their normals if these are within the crease angle,
+  i.e. if the cosine of the angle between them is >= crease_cos; pass
+  crease_cos > 1 to disable. Returns bool.
+*/
+int FCELIB_OP_ComputeNormals(FcelibMesh *mesh, const int pid, const int mode, const float crease_cos,
+                             const int apply_to_damage)
+{
+  int i;
+  int internal_pid = -1;
+  FcelibPart *part;
+
+  if (mode != FCELIB_OP_NORMALS_AREA && mode != FCELIB_OP_NORMALS_ANGLE)
+  {
+    fprintf(stderr, "ComputeNormals: Invalid mode %d\n", mode);
+    return 0;
+  }
+  if (pid >= 0)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "ComputeNormals: Invalid index (internal_pid)\n");
+      return 0;
+    }
+  }
+
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0 || (internal_pid >= 0 && i != internal_pid))
+      continue;
+    part = mesh->parts[ mesh->hdr.Parts[i] ];
+    if (!__FCELIB_OP_ComputePartNormals(mesh, part, mode, crease_cos, 0, NULL))
+      return 0;
+    if (apply_to_damage && !__FCELIB_OP_ComputePartNormals(mesh, part, mode, crease_cos, 1, NULL))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Returns hash of (seed, n) in [0, 1) */
+float __FCELIB_OP_Hash01(const unsigned long seed, const unsigned long n)
+{
+  unsigned long h = (seed * 2654435761UL + n * 2246822519UL + 0x9E3779B9UL) & 0xFFFFFFFFUL;
+  h ^= h >> 16;
+  h = (h * 0x7FEB352DUL) & 0xFFFFFFFFUL;
+  h ^= h >> 15;
+  h = (h * 0x846CA68BUL) & 0xFFFFFFFFUL;
+  h ^= h >> 16;
+  return (float)((double)(h >> 8) / 16777216.0);
+}
+
+/*
+  Generates damaged vertice positions for parts pids (all parts if NULL),
+  from undamaged positions and normals. impacts holds num_impacts points in
+  global coordinates (xyz). Each vertex within radius of an impact point is
+  pushed inwards, against its normal, by
+
+    strength * (1 - d^2 / radius^2)^2 * jitter
+
+  where d is the distance to the impact point, and jitter in [0.5, 1.5) is
+  given by seed and global vert index. Displacements of impacts add up.
+  Vertices outside radius of all impact points are undamaged. Existing
+  damaged positions of pids are overwritten, so that they depend on the
+  input only.
+
+  Damaged normals are then recomputed from damaged positions where these
+  changed: for vertices whose damaged position changed, and vertices sharing
+  a triangle with those (see FCELIB_OP_ComputeNormals, incl. crease_cos).
+  Other damaged normals are kept.
+
+  Returns bool.
+*/
+int FCELIB_OP_GenerateDamage(FcelibMesh *mesh, const int *pids, const int pids_len,
+                             const float *impacts, const int num_impacts,
+                             const float radius, const float strength, const unsigned long seed,
+                             const float crease_cos)
+{
+  int retv = 0;
+  int i;
+  int j;
+  int k;
+  int m;
+  int n;
+  int internal_pid;
+  float pos[3];
+  float nrm[3];
+  float disp;
+  float d2;
+  float t;
+  tVector damgd;
+  const float r2 = radius * radius;
+  const float inv_r2 = radius > 0.0f ? 1.0f / r2 : 0.0f;
+  unsigned char *moved = NULL;  /* per vert, by vert order in part: damaged position changed */
+  int moved_len = 0;
+  int num_moved;
+  FcelibPart *part;
+  FcelibVertex *vert;
+
+  if ((pids && pids_len < 0) || (num_impacts > 0 && !impacts) || num_impacts < 0)
+  {
+    fprintf(stderr, "GenerateDamage: Unexpected NULL (pids, impacts)\n");
+    return 0;
+  }
+  if (!(radius > 0.0f))
+  {
+    fprintf(stderr, "GenerateDamage: Invalid radius\n");
+    return 0;
+  }
+  for (i = 0; pids && i < pids_len; ++i)
+  {
+    if (FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pids[i]) < 0)
+    {
+      fprintf(stderr, "GenerateDamage: Invalid index (pids[%d] = %d)\n", i, pids[i]);
+      return 0;
+    }
+  }
+
+  n = pids ? pids_len : mesh->hdr.NumParts;
+  for (i = 0; i < n; ++i)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pids ? pids[i] : i);
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+
+    if (part->PNumVertices > moved_len)
+    {
+      void *ptr = FCELIB_UTIL_Realloc(moved, part->PNumVertices * sizeof(*moved));
+      if (!ptr)
+      {
+        fprintf(stderr, "GenerateDamage: Cannot allocate memory\n");
+        break;
+      }
+      moved = (unsigned char *)ptr;
+      moved_len = part->PNumVertices;
+    }
+
+    for (j = 0, m = 0, num_moved = 0; j < part->pvertices_len && m < part->PNumVertices; ++j)
+    {
+      if (part->PVertices[j] < 0)
+        continue;
+      vert = mesh->vertices[ part->PVertices[j] ];
+      pos[0] = vert->VertPos.x + part->PartPos.x;
+      pos[1] = vert->VertPos.y + part->PartPos.y;
+      pos[2] = vert->VertPos.z + part->PartPos.z;
+
+      /* Falloff kernel, summed over impacts */
+      disp = 0.0f;
+      for (k = 0; k < num_impacts; ++k)
+      {
+        const float dx = pos[0] - impacts[3 * k + 0];
+        const float dy = pos[1] - impacts[3 * k + 1];
+        const float dz = pos[2] - impacts[3 * k + 2];
+        d2 = dx * dx + dy * dy + dz * dz;
+        t = 1.0f - SCL_min(d2 * inv_r2, 1.0f);
+        disp += t * t;
+      }
+
+      memcpy(&damgd, &vert->VertPos, sizeof(damgd));
+      nrm[0] = vert->NormPos.x;
+      nrm[1] = vert->NormPos.y;
+      nrm[2] = vert->NormPos.z;
+      t = (float)FCELIB_UTIL_Sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+      if (disp > 0.0f && t > 0.0f)
+      {
+        disp *= strength * (0.5f + __FCELIB_OP_Hash01(seed, (unsigned long)part->PVertices[j])) / t;
+        damgd.x -= disp * nrm[0];
+        damgd.y -= disp * nrm[1];
+        damgd.z -= disp * nrm[2];
+      }
+
+      moved[m] = memcmp(&damgd, &vert->DamgdVertPos, sizeof(damgd)) != 0;
+      num_moved += moved[m];
+      memcpy(&vert->DamgdVertPos, &damgd, sizeof(damgd));
+      ++m;
+    }
+
+    if (num_moved > 0 &&
+        !__FCELIB_OP_ComputePartNormals(mesh, part, FCELIB_OP_NORMALS_AREA, crease_cos, 1, moved))
+      break;
+  }
+  if (i == n)
+    retv = 1;
+
+  FCELIB_UTIL_Free(moved);
+
+  return retv;
+}
+
 /*
   Returns mesh new part index (order) on success, -1 on failure.
   Allows (mesh == mesh_src)
@@ -179,7 +785,7 @@ int FCELIB_OP_CopyPartToMesh(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src
 
     /* Add part */
     mesh->hdr.Parts[internal_pid_new] = FCELIB_UTIL_ArrMax(mesh->hdr.Parts, mesh->parts_len) + 1;
-    part_new = (FcelibPart *)malloc(sizeof(*part_new));
+    part_new = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part_new));
     if (!part_new)
     {
       fprintf(stderr, "CopyPartToMesh: Cannot allocate memory (part_new)\n");
@@ -227,7 +833,7 @@ int FCELIB_OP_CopyPartToMesh(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src
     }
     mesh->hdr.NumVertices += part_new->PNumVertices;
 
-    old_global_to_new_global_idxs = (int *)malloc(mesh_src->vertices_len * sizeof(*old_global_to_new_global_idxs));
+    old_global_to_new_global_idxs = (int *)FCELIB_UTIL_Malloc(mesh_src->vertices_len * sizeof(*old_global_to_new_global_idxs));
     if (!old_global_to_new_global_idxs)
     {
       fprintf(stderr, "CopyPartToMesh: Cannot allocate memory (map)\n");
@@ -242,7 +848,7 @@ int FCELIB_OP_CopyPartToMesh(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src
       if (part_src->PVertices[i] < 0)
         continue;
 
-      mesh->vertices[vidx_1st + j] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
+      mesh->vertices[vidx_1st + j] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
       if (!mesh->vertices[vidx_1st + j])
       {
         fprintf(stderr, "CopyPartToMesh: Cannot allocate memory (vert)\n");
@@ -280,7 +886,7 @@ int FCELIB_OP_CopyPartToMesh(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src
       if (part_src->PTriangles[i] < 0)
         continue;
 
-      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
+      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
       if (!mesh->triangles[tidx_1st + j])
       {
         fprintf(stderr, "CopyPartToMesh: Cannot allocate memory (triag)\n");
@@ -308,7 +914,7 @@ int FCELIB_OP_CopyPartToMesh(FcelibMesh *mesh, FcelibMesh *mesh_src, int pid_src
     break;
   }  /* for (;;) */
 
-  free(old_global_to_new_global_idxs);
+  FCELIB_UTIL_Free(old_global_to_new_global_idxs);
 
   return pid_new;
 }
@@ -333,24 +939,25 @@ void FCELIB_OP_DeletePart(FcelibMesh *mesh, int pid)
     {
       if (part->PVertices[i] < 0)
         continue;
-      free(mesh->vertices[ part->PVertices[i] ]);
+      FCELIB_UTIL_Free(mesh->vertices[ part->PVertices[i] ]);
       mesh->vertices[ part->PVertices[i] ] = NULL;
     }
-    free(part->PVertices);
+    FCELIB_UTIL_Free(part->PVertices);
 
     for (i = 0; i < part->ptriangles_len; ++i)
     {
       if (part->PTriangles[i] < 0)
         continue;
-      free(mesh->triangles[ part->PTriangles[i] ]);
+      FCELIB_UTIL_Free(mesh->triangles[ part->PTriangles[i] ]);
       mesh->triangles[ part->PTriangles[i] ] = NULL;
     }
-    free(part->PTriangles);
+    FCELIB_UTIL_Free(part->PTriangles);
 
     mesh->hdr.NumVertices -= part->PNumVertices;
     mesh->hdr.NumTriangles -= part->PNumTriangles;
     --mesh->hdr.NumParts;
-    free(part);
+    FCELIB_TYPES_PartInvalidateCaches(part);
+    FCELIB_UTIL_Free(part);
     mesh->parts[ mesh->hdr.Parts[internal_pid] ] = NULL;
     mesh->hdr.Parts[internal_pid] = -1;
 
@@ -358,17 +965,21 @@ void FCELIB_OP_DeletePart(FcelibMesh *mesh, int pid)
   }  /* for (;;) */
 }
 
-/* Delete part triangles by order. */
-int FCELIB_OP_DeletePartTriags(FcelibMesh *mesh, const int pid, const int *idxs, int idxs_len)
+/*
+  Delete triangles from any number of parts by order, in a single pass.
+  Triangle i is given by part pids[i] and triangle idxs[i] within that part.
+  Duplicates are allowed. Nothing is deleted if any index is out of range.
+*/
+int FCELIB_OP_DeleteTriags(FcelibMesh *mesh, const int *pids, const int *idxs, int idxs_len)
 {
   int retv = 0;
   int i;
-  int internal_pid;
+  int j;
+  int n;
+  int order;
+  int *offsets = NULL;  /* first bit of part, by part order */
+  unsigned char *bitmap = NULL;  /* bit per triangle, by part order and triangle order */
   FcelibPart *part;
-  int *ptr;
-  int *sptr;
-  int search_len = idxs_len;
-  int *map = NULL;
 
   for (;;)
   {
@@ -377,342 +988,2769 @@ int FCELIB_OP_DeletePartTriags(FcelibMesh *mesh, const int pid, const int *idxs,
       retv = 1;
       break;
     }
-    if (!idxs)
+    if (!pids || !idxs)
     {
-      fprintf(stderr, "DeletePartTriags: Unexpected NULL (idxs)\n");
+      fprintf(stderr, "DeleteTriags: Unexpected NULL (pids, idxs)\n");
       break;
     }
 
-    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
-    if (internal_pid < 0)
+    offsets = (int *)FCELIB_UTIL_Malloc((mesh->hdr.NumParts + 1) * sizeof(*offsets));
+    if (!offsets)
     {
-      fprintf(stderr, "DeletePartTriags: Invalid index (internal_pid)\n");
+      fprintf(stderr, "DeleteTriags: Cannot allocate memory (offsets)\n");
       break;
     }
-    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    offsets[0] = 0;
+    for (i = 0, order = 0; i < mesh->parts_len && order < mesh->hdr.NumParts; ++i)
+    {
+      if (mesh->hdr.Parts[i] < 0)
+        continue;
+      offsets[order + 1] = offsets[order] + mesh->parts[ mesh->hdr.Parts[i] ]->PNumTriangles;
+      ++order;
+    }
 
-    map = (int *)malloc(idxs_len * sizeof(*map));
-    if (!map)
+    n = SCL_ceil(offsets[mesh->hdr.NumParts], 8);
+    bitmap = (unsigned char *)FCELIB_UTIL_Malloc((n + 1) * sizeof(*bitmap));
+    if (!bitmap)
     {
-      fprintf(stderr, "DeletePartTriags: Cannot allocate memory (map)\n");
+      fprintf(stderr, "DeleteTriags: Cannot allocate memory (bitmap)\n");
       break;
     }
+    memset(bitmap, 0, (n + 1) * sizeof(*bitmap));
 
-    memcpy(map, idxs, idxs_len * sizeof(*map));
-    qsort(map, idxs_len, sizeof(*map), FCELIB_UTIL_CompareInts);
-    if (map[0] < 0 || map[idxs_len - 1] > part->PNumTriangles)
+    for (i = 0; i < idxs_len; ++i)
     {
-      fprintf(stderr, "DeletePartTriags: Triangle index out of range (idxs)\n");
-      break;
+      if (pids[i] < 0 || pids[i] >= mesh->hdr.NumParts)
+      {
+        fprintf(stderr, "DeleteTriags: Invalid index (pids[%d] = %d)\n", i, pids[i]);
+        break;
+      }
+      if (idxs[i] < 0 || idxs[i] >= offsets[pids[i] + 1] - offsets[pids[i]])
+      {
+        fprintf(stderr, "DeleteTriags: Triangle index out of range (idxs[%d] = %d)\n", i, idxs[i]);
+        break;
+      }
+      n = offsets[pids[i]] + idxs[i];
+      bitmap[n >> 3] |= (unsigned char)(1 << (n & 7));
     }
+    if (i < idxs_len)
+      break;
 
-    ptr = NULL;
-    sptr = map;
-    for (i = 0; i < part->ptriangles_len && search_len > 0; ++i)
+    for (i = 0, order = 0; i < mesh->parts_len && order < mesh->hdr.NumParts; ++i)
     {
-      if (part->PTriangles[i] < 0)
+      if (mesh->hdr.Parts[i] < 0)
         continue;
-      ptr = (int *)bsearch(&i, sptr, search_len, sizeof(*map), FCELIB_UTIL_CompareInts);
-      if (!ptr)
-        continue;
-      free(mesh->triangles[ part->PTriangles[i] ]);
-      mesh->triangles[ part->PTriangles[i] ] = NULL;
-      part->PTriangles[i] = -1;
+      part = mesh->parts[ mesh->hdr.Parts[i] ];
+      n = offsets[order];
+      ++order;
 
-      ++sptr;
-      --search_len;
-      ptr = NULL;
-    }
-    part->PNumTriangles -= idxs_len;
-    mesh->hdr.NumTriangles -= idxs_len;
-    free(map);
+      for (j = 0; j < part->ptriangles_len && n < offsets[order]; ++j)
+      {
+        if (part->PTriangles[j] < 0)
+          continue;
+        if (bitmap[n >> 3] & (1 << (n & 7)))
+        {
+          FCELIB_TYPES_PartInvalidateCaches(part);
+          FCELIB_UTIL_Free(mesh->triangles[ part->PTriangles[j] ]);
+          mesh->triangles[ part->PTriangles[j] ] = NULL;
+          part->PTriangles[j] = -1;
+          --part->PNumTriangles;
+          --mesh->hdr.NumTriangles;
+        }
+        ++n;
+      }  /* for j */
+    }  /* for i */
 
     retv = 1;
     break;
   }  /* for (;;) */
 
+  FCELIB_UTIL_Free(offsets);
+  FCELIB_UTIL_Free(bitmap);
+
   return retv;
 }
 
-/* Deletes vertices that are not referenced by any triangles. */
-int FCELIB_OP_DeleteUnrefdVerts(FcelibMesh *mesh)
+/* Delete part triangles by order. See FCELIB_OP_DeleteTriags() */
+int FCELIB_OP_DeletePartTriags(FcelibMesh *mesh, const int pid, const int *idxs, int idxs_len)
 {
+  int retv;
   int i;
-  int j;
-  int k;
-  FcelibPart *part;
-  int *map;
+  int *pids;
 
-  map = (int *)malloc(mesh->vertices_len * sizeof(*map));
-  if (!map)
+  if (idxs_len < 1)
+    return 1;
+
+  pids = (int *)FCELIB_UTIL_Malloc(idxs_len * sizeof(*pids));
+  if (!pids)
   {
-    fprintf(stderr, "DeleteUnrefdVerts: Cannot allocate memory (map)\n");
+    fprintf(stderr, "DeletePartTriags: Cannot allocate memory (pids)\n");
     return 0;
   }
-  memset(map, 0, mesh->vertices_len * sizeof(*map));
+  for (i = 0; i < idxs_len; ++i)
+    pids[i] = pid;
 
-  for (i = 0; i < mesh->parts_len; ++i)
-  {
-    if (mesh->hdr.Parts[i] < 0)
-      continue;
-    part = mesh->parts[ mesh->hdr.Parts[i] ];
+  retv = FCELIB_OP_DeleteTriags(mesh, pids, idxs, idxs_len);
+  FCELIB_UTIL_Free(pids);
 
-    /* Mark referenced verts */
-    for (j = 0; j < part->ptriangles_len; ++j)
-    {
-      if (part->PTriangles[j] < 0)
-        continue;
-
-      for (k = 0; k < 3; ++k)
-        map[ mesh->triangles[ part->PTriangles[j] ]->vidx[k] ] = 1;
-    }
+  return retv;
+}
 
-    /* Delete existing, unreferenced verts */
-    for (j = 0; j < part->pvertices_len; ++j)
-    {
-      if (part->PVertices[j] < 0 || map[ part->PVertices[j] ] == 1)
-        continue;
-      free(mesh->vertices[ part->PVertices[j] ]);
-      mesh->vertices[ part->PVertices[j] ] = NULL;
-      part->PVertices[j] = -1;
-      --part->PNumVertices;
-      --mesh->hdr.NumVertices;
-    }
-  }
+/* Sort keys for FCELIB_OP_SortPartTriags() */
+#define FCELIB_OP_SORTKEY_FLAG_MASK 0  /* (flag & mask) != 0 goes last */
+#define FCELIB_OP_SORTKEY_FLAG      1  /* flag & mask, ascending */
+#define FCELIB_OP_SORTKEY_TEXPAGE   2  /* tex_page, ascending */
 
-  free(map);
-  return 1;
+/* Compares {key, tidx, seq} triplets by key, then by seq (i.e., stable) */
+int __FCELIB_OP_CompareSortKeys(const void *a, const void *b)
+{
+  const int *arg1 = (const int *)a;
+  const int *arg2 = (const int *)b;
+  if (arg1[0] != arg2[0])
+    return (arg1[0] > arg2[0]) - (arg1[0] < arg2[0]);
+  return (arg1[2] > arg2[2]) - (arg1[2] < arg2[2]);
 }
 
-/* Returns new part index (order) on success, -1 on failure. */
-int FCELIB_OP_MergePartsToNew(FcelibMesh *mesh, int pid1, int pid2)
+/*
+  Stable sort of part triangles by key (see FCELIB_OP_SORTKEY_*). Permutes
+  PTriangles in place; vertices and triangle data are unchanged.
+  Returns bool.
+*/
+int FCELIB_OP_SortPartTriags(FcelibMesh *mesh, const int pid, const int key, const int mask)
 {
-  int pid_new = -1;
-  int internal_pid_new = -1;
-  int internal_pid1;
-  int internal_pid2;
-  int i;
+  int internal_pid;
   int j;
   int n;
-  int vidx_1st;
-  int tidx_1st;
-  int *old_global_to_new_global_idxs = NULL;  /* maps vert ref's in copied triags */
-  FcelibPart *part_new;
-  FcelibPart *part_src1;
-  FcelibPart *part_src2;
+  int *items;  /* {key, tidx, seq} */
+  FcelibPart *part;
+  const FcelibTriangle *triag;
 
-  if (pid1 == pid2)
+  internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+  if (internal_pid < 0)
   {
-    fprintf(stderr, "MergePartsToNew: Cannot merge part with itself\n");
-    return -1;
+    fprintf(stderr, "SortPartTriags: Invalid index (internal_pid)\n");
+    return 0;
   }
-
-  internal_pid1 = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid1);
-  internal_pid2 = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid2);
-  if (internal_pid1 < 0)
+  if (key < FCELIB_OP_SORTKEY_FLAG_MASK || key > FCELIB_OP_SORTKEY_TEXPAGE)
   {
-    fprintf(stderr, "MergePartsToNew: Invalid index (internal_pid1)\n");
-    return -1;
+    fprintf(stderr, "SortPartTriags: Invalid key %d\n", key);
+    return 0;
   }
-  if (internal_pid2 < 0)
+  part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+  if (part->PNumTriangles < 2)
+    return 1;
+  FCELIB_TYPES_PartInvalidateCaches(part);
+
+  items = (int *)FCELIB_UTIL_Malloc(3 * part->PNumTriangles * sizeof(*items));
+  if (!items)
   {
-    fprintf(stderr, "MergePartsToNew: Invalid index (internal_pid2)\n");
-    return -1;
+    fprintf(stderr, "SortPartTriags: Cannot allocate memory\n");
+    return 0;
   }
-  part_src1 = mesh->parts[mesh->hdr.Parts[internal_pid1]];
-  part_src2 = mesh->parts[mesh->hdr.Parts[internal_pid2]];
 
-  for (;;)
+  for (j = 0, n = 0; j < part->ptriangles_len && n < part->PNumTriangles; ++j)
   {
-    if (mesh->hdr.Parts[mesh->parts_len - 1] >= 0)
+    if (part->PTriangles[j] < 0)
+      continue;
+    triag = mesh->triangles[ part->PTriangles[j] ];
+    switch (key)
     {
-      if (!FCELIB_TYPES_AddParts(mesh, 1))
-      {
-        internal_pid_new = -1;
-        break;
-      }
+      case FCELIB_OP_SORTKEY_FLAG_MASK: items[3 * n] = (triag->flag & mask) != 0; break;
+      case FCELIB_OP_SORTKEY_FLAG: items[3 * n] = triag->flag & mask; break;
+      default: items[3 * n] = triag->tex_page; break;
     }
+    items[3 * n + 1] = part->PTriangles[j];
+    items[3 * n + 2] = n;
+    ++n;
+  }
 
-    /* Get first unused index */
-    internal_pid_new = FCELIB_TYPES_GetFirstUnusedGlobalPartIdx(mesh);
-    vidx_1st = FCELIB_TYPES_GetFirstUnusedGlobalVertexIdx(mesh);
-    tidx_1st = FCELIB_TYPES_GetFirstUnusedGlobalTriangleIdx(mesh);
+  qsort(items, n, 3 * sizeof(*items), __FCELIB_OP_CompareSortKeys);
+
+  /* Live entries keep their positions in PTriangles, only their values move */
+  for (j = 0, n = 0; j < part->ptriangles_len && n < part->PNumTriangles; ++j)
+  {
+    if (part->PTriangles[j] < 0)
+      continue;
+    part->PTriangles[j] = items[3 * n + 1];
+    ++n;
+  }
+
+  FCELIB_UTIL_Free(items);
+  return 1;
+}
 
+/* Vertex cache optimization, see FCELIB_OP_OptimizeVertexCache() */
+#define FCELIB_OP_VCACHE_SIZE 32
 
-    /* Add part */
-    mesh->hdr.Parts[internal_pid_new] = FCELIB_UTIL_ArrMax(mesh->hdr.Parts, mesh->parts_len) + 1;
-    part_new = (FcelibPart *)malloc(sizeof(*part_new));
-    if (!part_new)
+/* Forsyth vertex score. cache_pos: -1 if not in cache. */
+float __FCELIB_OP_VCacheScore(const int cache_pos, const int remaining)
+{
+  float score = 0.0f;
+  float t;
+  if (remaining < 1)
+    return -1.0f;
+  if (cache_pos >= 0)
+  {
+    if (cache_pos < 3)
+      score = 0.75f;  /* last triangle's verts, no bonus for any particular order */
+    else
     {
-      fprintf(stderr, "MergePartsToNew: Cannot allocate memory (part)\n");
-      internal_pid_new = -1;
-      break;
+      t = 1.0f - (float)(cache_pos - 3) / (FCELIB_OP_VCACHE_SIZE - 3);
+      score = t * (float)FCELIB_UTIL_Sqrt(t);  /* t^1.5 */
     }
-    memset(part_new, 0, sizeof(*part_new));
-    part_new->pvertices_len = 0;
-    part_new->ptriangles_len = 0;
+  }
+  return score + 2.0f / (float)FCELIB_UTIL_Sqrt(remaining);  /* valence boost */
+}
 
-    mesh->parts[ mesh->hdr.Parts[internal_pid_new] ] = part_new;
+/*
+  Reorders part triangles for post-transform vertex cache hits, after
+  Forsyth, "Linear-Speed Vertex Cache Optimisation" (2006). A vertex scores by
+  its position in a simulated LRU cache and by its number of remaining
+  triangles; the triangle with the highest sum of vertex scores among
+  triangles of cached vertices is drawn next.
 
-    sprintf(part_new->PartName, "%d_%d", internal_pid1, internal_pid2);
-    part_new->PartPos.x = 0.0f;
-    part_new->PartPos.y = 0.0f;
-    part_new->PartPos.z = 0.0f;
+  Semi-transparent (flag 0x8) triangles are not reordered: they keep their
+  positions in PTriangles, as draw order matters for them. Other triangles
+  are reordered among the remaining positions.
 
-    part_new->PNumTriangles = part_src1->PNumTriangles + part_src2->PNumTriangles;
-    part_new->PNumVertices = part_src1->PNumVertices + part_src2->PNumVertices;
+  If reorder_verts, PVertices are reordered by first use in the new
+  triangle order; unreferenced verts go last, in their previous order.
 
-    ++mesh->hdr.NumParts;
+  Returns bool.
+*/
+int FCELIB_OP_OptimizeVertexCache(FcelibMesh *mesh, const int pid, const int reorder_verts)
+{
+  int retv = 0;
+  int internal_pid;
+  int i;
+  int j;
+  int k;
+  int n;
+  int nt;  /* reordered triags */
+  int nv;
+  int best;
+  int cursor = 0;
+  int cache_len = 0;
+  int new_cache_len;
+  int cache[FCELIB_OP_VCACHE_SIZE + 3];
+  int new_cache[FCELIB_OP_VCACHE_SIZE + 3];
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  int *tri = NULL;  /* per triag: local vert idxs */
+  int *tidx = NULL;  /* per triag: global triag idx */
+  int *offsets = NULL;  /* per local vert: first entry in adj, nv + 1 entries */
+  int *remaining = NULL;  /* per local vert: number of triags not yet drawn */
+  int *adj = NULL;  /* triags by vert; first remaining[v] entries are not yet drawn */
+  int *cache_pos = NULL;
+  int *order = NULL;
+  float *vscore = NULL;
+  float *tscore = NULL;
+  unsigned char *drawn = NULL;
+  FcelibPart *part;
+  const FcelibTriangle *triag;
 
-#if SCL_DEBUG >= 1
-    printf("triangles %d + %d = %d\n", part_src1->PNumTriangles, part_src2->PNumTriangles, part_new->PNumTriangles);
-    printf("vertices %d + %d = %d\n", part_src1->PNumVertices, part_src2->PNumVertices, part_new->PNumVertices);
-#endif
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "OptimizeVertexCache: Invalid index (internal_pid)\n");
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    nv = part->PNumVertices;
 
-    /* Copy vertices */
-    if (!FCELIB_TYPES_AddVerticesToPart(part_new, part_new->PNumVertices))
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    tri = (int *)FCELIB_UTIL_Malloc((3 * part->PNumTriangles + 1) * sizeof(*tri));
+    tidx = (int *)FCELIB_UTIL_Malloc((part->PNumTriangles + 1) * sizeof(*tidx));
+    offsets = (int *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*offsets));
+    remaining = (int *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*remaining));
+    adj = (int *)FCELIB_UTIL_Malloc((3 * part->PNumTriangles + 1) * sizeof(*adj));
+    cache_pos = (int *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*cache_pos));
+    order = (int *)FCELIB_UTIL_Malloc((part->PNumTriangles + 1) * sizeof(*order));
+    vscore = (float *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*vscore));
+    tscore = (float *)FCELIB_UTIL_Malloc((part->PNumTriangles + 1) * sizeof(*tscore));
+    drawn = (unsigned char *)FCELIB_UTIL_Malloc((part->PNumTriangles + 1) * sizeof(*drawn));
+    if (!tri || !tidx || !offsets || !remaining || !adj || !cache_pos || !order || !vscore || !tscore || !drawn)
     {
-      internal_pid_new = -1;
+      fprintf(stderr, "OptimizeVertexCache: Cannot allocate memory\n");
       break;
     }
+    memset(remaining, 0, (nv + 1) * sizeof(*remaining));
+    memset(cache_pos, 0xFF, (nv + 1) * sizeof(*cache_pos));
+    memset(drawn, 0, (part->PNumTriangles + 1) * sizeof(*drawn));
 
-    if (mesh->vertices_len < vidx_1st + part_new->PNumVertices)
+    /* Collect opaque triangles */
+    for (j = 0, nt = 0; j < part->ptriangles_len; ++j)
     {
-      if (!FCELIB_TYPES_AddVerticesToMesh(mesh, vidx_1st + part_new->PNumVertices - mesh->vertices_len))
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      if (triag->flag & 0x8)
+        continue;
+      for (k = 0; k < 3; ++k)
       {
-        internal_pid_new = -1;
+        tri[3 * nt + k] = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (tri[3 * nt + k] < 0)
+          break;
+        ++remaining[ tri[3 * nt + k] ];
+      }
+      if (k < 3)
+      {
+        fprintf(stderr, "OptimizeVertexCache: Triangle references vertex outside part\n");
         break;
       }
+      tidx[nt++] = part->PTriangles[j];
     }
-    mesh->hdr.NumVertices += part_new->PNumVertices;
+    if (j < part->ptriangles_len)
+      break;
 
-    old_global_to_new_global_idxs = (int *)malloc(mesh->vertices_len * sizeof(*old_global_to_new_global_idxs));
-    if (!old_global_to_new_global_idxs)
+    /* Triangles by vertex */
+    offsets[0] = 0;
+    for (i = 0; i < nv; ++i)
+      offsets[i + 1] = offsets[i] + remaining[i];
+    memset(remaining, 0, (nv + 1) * sizeof(*remaining));
+    for (i = 0; i < nt; ++i)
     {
-      fprintf(stderr, "MergePartsToNew: Cannot allocate memory (map)\n");
-      internal_pid_new = -1;
-      break;
+      for (k = 0; k < 3; ++k)
+      {
+        n = tri[3 * i + k];
+        adj[offsets[n] + remaining[n]++] = i;
+      }
     }
-    memset(old_global_to_new_global_idxs, 0xFF, mesh->vertices_len * sizeof(*old_global_to_new_global_idxs));
 
-    /* i - vert index in source, j - vert index in receiver */
-    for (i = 0, j = 0; i < part_src1->pvertices_len && j < part_src1->PNumVertices; ++i)
+    for (i = 0; i < nv; ++i)
+      vscore[i] = __FCELIB_OP_VCacheScore(-1, remaining[i]);
+    for (i = 0; i < nt; ++i)
+      tscore[i] = vscore[ tri[3 * i] ] + vscore[ tri[3 * i + 1] ] + vscore[ tri[3 * i + 2] ];
+
+    best = nt > 0 ? 0 : -1;
+    for (n = 0; n < nt; ++n)
     {
-      if (part_src1->PVertices[i] < 0)
-        continue;
+      /* No candidate from cache: next undrawn triangle in previous order */
+      if (best < 0)
+      {
+        while (drawn[cursor])
+          ++cursor;
+        best = cursor;
+      }
+      order[n] = best;
+      drawn[best] = 1;
 
-      mesh->vertices[vidx_1st + j] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
-      if (!mesh->vertices[vidx_1st + j])
+      /* Remove from vert adjacency, update cache */
+      new_cache_len = 0;
+      for (k = 0; k < 3; ++k)
       {
-        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (vert1)\n");
-        internal_pid_new = -1;
-        break;
+        const int v = tri[3 * best + k];
+        for (i = offsets[v]; adj[i] != best; ++i)
+          continue;
+        adj[i] = adj[offsets[v] + remaining[v] - 1];
+        adj[offsets[v] + remaining[v] - 1] = best;
+        --remaining[v];
+        new_cache[new_cache_len++] = v;
+      }
+      for (i = 0; i < cache_len; ++i)
+      {
+        const int v = cache[i];
+        if (v == tri[3 * best] || v == tri[3 * best + 1] || v == tri[3 * best + 2])
+          continue;
+        new_cache[new_cache_len++] = v;
+      }
+      cache_len = SCL_min(new_cache_len, FCELIB_OP_VCACHE_SIZE);
+      for (i = 0; i < new_cache_len; ++i)
+      {
+        const int v = new_cache[i];
+        cache_pos[v] = i < cache_len ? i : -1;
+        vscore[v] = __FCELIB_OP_VCacheScore(cache_pos[v], remaining[v]);
+        if (i < cache_len)
+          cache[i] = v;
       }
-      part_new->PVertices[j] = vidx_1st + j;
-      FCELIB_TYPES_CpyVert(mesh->vertices[vidx_1st + j], mesh->vertices[ part_src1->PVertices[i] ]);
-      FCELIB_TYPES_VertAddPosition(mesh->vertices[vidx_1st + j], &part_src1->PartPos);
-      old_global_to_new_global_idxs[part_src1->PVertices[i]] = vidx_1st + j;
 
-      ++j;
+      /* Rescore undrawn triangles of affected verts, pick best */
+      best = -1;
+      for (i = 0; i < new_cache_len; ++i)
+      {
+        const int v = new_cache[i];
+        for (j = offsets[v]; j < offsets[v] + remaining[v]; ++j)
+        {
+          const int t = adj[j];
+          tscore[t] = vscore[ tri[3 * t] ] + vscore[ tri[3 * t + 1] ] + vscore[ tri[3 * t + 2] ];
+          if (best < 0 || tscore[t] > tscore[best])
+            best = t;
+        }
+      }
     }
-    if (internal_pid_new < 0)
-      break;
 
-    for (i = 0; i < part_src2->pvertices_len && j < part_src1->PNumVertices + part_src2->PNumVertices; ++i)
+    FCELIB_TYPES_PartInvalidateCaches(part);
+
+    /* Write opaque triangles to their previous positions, in new order */
+    for (j = 0, n = 0; j < part->ptriangles_len && n < nt; ++j)
     {
-      if (part_src2->PVertices[i] < 0)
+      if (part->PTriangles[j] < 0 || (mesh->triangles[ part->PTriangles[j] ]->flag & 0x8))
         continue;
+      part->PTriangles[j] = tidx[ order[n++] ];
+    }
 
-      mesh->vertices[vidx_1st + j] = (FcelibVertex *)malloc(sizeof(**mesh->vertices));
-      if (!mesh->vertices[vidx_1st + j])
+    if (reorder_verts && nv > 0)
+    {
+      /* order: local vert idxs by first use; remaining: 1 if used */
+      memset(remaining, 0, (nv + 1) * sizeof(*remaining));
+      for (j = 0, n = 0; j < part->ptriangles_len; ++j)
       {
-        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (vert2)\n");
-        internal_pid_new = -1;
-        break;
+        if (part->PTriangles[j] < 0)
+          continue;
+        triag = mesh->triangles[ part->PTriangles[j] ];
+        for (k = 0; k < 3; ++k)
+        {
+          i = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+          if (i < 0)
+            continue;
+          if (!remaining[i])
+          {
+            remaining[i] = 1;
+            offsets[n++] = i;
+          }
+        }
+      }
+      for (i = 0; i < nv; ++i)
+      {
+        if (!remaining[i])
+          offsets[n++] = i;
       }
-      part_new->PVertices[j] = vidx_1st + j;
-      FCELIB_TYPES_CpyVert(mesh->vertices[vidx_1st + j], mesh->vertices[ part_src2->PVertices[i] ]);
-      FCELIB_TYPES_VertAddPosition(mesh->vertices[vidx_1st + j], &part_src2->PartPos);
-      old_global_to_new_global_idxs[ part_src2->PVertices[i] ] = vidx_1st + j;
 
-      ++j;
+      /* Local to global */
+      for (j = 0, i = 0; j < part->pvertices_len && i < nv; ++j)
+      {
+        if (part->PVertices[j] < 0)
+          continue;
+        cache_pos[i++] = part->PVertices[j];
+      }
+
+      /* Live entries keep their positions in PVertices, only their values move */
+      for (j = 0, i = 0; j < part->pvertices_len && i < nv; ++j)
+      {
+        if (part->PVertices[j] < 0)
+          continue;
+        part->PVertices[j] = cache_pos[ offsets[i++] ];
+      }
     }
-    if (internal_pid_new < 0)
-      break;
 
-    /* Copy triangles */
-    if (!FCELIB_TYPES_AddTrianglesToPart(part_new, part_new->PNumTriangles))
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(tri);
+  FCELIB_UTIL_Free(tidx);
+  FCELIB_UTIL_Free(offsets);
+  FCELIB_UTIL_Free(remaining);
+  FCELIB_UTIL_Free(adj);
+  FCELIB_UTIL_Free(cache_pos);
+  FCELIB_UTIL_Free(order);
+  FCELIB_UTIL_Free(vscore);
+  FCELIB_UTIL_Free(tscore);
+  FCELIB_UTIL_Free(drawn);
+
+  return retv;
+}
+
+/*
+  Deletes part vertices that are not referenced by any part triangle, in
+  O(part vertices + part triangles). Verts are marked by vert order in part,
+  see FCELIB_TYPES_VertMapInit().
+
+  If compact, moves unused (-1) entries of PVertices and PTriangles to the
+  end in the same pass. Order is kept, capacities are unchanged.
+*/
+int __FCELIB_OP_DeletePartUnrefdVerts(FcelibMesh *mesh, FcelibPart *part, const int compact)
+{
+  int retv = 0;
+  int j;
+  int k;
+  int n;
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  unsigned char *used = NULL;  /* per local vert: referenced by part triangle */
+  const FcelibTriangle *triag;
+
+  for (;;)
+  {
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    used = (unsigned char *)FCELIB_UTIL_Malloc((SCL_max(0, part->PNumVertices) + 1) * sizeof(*used));
+    if (!used)
     {
-      internal_pid_new = -1;
+      fprintf(stderr, "DeleteUnrefdVerts: Cannot allocate memory (used)\n");
       break;
     }
+    memset(used, 0, (SCL_max(0, part->PNumVertices) + 1) * sizeof(*used));
 
-    if (mesh->triangles_len < tidx_1st + part_new->PNumTriangles)
+    /* Mark referenced verts */
+    for (j = 0, n = 0; j < part->ptriangles_len; ++j)
     {
-      if (!FCELIB_TYPES_AddTrianglesToMesh(mesh, tidx_1st + part_new->PNumTriangles - mesh->triangles_len))
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
       {
-        internal_pid_new = -1;
-        break;
+        const int v = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (v >= 0)
+          used[v] = 1;
       }
+      if (compact)
+        part->PTriangles[n++] = part->PTriangles[j];
     }
-    mesh->hdr.NumTriangles += part_new->PNumTriangles;
+    if (compact && n < part->ptriangles_len)
+      memset(part->PTriangles + n, 0xFF, (part->ptriangles_len - n) * sizeof(*part->PTriangles));
 
-    for (i = 0, j = 0; i < part_src1->ptriangles_len && j < part_src1->PNumTriangles; ++i)
+    /* Delete existing, unreferenced verts */
+    for (j = 0, n = 0; j < part->pvertices_len; ++j)
     {
-      if (part_src1->PTriangles[i] < 0)
+      const int v = FCELIB_TYPES_VertMapGet(&g2l, part->PVertices[j]);
+      k = part->PVertices[j];
+      if (k < 0)
         continue;
-      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
-      if (!mesh->triangles[tidx_1st + j])
+      if (v < 0 || used[v])
       {
-        /* fatal error? */
-        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (triag1)\n");
-        internal_pid_new = -1;
-        break;
+        if (compact)
+          part->PVertices[n++] = k;
+        continue;
       }
-      part_new->PTriangles[j] = tidx_1st + j;
-      FCELIB_TYPES_CpyTriag(mesh->triangles[tidx_1st + j], mesh->triangles[ part_src1->PTriangles[i] ]);
+      FCELIB_TYPES_PartInvalidateCaches(part);
+      FCELIB_UTIL_Free(mesh->vertices[k]);
+      mesh->vertices[k] = NULL;
+      part->PVertices[j] = -1;
+      --part->PNumVertices;
+      --mesh->hdr.NumVertices;
+    }
+    if (compact && n < part->pvertices_len)
+      memset(part->PVertices + n, 0xFF, (part->pvertices_len - n) * sizeof(*part->PVertices));
 
-      for (n = 0; n < 3; ++n)
-        mesh->triangles[tidx_1st + j]->vidx[n] = old_global_to_new_global_idxs[mesh->triangles[tidx_1st + j]->vidx[n]];
+    retv = 1;
+    break;
+  }  /* for (;;) */
 
-      ++j;
-    }
-    if (internal_pid_new < 0)
-      break;
-    for (i = 0; i < part_src2->ptriangles_len && j < part_src1->PNumTriangles + part_src2->PNumTriangles; ++i)
-    {
-      if (part_src2->PTriangles[i] < 0)
-        continue;
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(used);
 
-      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)malloc(sizeof(**mesh->triangles));
-      if (!mesh->triangles[tidx_1st + j])
-      {
-        /* fatal error */
-        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (triag2)\n");
-        internal_pid_new = -1;
+  return retv;
+}
+
+/*
+  Deletes vertices that are not referenced by any triangles. If compact,
+  also moves unused part index entries to the end, see
+  FCELIB_OP_DeletePartUnrefdVerts().
+*/
+int FCELIB_OP_DeleteUnrefdVerts(FcelibMesh *mesh, const int compact)
+{
+  int i;
+
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+    if (!__FCELIB_OP_DeletePartUnrefdVerts(mesh, mesh->parts[ mesh->hdr.Parts[i] ], compact))
+      return 0;
+  }
+
+  return 1;
+}
+
+/*
+  Deletes part vertices that are not referenced by any part triangles.
+  If compact, also moves unused part index entries to the end.
+*/
+int FCELIB_OP_DeletePartUnrefdVerts(FcelibMesh *mesh, const int pid, const int compact)
+{
+  const int internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+  if (internal_pid < 0)
+  {
+    fprintf(stderr, "DeletePartUnrefdVerts: Invalid index (internal_pid)\n");
+    return 0;
+  }
+  return __FCELIB_OP_DeletePartUnrefdVerts(mesh, mesh->parts[ mesh->hdr.Parts[internal_pid] ], compact);
+}
+
+/* Returns floor(x * inv_cell), clamped to a range safe for hashing. */
+long __FCELIB_OP_GridCell(const float x, const float inv_cell)
+{
+  double t = (double)x * inv_cell;
+  long c;
+  t = SCL_clamp(t, -1.0e9, 1.0e9);
+  c = (long)t;
+  if (t < (double)c)
+    --c;
+  return c;
+}
+
+unsigned long __FCELIB_OP_GridHash(const long cx, const long cy, const long cz)
+{
+  return ((unsigned long)cx * 73856093UL) ^ ((unsigned long)cy * 19349663UL) ^ ((unsigned long)cz * 83492791UL);
+}
+
+/* Returns 1 if squared distance of a and b is <= eps2 */
+int __FCELIB_OP_VecNear(const tVector *a, const tVector *b, const float eps2)
+{
+  const float dx = a->x - b->x;
+  const float dy = a->y - b->y;
+  const float dz = a->z - b->z;
+  return dx * dx + dy * dy + dz * dz <= eps2;
+}
+
+/*
+  Merge part vertices whose positions are within epsilon (Euclidean), in
+  expected O(part vertices + part triangles). Vertices are binned into a
+  uniform grid of cell size epsilon, stored in a hash table; each vertex is
+  compared to the kept vertices in its own and the 26 adjacent cells. The
+  first vertex in part order is kept.
+
+  compare_normals: normals must be within epsilon, too.
+  compare_damage: damaged positions and normals must be within epsilon, too.
+  Animation flags must always match. Triangles are re-referenced, merged
+  vertices are deleted. Texture coordinates are stored per triangle and kept.
+
+  Returns number of deleted vertices, -1 on failure.
+*/
+int FCELIB_OP_WeldVertices(FcelibMesh *mesh, const int pid, const float epsilon,
+                           const int compare_normals, const int compare_damage)
+{
+  int retv = -1;
+  int internal_pid;
+  int j;
+  int k;
+  int n = 0;
+  int num_buckets = 1;
+  int *verts = NULL;    /* global vert idxs of part, in order */
+  int *heads = NULL;    /* hash table: first kept vert, by bucket */
+  int *next = NULL;     /* chained kept verts, by local idx */
+  int *kept = NULL;     /* per local vert: local idx of kept vert */
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  long *cells = NULL;   /* grid cell of each vert, xyz */
+  const float eps = SCL_max(epsilon, 0.0f);
+  const float eps2 = eps * eps;
+  const float inv_cell = eps > 1e-6f ? 1.0f / eps : 1e6f;
+  FcelibPart *part;
+  FcelibTriangle *triag;
+  FcelibVertex *vert;
+  FcelibVertex *vert_kept;
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "WeldVertices: Invalid index (internal_pid)\n");
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    if (part->PNumVertices < 2)
+    {
+      retv = 0;
+      break;
+    }
+
+    while (num_buckets < 2 * part->PNumVertices)
+      num_buckets <<= 1;
+
+    verts = (int *)FCELIB_UTIL_Malloc(part->PNumVertices * sizeof(*verts));
+    heads = (int *)FCELIB_UTIL_Malloc(num_buckets * sizeof(*heads));
+    next = (int *)FCELIB_UTIL_Malloc(part->PNumVertices * sizeof(*next));
+    kept = (int *)FCELIB_UTIL_Malloc(part->PNumVertices * sizeof(*kept));
+    cells = (long *)FCELIB_UTIL_Malloc(3 * part->PNumVertices * sizeof(*cells));
+    if (!verts || !heads || !next || !kept || !cells)
+    {
+      fprintf(stderr, "WeldVertices: Cannot allocate memory\n");
+      break;
+    }
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    memset(heads, 0xFF, num_buckets * sizeof(*heads));
+
+    for (j = 0; j < part->pvertices_len && n < part->PNumVertices; ++j)
+    {
+      int cx;
+      int cy;
+      int cz;
+      int found = -1;
+
+      if (part->PVertices[j] < 0)
+        continue;
+      vert = mesh->vertices[ part->PVertices[j] ];
+      verts[n] = part->PVertices[j];
+      cells[3 * n + 0] = __FCELIB_OP_GridCell(vert->VertPos.x, inv_cell);
+      cells[3 * n + 1] = __FCELIB_OP_GridCell(vert->VertPos.y, inv_cell);
+      cells[3 * n + 2] = __FCELIB_OP_GridCell(vert->VertPos.z, inv_cell);
+
+      /* Search kept verts in adjacent cells */
+      for (cx = -1; cx <= 1 && found < 0; ++cx)
+      for (cy = -1; cy <= 1 && found < 0; ++cy)
+      for (cz = -1; cz <= 1 && found < 0; ++cz)
+      {
+        long c[3];
+        c[0] = cells[3 * n + 0] + cx;
+        c[1] = cells[3 * n + 1] + cy;
+        c[2] = cells[3 * n + 2] + cz;
+        for (k = heads[ __FCELIB_OP_GridHash(c[0], c[1], c[2]) & (num_buckets - 1) ]; k >= 0; k = next[k])
+        {
+          if (cells[3 * k + 0] != c[0] || cells[3 * k + 1] != c[1] || cells[3 * k + 2] != c[2])
+            continue;
+          vert_kept = mesh->vertices[ verts[k] ];
+          if (vert->Animation != vert_kept->Animation ||
+              !__FCELIB_OP_VecNear(&vert->VertPos, &vert_kept->VertPos, eps2))
+            continue;
+          if (compare_normals && !__FCELIB_OP_VecNear(&vert->NormPos, &vert_kept->NormPos, eps2))
+            continue;
+          if (compare_damage &&
+              (!__FCELIB_OP_VecNear(&vert->DamgdVertPos, &vert_kept->DamgdVertPos, eps2) ||
+               (compare_normals && !__FCELIB_OP_VecNear(&vert->DamgdNormPos, &vert_kept->DamgdNormPos, eps2))))
+            continue;
+          found = k;
+          break;
+        }
+      }
+
+      if (found >= 0)
+      {
+        kept[n] = found;
+      }
+      else
+      {
+        const int bucket = (int)(__FCELIB_OP_GridHash(cells[3 * n + 0], cells[3 * n + 1], cells[3 * n + 2]) & (num_buckets - 1));
+        kept[n] = n;
+        next[n] = heads[bucket];
+        heads[bucket] = n;
+      }
+      ++n;
+    }  /* for j */
+
+    FCELIB_TYPES_PartInvalidateCaches(part);
+
+    /* Re-reference triangles */
+    for (j = 0; j < part->ptriangles_len; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        n = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (n >= 0)
+          triag->vidx[k] = verts[ kept[n] ];
+      }
+    }
+
+    /* Delete merged verts */
+    retv = 0;
+    for (j = 0, n = 0; j < part->pvertices_len; ++j)
+    {
+      k = part->PVertices[j];
+      if (k < 0)
+        continue;
+      ++n;
+      if (kept[n - 1] == n - 1)
+        continue;
+      FCELIB_UTIL_Free(mesh->vertices[k]);
+      mesh->vertices[k] = NULL;
+      part->PVertices[j] = -1;
+      --part->PNumVertices;
+      --mesh->hdr.NumVertices;
+      ++retv;
+    }
+
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(verts);
+  FCELIB_UTIL_Free(heads);
+  FCELIB_UTIL_Free(next);
+  FCELIB_UTIL_Free(kept);
+  FCELIB_UTIL_Free(cells);
+  FCELIB_TYPES_VertMapRelease(&g2l);
+
+  return retv;
+}
+
+/*
+  Appends a copy of part pid, mirrored at the global plane through the origin
+  normal to axis (0: x, 1: y, 2: z), e.g. to make a right-hand part from a
+  left-hand part. Part position, vertices, normals, and damaged positions and
+  normals are mirrored; triangle winding is reversed (see FCELIB_OP_Transform).
+  new_name may be NULL to keep the name of the source part.
+
+  Returns new part index (order) on success, -1 on failure (mesh unchanged).
+*/
+int FCELIB_OP_MirrorPart(FcelibMesh *mesh, const int pid, const int axis, const char *new_name)
+{
+  int pid_new;
+  float matrix[16];
+  FcelibPart *part;
+
+  if (axis < 0 || axis > 2)
+  {
+    fprintf(stderr, "MirrorPart: Invalid axis %d\n", axis);
+    return -1;
+  }
+
+  pid_new = FCELIB_OP_CopyPartToMesh(mesh, mesh, pid);
+  if (pid_new < 0)
+    return -1;
+
+  memset(matrix, 0, sizeof(matrix));
+  matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0f;
+  matrix[5 * axis] = -1.0f;
+  if (!FCELIB_OP_Transform(mesh, matrix, &pid_new, 1, 1, 1))
+  {
+    FCELIB_OP_DeletePart(mesh, pid_new);
+    return -1;
+  }
+
+  if (new_name)
+  {
+    part = mesh->parts[ mesh->hdr.Parts[FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid_new)] ];
+    memset(part->PartName, 0, sizeof(part->PartName));
+    strncpy(part->PartName, new_name, sizeof(part->PartName) - 1);
+  }
+
+  return pid_new;
+}
+
+/*
+  Matches vertices of part pid_a, mirrored at the global plane normal to axis
+  (0: x, 1: y, 2: z), to vertices of part pid_b, by global position within
+  epsilon (Euclidean). Vertices of pid_b are binned into a uniform grid of cell
+  size epsilon, stored in a hash table (see FCELIB_OP_WeldVertices), so that
+  this runs in expected O(part vertices). pid_a and pid_b may be the same
+  part, e.g. to find the symmetry of a body.
+
+  matches must hold PNumVertices of pid_a items. matches[i] is set to the
+  index (order) in pid_b of the nearest vertex within epsilon, -1 if none.
+
+  Returns number of matched vertices, -1 on failure.
+*/
+int FCELIB_OP_FindSymmetry(const FcelibMesh *mesh, const int pid_a, const int pid_b, const int axis,
+                           const float epsilon, int *matches)
+{
+  int retv = -1;
+  int internal_pid_a;
+  int internal_pid_b;
+  int i;
+  int j;
+  int k;
+  int n;
+  int num_buckets = 1;
+  int *heads = NULL;    /* hash table: first vert of pid_b, by bucket */
+  int *next = NULL;     /* chained verts, by order in pid_b */
+  long *cells = NULL;   /* grid cell of each vert of pid_b, xyz */
+  tVector *pos = NULL;  /* global position of each vert of pid_b */
+  const float eps = SCL_max(epsilon, 0.0f);
+  const float eps2 = eps * eps;
+  const float inv_cell = eps > 1e-6f ? 1.0f / eps : 1e6f;
+  const FcelibPart *part_a;
+  const FcelibPart *part_b;
+  const FcelibVertex *vert;
+
+  for (;;)
+  {
+    internal_pid_a = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid_a);
+    internal_pid_b = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid_b);
+    if (internal_pid_a < 0 || internal_pid_b < 0)
+    {
+      fprintf(stderr, "FindSymmetry: Invalid index (internal_pid)\n");
+      break;
+    }
+    if (axis < 0 || axis > 2)
+    {
+      fprintf(stderr, "FindSymmetry: Invalid axis %d\n", axis);
+      break;
+    }
+    part_a = mesh->parts[ mesh->hdr.Parts[internal_pid_a] ];
+    part_b = mesh->parts[ mesh->hdr.Parts[internal_pid_b] ];
+
+    while (num_buckets < 2 * part_b->PNumVertices)
+      num_buckets <<= 1;
+
+    heads = (int *)FCELIB_UTIL_Malloc(num_buckets * sizeof(*heads));
+    next = (int *)FCELIB_UTIL_Malloc((part_b->PNumVertices + 1) * sizeof(*next));
+    cells = (long *)FCELIB_UTIL_Malloc((3 * part_b->PNumVertices + 1) * sizeof(*cells));
+    pos = (tVector *)FCELIB_UTIL_Malloc((part_b->PNumVertices + 1) * sizeof(*pos));
+    if (!heads || !next || !cells || !pos)
+    {
+      fprintf(stderr, "FindSymmetry: Cannot allocate memory\n");
+      break;
+    }
+    memset(heads, 0xFF, num_buckets * sizeof(*heads));
+
+    /* Bin verts of pid_b */
+    for (j = 0, n = 0; j < part_b->pvertices_len && n < part_b->PNumVertices; ++j)
+    {
+      if (part_b->PVertices[j] < 0)
+        continue;
+      vert = mesh->vertices[ part_b->PVertices[j] ];
+      pos[n].x = vert->VertPos.x + part_b->PartPos.x;
+      pos[n].y = vert->VertPos.y + part_b->PartPos.y;
+      pos[n].z = vert->VertPos.z + part_b->PartPos.z;
+      cells[3 * n + 0] = __FCELIB_OP_GridCell(pos[n].x, inv_cell);
+      cells[3 * n + 1] = __FCELIB_OP_GridCell(pos[n].y, inv_cell);
+      cells[3 * n + 2] = __FCELIB_OP_GridCell(pos[n].z, inv_cell);
+      k = (int)(__FCELIB_OP_GridHash(cells[3 * n + 0], cells[3 * n + 1], cells[3 * n + 2]) & (num_buckets - 1));
+      next[n] = heads[k];
+      heads[k] = n;
+      ++n;
+    }
+
+    /* Search mirrored verts of pid_a in adjacent cells */
+    retv = 0;
+    for (j = 0, i = 0; j < part_a->pvertices_len && i < part_a->PNumVertices; ++j)
+    {
+      int cx;
+      int cy;
+      int cz;
+      long c0[3];
+      float p[3];
+      float best = eps2;
+      tVector v;
+
+      if (part_a->PVertices[j] < 0)
+        continue;
+      vert = mesh->vertices[ part_a->PVertices[j] ];
+      p[0] = vert->VertPos.x + part_a->PartPos.x;
+      p[1] = vert->VertPos.y + part_a->PartPos.y;
+      p[2] = vert->VertPos.z + part_a->PartPos.z;
+      p[axis] = -p[axis];
+      v.x = p[0];
+      v.y = p[1];
+      v.z = p[2];
+      for (k = 0; k < 3; ++k)
+        c0[k] = __FCELIB_OP_GridCell(p[k], inv_cell);
+
+      matches[i] = -1;
+      for (cx = -1; cx <= 1; ++cx)
+      for (cy = -1; cy <= 1; ++cy)
+      for (cz = -1; cz <= 1; ++cz)
+      {
+        long c[3];
+        c[0] = c0[0] + cx;
+        c[1] = c0[1] + cy;
+        c[2] = c0[2] + cz;
+        for (k = heads[ __FCELIB_OP_GridHash(c[0], c[1], c[2]) & (num_buckets - 1) ]; k >= 0; k = next[k])
+        {
+          const float dx = pos[k].x - v.x;
+          const float dy = pos[k].y - v.y;
+          const float dz = pos[k].z - v.z;
+          if (cells[3 * k + 0] != c[0] || cells[3 * k + 1] != c[1] || cells[3 * k + 2] != c[2])
+            continue;
+          if (dx * dx + dy * dy + dz * dz > best)
+            continue;
+          if (matches[i] >= 0 && dx * dx + dy * dy + dz * dz == best && k > matches[i])
+            continue;  /* ties: lowest index */
+          best = dx * dx + dy * dy + dz * dz;
+          matches[i] = k;
+        }
+      }
+      retv += matches[i] >= 0;
+      ++i;
+    }  /* for j */
+
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(heads);
+  FCELIB_UTIL_Free(next);
+  FCELIB_UTIL_Free(cells);
+  FCELIB_UTIL_Free(pos);
+
+  return retv;
+}
+
+/* Compares {vert, vert, half-edge} */
+int __FCELIB_OP_CompareHalfEdges(const void *a, const void *b)
+{
+  const int *arg1 = (const int *)a;
+  const int *arg2 = (const int *)b;
+  if (arg1[0] != arg2[0])
+    return (arg1[0] > arg2[0]) - (arg1[0] < arg2[0]);
+  if (arg1[1] != arg2[1])
+    return (arg1[1] > arg2[1]) - (arg1[1] < arg2[1]);
+  return (arg1[2] > arg2[2]) - (arg1[2] < arg2[2]);
+}
+
+/*
+  Returns adjacency of part (see FcelibAdjacency), NULL on failure. Built on
+  first call, in O(part vertices + T log T) for T part triangles, and cached
+  until an op changes part topology. Half-edges are twins if their triangles
+  share the edge's vertices (by index, in either direction) and no other
+  triangle does. The returned pointer is owned by the part.
+*/
+const FcelibAdjacency *FCELIB_OP_GetPartAdjacency(FcelibMesh *mesh, const int pid)
+{
+  int internal_pid;
+  int i;
+  int j;
+  int k;
+  int n;
+  int nt;
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  int *edges = NULL;  /* per half-edge: {vert, vert, half-edge} */
+  FcelibAdjacency *adj = NULL;
+  FcelibPart *part;
+  const FcelibTriangle *triag;
+
+  internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+  if (internal_pid < 0)
+  {
+    fprintf(stderr, "GetPartAdjacency: Invalid index (internal_pid)\n");
+    return NULL;
+  }
+  part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+  if (part->adj)
+    return part->adj;
+
+  for (;;)
+  {
+    nt = part->PNumTriangles;
+
+    adj = (FcelibAdjacency *)FCELIB_UTIL_Malloc(sizeof(*adj));
+    if (!adj)
+    {
+      fprintf(stderr, "GetPartAdjacency: Cannot allocate memory\n");
+      break;
+    }
+    memset(adj, 0, sizeof(*adj));
+    adj->num_vertices = part->PNumVertices;
+    adj->num_triangles = nt;
+
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    edges = (int *)FCELIB_UTIL_Malloc((9 * nt + 1) * sizeof(*edges));
+    adj->vert_offsets = (int *)FCELIB_UTIL_Malloc((part->PNumVertices + 1) * sizeof(*adj->vert_offsets));
+    adj->vert_triags = (int *)FCELIB_UTIL_Malloc((3 * nt + 1) * sizeof(*adj->vert_triags));
+    adj->twins = (int *)FCELIB_UTIL_Malloc((3 * nt + 1) * sizeof(*adj->twins));
+    if (!edges || !adj->vert_offsets || !adj->vert_triags || !adj->twins)
+    {
+      fprintf(stderr, "GetPartAdjacency: Cannot allocate memory\n");
+      break;
+    }
+    memset(adj->vert_offsets, 0, (part->PNumVertices + 1) * sizeof(*adj->vert_offsets));
+
+    /* Half-edges by local vert idxs; count triangles per vert */
+    for (j = 0, i = 0; j < part->ptriangles_len && i < nt; ++j)
+    {
+      int v[3];
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        v[k] = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (v[k] < 0)
+          break;
+      }
+      if (k < 3)
+      {
+        fprintf(stderr, "GetPartAdjacency: Triangle references vertex outside part\n");
+        break;
+      }
+      for (k = 0; k < 3; ++k)
+      {
+        ++adj->vert_offsets[v[k] + 1];
+        edges[9 * i + 3 * k + 0] = SCL_min(v[k], v[(k + 1) % 3]);
+        edges[9 * i + 3 * k + 1] = SCL_max(v[k], v[(k + 1) % 3]);
+        edges[9 * i + 3 * k + 2] = 3 * i + k;
+      }
+      ++i;
+    }
+    if (i < nt)
+      break;
+
+    /* Vertex -> triangles, ascending */
+    for (i = 0; i < part->PNumVertices; ++i)
+      adj->vert_offsets[i + 1] += adj->vert_offsets[i];
+    for (j = 0, i = 0; j < part->ptriangles_len && i < nt; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        n = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        adj->vert_triags[ adj->vert_offsets[n]++ ] = i;
+      }
+      ++i;
+    }
+    for (i = part->PNumVertices; i > 0; --i)
+      adj->vert_offsets[i] = adj->vert_offsets[i - 1];
+    adj->vert_offsets[0] = 0;
+
+    /* Twins: runs of equal edges */
+    qsort(edges, 3 * nt, 3 * sizeof(*edges), __FCELIB_OP_CompareHalfEdges);
+    for (i = 0; i < 3 * nt; i = j)
+    {
+      for (j = i + 1; j < 3 * nt && edges[3 * j] == edges[3 * i] && edges[3 * j + 1] == edges[3 * i + 1]; ++j)
+        continue;
+      switch (j - i)
+      {
+        case 1:
+          adj->twins[ edges[3 * i + 2] ] = -1;
+          ++adj->num_boundary;
+          break;
+        case 2:
+          adj->twins[ edges[3 * i + 2] ] = edges[3 * i + 5];
+          adj->twins[ edges[3 * i + 5] ] = edges[3 * i + 2];
+          break;
+        default:
+          for (n = i; n < j; ++n)
+            adj->twins[ edges[3 * n + 2] ] = -2;
+          break;
+      }
+    }
+
+    adj->boundary = (int *)FCELIB_UTIL_Malloc((adj->num_boundary + 1) * sizeof(*adj->boundary));
+    if (!adj->boundary)
+    {
+      fprintf(stderr, "GetPartAdjacency: Cannot allocate memory\n");
+      break;
+    }
+    for (i = 0, n = 0; i < 3 * nt; ++i)
+    {
+      if (adj->twins[i] == -1)
+        adj->boundary[n++] = i;
+    }
+
+    part->adj = adj;
+    adj = NULL;
+    break;
+  }  /* for (;;) */
+
+  if (adj)
+  {
+    part->adj = adj;
+    FCELIB_TYPES_PartInvalidateAdjacency(part);
+  }
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(edges);
+
+  return part->adj;
+}
+
+struct __FcelibOpCollapse {
+  double cost;
+  int    u;      /* removed vert */
+  int    v;      /* kept vert */
+  int    ver_u;
+  int    ver_v;
+};
+
+/* Working copy of a part. Local vert idxs are part vert order, local triag idxs are part triag order. */
+struct __FcelibOpQem {
+  int     nv;
+  int     nt_alive;
+  double *pos;              /* per vert: xyz */
+  double *q;                /* per vert: symmetric 4x4 quadric, upper triangle a2 ab ac ad b2 bc bd c2 cd d2 */
+  int    *ver;              /* per vert: version, -1 if removed */
+  unsigned char *locked;    /* per vert: never removed */
+  int    *tri;              /* per triag: local vert idxs */
+  float  *uv;               /* per triag: uuuvvv */
+  int    *tex_page;         /* per triag */
+  unsigned char *tri_alive;
+  int    *head;             /* per vert: first adjacency node, -1 if none */
+  int    *node_tri;         /* per adjacency node: triag */
+  int    *node_next;        /* per adjacency node: next node, -1 if none */
+  int     nodes_len;
+  int     nodes_cap;
+  struct __FcelibOpCollapse *heap;
+  int     heap_len;
+  int     heap_cap;
+};
+
+void __FCELIB_OP_QemAddPlane(double *q, const double n[3], const double d, const double w)
+{
+  q[0] += w * n[0] * n[0]; q[1] += w * n[0] * n[1]; q[2] += w * n[0] * n[2]; q[3] += w * n[0] * d;
+  q[4] += w * n[1] * n[1]; q[5] += w * n[1] * n[2]; q[6] += w * n[1] * d;
+  q[7] += w * n[2] * n[2]; q[8] += w * n[2] * d;
+  q[9] += w * d * d;
+}
+
+double __FCELIB_OP_QemEval(const double *q, const double *p)
+{
+  return q[0] * p[0] * p[0] + 2 * q[1] * p[0] * p[1] + 2 * q[2] * p[0] * p[2] + 2 * q[3] * p[0]
+       + q[4] * p[1] * p[1] + 2 * q[5] * p[1] * p[2] + 2 * q[6] * p[1]
+       + q[7] * p[2] * p[2] + 2 * q[8] * p[2]
+       + q[9];
+}
+
+/* Unnormalized normal of triangle (a, b, c) in n */
+void __FCELIB_OP_QemCross(const double *a, const double *b, const double *c, double n[3])
+{
+  double e1[3];
+  double e2[3];
+  e1[0] = b[0] - a[0]; e1[1] = b[1] - a[1]; e1[2] = b[2] - a[2];
+  e2[0] = c[0] - a[0]; e2[1] = c[1] - a[1]; e2[2] = c[2] - a[2];
+  n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+int __FCELIB_OP_QemAddNode(struct __FcelibOpQem *s, const int vert, const int t)
+{
+  if (s->nodes_len == s->nodes_cap)
+  {
+    const int cap = 2 * s->nodes_cap + 16;
+    int *p = (int *)FCELIB_UTIL_Realloc(s->node_tri, cap * sizeof(*p));
+    if (!p)
+      return 0;
+    s->node_tri = p;
+    p = (int *)FCELIB_UTIL_Realloc(s->node_next, cap * sizeof(*p));
+    if (!p)
+      return 0;
+    s->node_next = p;
+    s->nodes_cap = cap;
+  }
+  s->node_tri[s->nodes_len] = t;
+  s->node_next[s->nodes_len] = s->head[vert];
+  s->head[vert] = s->nodes_len++;
+  return 1;
+}
+
+/* Min-heap on cost */
+int __FCELIB_OP_QemPush(struct __FcelibOpQem *s, const int u, const int v)
+{
+  int i;
+  double q[10];
+  struct __FcelibOpCollapse e;
+  if (u == v || s->ver[u] < 0 || s->ver[v] < 0 || s->locked[u])
+    return 1;
+  if (s->heap_len == s->heap_cap)
+  {
+    const int cap = 2 * s->heap_cap + 16;
+    struct __FcelibOpCollapse *p = (struct __FcelibOpCollapse *)FCELIB_UTIL_Realloc(s->heap, cap * sizeof(*p));
+    if (!p)
+      return 0;
+    s->heap = p;
+    s->heap_cap = cap;
+  }
+  for (i = 0; i < 10; ++i)
+    q[i] = s->q[10 * u + i] + s->q[10 * v + i];
+  e.cost = __FCELIB_OP_QemEval(q, s->pos + 3 * v);
+  e.u = u;
+  e.v = v;
+  e.ver_u = s->ver[u];
+  e.ver_v = s->ver[v];
+  for (i = s->heap_len++; i > 0 && s->heap[(i - 1) / 2].cost > e.cost; i = (i - 1) / 2)
+    s->heap[i] = s->heap[(i - 1) / 2];
+  s->heap[i] = e;
+  return 1;
+}
+
+void __FCELIB_OP_QemPop(struct __FcelibOpQem *s, struct __FcelibOpCollapse *out)
+{
+  int i = 0;
+  int c;
+  const struct __FcelibOpCollapse last = s->heap[--s->heap_len];
+  *out = s->heap[0];
+  for (;;)
+  {
+    c = 2 * i + 1;
+    if (c >= s->heap_len)
+      break;
+    if (c + 1 < s->heap_len && s->heap[c + 1].cost < s->heap[c].cost)
+      ++c;
+    if (s->heap[c].cost >= last.cost)
+      break;
+    s->heap[i] = s->heap[c];
+    i = c;
+  }
+  if (s->heap_len > 0)
+    s->heap[i] = last;
+}
+
+/*
+  Collapse u -> v is valid if no remaining triangle of u flips, degenerates,
+  or duplicates a triangle of v (same vertex set, e.g. folding a closed part
+  onto itself), and at least one triangle is left.
+*/
+int __FCELIB_OP_QemValid(const struct __FcelibOpQem *s, const int u, const int v)
+{
+  int n;
+  int m;
+  int k;
+  int num_removed = 0;
+  const double *p[3];
+  double n0[3];
+  double n1[3];
+  for (n = s->head[u]; n >= 0; n = s->node_next[n])
+  {
+    const int *t = s->tri + 3 * s->node_tri[n];
+    int a;
+    int b;
+    if (!s->tri_alive[ s->node_tri[n] ])
+      continue;
+    if (t[0] == v || t[1] == v || t[2] == v)
+    {
+      ++num_removed;
+      continue;
+    }
+    k = t[0] == u ? 0 : t[1] == u ? 1 : 2;
+    a = t[(k + 1) % 3];
+    b = t[(k + 2) % 3];
+    for (m = s->head[v]; m >= 0; m = s->node_next[m])
+    {
+      const int *w = s->tri + 3 * s->node_tri[m];
+      if (!s->tri_alive[ s->node_tri[m] ])
+        continue;
+      if ((w[0] == a || w[1] == a || w[2] == a) && (w[0] == b || w[1] == b || w[2] == b))
+        return 0;
+    }
+    for (k = 0; k < 3; ++k)
+      p[k] = s->pos + 3 * t[k];
+    __FCELIB_OP_QemCross(p[0], p[1], p[2], n0);
+    for (k = 0; k < 3; ++k)
+    {
+      if (t[k] == u)
+        p[k] = s->pos + 3 * v;
+    }
+    __FCELIB_OP_QemCross(p[0], p[1], p[2], n1);
+    if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0)
+      return 0;
+  }
+  return s->nt_alive - num_removed > 0;
+}
+
+/* Collapse u -> v, then requeue edges around v. Returns bool. */
+int __FCELIB_OP_QemCollapse(struct __FcelibOpQem *s, const int u, const int v)
+{
+  int i;
+  int k;
+  int n;
+  int has_uv = 0;
+  float uv_v[2] = { 0.0f, 0.0f };
+
+  /* Texture coordinates at v, from a triangle that is removed */
+  for (n = s->head[u]; n >= 0 && !has_uv; n = s->node_next[n])
+  {
+    const int t = s->node_tri[n];
+    if (!s->tri_alive[t])
+      continue;
+    for (k = 0; k < 3; ++k)
+    {
+      if (s->tri[3 * t + k] != v)
+        continue;
+      uv_v[0] = s->uv[6 * t + k];
+      uv_v[1] = s->uv[6 * t + 3 + k];
+      has_uv = 1;
+    }
+  }
+
+  for (n = s->head[u]; n >= 0; n = s->node_next[n])
+  {
+    const int t = s->node_tri[n];
+    int *tv = s->tri + 3 * t;
+    if (!s->tri_alive[t])
+      continue;
+    if (tv[0] == v || tv[1] == v || tv[2] == v)
+    {
+      s->tri_alive[t] = 0;
+      --s->nt_alive;
+      continue;
+    }
+    for (k = 0; k < 3; ++k)
+    {
+      if (tv[k] != u)
+        continue;
+      tv[k] = v;
+      if (has_uv)
+      {
+        s->uv[6 * t + k] = uv_v[0];
+        s->uv[6 * t + 3 + k] = uv_v[1];
+      }
+    }
+    if (!__FCELIB_OP_QemAddNode(s, v, t))
+      return 0;
+  }
+
+  for (i = 0; i < 10; ++i)
+    s->q[10 * v + i] += s->q[10 * u + i];
+  s->ver[u] = -1;
+  ++s->ver[v];
+
+  for (n = s->head[v]; n >= 0; n = s->node_next[n])
+  {
+    const int t = s->node_tri[n];
+    if (!s->tri_alive[t])
+      continue;
+    for (k = 0; k < 3; ++k)
+    {
+      if (!__FCELIB_OP_QemPush(s, v, s->tri[3 * t + k]) || !__FCELIB_OP_QemPush(s, s->tri[3 * t + k], v))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+void __FCELIB_OP_QemRelease(struct __FcelibOpQem *s)
+{
+  FCELIB_UTIL_Free(s->pos);
+  FCELIB_UTIL_Free(s->q);
+  FCELIB_UTIL_Free(s->ver);
+  FCELIB_UTIL_Free(s->locked);
+  FCELIB_UTIL_Free(s->tri);
+  FCELIB_UTIL_Free(s->uv);
+  FCELIB_UTIL_Free(s->tex_page);
+  FCELIB_UTIL_Free(s->tri_alive);
+  FCELIB_UTIL_Free(s->head);
+  FCELIB_UTIL_Free(s->node_tri);
+  FCELIB_UTIL_Free(s->node_next);
+  FCELIB_UTIL_Free(s->heap);
+}
+
+/*
+  Quadric error mesh simplification (Garland, Heckbert 1997), by half-edge
+  collapses. Writes the result into a new part, e.g. to generate lower LODs.
+  The source part is unchanged.
+
+  Each collapse moves a vertex onto a neighbor, so kept vertices keep all
+  attributes (normals, damaged positions, animation flag). Triangles keep
+  flag and texpage; texture coordinates at a moved corner are taken from the
+  kept vertex. Collapses that flip a triangle, or would create a triangle
+  with the same vertices as an existing one, are rejected. Open boundaries
+  are preserved by penalty planes. If preserve_uv_seams, vertices where
+  triangles differ in texture coordinates or texpage are never moved.
+
+  Decimates until the new part has at most target_triags triangles, or no
+  valid collapse is left; target_triags is thus a lower bound, e.g. a closed
+  part keeps at least 4 triangles. The new part
+  is appended, with name and position of the source part. Fails if
+  target_triags < 1 or the source part has no triangles.
+
+  Returns new part index (order) on success, -1 on failure (mesh unchanged).
+*/
+int FCELIB_OP_DecimatePart(FcelibMesh *mesh, const int pid, const int target_triags, const int preserve_uv_seams)
+{
+  int pid_new = -1;
+  int retv = 0;
+  int internal_pid;
+  int i;
+  int j;
+  int k;
+  int n;
+  int nt;
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  const FcelibAdjacency *adj;
+  int *del = NULL;
+  struct __FcelibOpQem s;
+  struct __FcelibOpCollapse e;
+  FcelibPart *part;
+  FcelibTriangle *triag;
+
+  memset(&s, 0, sizeof(s));
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "DecimatePart: Invalid index (internal_pid)\n");
+      break;
+    }
+    if (target_triags < 1)
+    {
+      fprintf(stderr, "DecimatePart: Invalid target_triags %d\n", target_triags);
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    if (part->PNumTriangles < 1)
+    {
+      fprintf(stderr, "DecimatePart: Part has no triangles\n");
+      break;
+    }
+    s.nv = part->PNumVertices;
+    nt = part->PNumTriangles;
+
+    adj = FCELIB_OP_GetPartAdjacency(mesh, pid);
+    if (!adj || !FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    s.pos = (double *)FCELIB_UTIL_Malloc((3 * s.nv + 1) * sizeof(*s.pos));
+    s.q = (double *)FCELIB_UTIL_Malloc((10 * s.nv + 1) * sizeof(*s.q));
+    s.ver = (int *)FCELIB_UTIL_Malloc((s.nv + 1) * sizeof(*s.ver));
+    s.locked = (unsigned char *)FCELIB_UTIL_Malloc((s.nv + 1) * sizeof(*s.locked));
+    s.head = (int *)FCELIB_UTIL_Malloc((s.nv + 1) * sizeof(*s.head));
+    s.tri = (int *)FCELIB_UTIL_Malloc((3 * nt + 1) * sizeof(*s.tri));
+    s.uv = (float *)FCELIB_UTIL_Malloc((6 * nt + 1) * sizeof(*s.uv));
+    s.tex_page = (int *)FCELIB_UTIL_Malloc((nt + 1) * sizeof(*s.tex_page));
+    s.tri_alive = (unsigned char *)FCELIB_UTIL_Malloc((nt + 1) * sizeof(*s.tri_alive));
+    if (!s.pos || !s.q || !s.ver || !s.locked || !s.head || !s.tri || !s.uv || !s.tex_page || !s.tri_alive)
+    {
+      fprintf(stderr, "DecimatePart: Cannot allocate memory\n");
+      break;
+    }
+    memset(s.q, 0, (10 * s.nv + 1) * sizeof(*s.q));
+    memset(s.ver, 0, (s.nv + 1) * sizeof(*s.ver));
+    memset(s.locked, 0, (s.nv + 1) * sizeof(*s.locked));
+    memset(s.head, 0xFF, (s.nv + 1) * sizeof(*s.head));
+
+    for (j = 0, i = 0; j < part->pvertices_len && i < s.nv; ++j)
+    {
+      const FcelibVertex *vert;
+      if (part->PVertices[j] < 0)
+        continue;
+      vert = mesh->vertices[ part->PVertices[j] ];
+      s.pos[3 * i + 0] = vert->VertPos.x;
+      s.pos[3 * i + 1] = vert->VertPos.y;
+      s.pos[3 * i + 2] = vert->VertPos.z;
+      ++i;
+    }
+
+    /* Triangles, face quadrics, vert -> triangles */
+    for (j = 0, i = 0; j < part->ptriangles_len && i < nt; ++j)
+    {
+      double nrm[3];
+      double len;
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        s.tri[3 * i + k] = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        s.uv[6 * i + k] = triag->U[k];
+        s.uv[6 * i + 3 + k] = triag->V[k];
+      }
+      if (s.tri[3 * i] < 0 || s.tri[3 * i + 1] < 0 || s.tri[3 * i + 2] < 0)
+      {
+        fprintf(stderr, "DecimatePart: Triangle references vertex outside part\n");
+        break;
+      }
+      s.tri_alive[i] = 1;
+      s.tex_page[i] = triag->tex_page;
+      for (k = 0; k < 3; ++k)
+      {
+        if (!__FCELIB_OP_QemAddNode(&s, s.tri[3 * i + k], i))
+          break;
+      }
+      if (k < 3)
+      {
+        fprintf(stderr, "DecimatePart: Cannot allocate memory (nodes)\n");
+        break;
+      }
+
+      __FCELIB_OP_QemCross(s.pos + 3 * s.tri[3 * i], s.pos + 3 * s.tri[3 * i + 1], s.pos + 3 * s.tri[3 * i + 2], nrm);
+      len = FCELIB_UTIL_Sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+      if (len > 0.0)
+      {
+        const double *p0 = s.pos + 3 * s.tri[3 * i];
+        nrm[0] /= len; nrm[1] /= len; nrm[2] /= len;
+        for (k = 0; k < 3; ++k)
+          __FCELIB_OP_QemAddPlane(s.q + 10 * s.tri[3 * i + k], nrm,
+                                  -(nrm[0] * p0[0] + nrm[1] * p0[1] + nrm[2] * p0[2]), 0.5 * len);
+      }
+
+      ++i;
+    }
+    if (i < nt)
+      break;
+    s.nt_alive = nt;
+
+    /* Lock verts whose triangle corners differ in texture coordinates or texpage */
+    for (i = 0; i < s.nv && preserve_uv_seams; ++i)
+    {
+      float uv0[2];
+      int tp0 = 0;
+      int first = 1;
+      uv0[0] = uv0[1] = 0.0f;
+      for (n = s.head[i]; n >= 0 && !s.locked[i]; n = s.node_next[n])
+      {
+        const int t = s.node_tri[n];
+        for (k = 0; k < 3 && s.tri[3 * t + k] != i; ++k)
+          continue;
+        if (first)
+        {
+          uv0[0] = s.uv[6 * t + k];
+          uv0[1] = s.uv[6 * t + 3 + k];
+          tp0 = s.tex_page[t];
+          first = 0;
+        }
+        else if (s.uv[6 * t + k] != uv0[0] || s.uv[6 * t + 3 + k] != uv0[1] || s.tex_page[t] != tp0)
+          s.locked[i] = 1;
+      }
+    }
+
+    /* Open boundary edges (used by one triangle) get a perpendicular penalty plane */
+    for (i = 0; i < adj->num_boundary; ++i)
+    {
+      const int *t = s.tri + 3 * (adj->boundary[i] / 3);
+      const int a = t[adj->boundary[i] % 3];
+      const int b = t[(adj->boundary[i] + 1) % 3];
+      const double *pa = s.pos + 3 * a;
+      const double *pb = s.pos + 3 * b;
+      double fn[3];
+      double m[3];
+      double len2;
+      double len;
+      __FCELIB_OP_QemCross(s.pos + 3 * t[0], s.pos + 3 * t[1], s.pos + 3 * t[2], fn);
+      m[0] = (pb[1] - pa[1]) * fn[2] - (pb[2] - pa[2]) * fn[1];
+      m[1] = (pb[2] - pa[2]) * fn[0] - (pb[0] - pa[0]) * fn[2];
+      m[2] = (pb[0] - pa[0]) * fn[1] - (pb[1] - pa[1]) * fn[0];
+      len = FCELIB_UTIL_Sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+      len2 = (pb[0] - pa[0]) * (pb[0] - pa[0]) + (pb[1] - pa[1]) * (pb[1] - pa[1]) + (pb[2] - pa[2]) * (pb[2] - pa[2]);
+      if (len > 0.0)
+      {
+        m[0] /= len; m[1] /= len; m[2] /= len;
+        __FCELIB_OP_QemAddPlane(s.q + 10 * a, m, -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]), 1000.0 * len2);
+        __FCELIB_OP_QemAddPlane(s.q + 10 * b, m, -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]), 1000.0 * len2);
+      }
+    }
+
+    /* Candidate collapses: each half-edge, both directions */
+    for (i = 0; i < 3 * nt; ++i)
+    {
+      const int a = s.tri[i];
+      const int b = s.tri[3 * (i / 3) + (i + 1) % 3];
+      if (!__FCELIB_OP_QemPush(&s, a, b) || !__FCELIB_OP_QemPush(&s, b, a))
+        break;
+    }
+    if (i < 3 * nt)
+    {
+      fprintf(stderr, "DecimatePart: Cannot allocate memory (heap)\n");
+      break;
+    }
+
+    /* Decimate */
+    while (s.nt_alive > target_triags && s.heap_len > 0)
+    {
+      __FCELIB_OP_QemPop(&s, &e);
+      if (s.ver[e.u] != e.ver_u || s.ver[e.v] != e.ver_v)
+        continue;  /* stale */
+      if (!__FCELIB_OP_QemValid(&s, e.u, e.v))
+        continue;
+      if (!__FCELIB_OP_QemCollapse(&s, e.u, e.v))
+        break;
+    }
+    if (s.nt_alive > target_triags && s.heap_len > 0)
+    {
+      fprintf(stderr, "DecimatePart: Cannot allocate memory (collapse)\n");
+      break;
+    }
+
+    /* Write result to a copy of the source part */
+    del = (int *)FCELIB_UTIL_Malloc((nt - s.nt_alive + 1) * sizeof(*del));
+    if (!del)
+    {
+      fprintf(stderr, "DecimatePart: Cannot allocate memory (del)\n");
+      break;
+    }
+    pid_new = FCELIB_OP_CopyPartToMesh(mesh, mesh, pid);
+    if (pid_new < 0)
+      break;
+    part = mesh->parts[ mesh->hdr.Parts[FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid_new)] ];
+    for (i = 0, n = 0; i < nt; ++i)
+    {
+      triag = mesh->triangles[ part->PTriangles[i] ];
+      if (!s.tri_alive[i])
+      {
+        del[n++] = i;
+        continue;
+      }
+      for (k = 0; k < 3; ++k)
+      {
+        triag->vidx[k] = part->PVertices[ s.tri[3 * i + k] ];
+        triag->U[k] = s.uv[6 * i + k];
+        triag->V[k] = s.uv[6 * i + 3 + k];
+      }
+    }
+    if (!FCELIB_OP_DeletePartTriags(mesh, pid_new, del, n) ||
+        !FCELIB_OP_DeletePartUnrefdVerts(mesh, pid_new, 1))
+    {
+      FCELIB_OP_DeletePart(mesh, pid_new);
+      pid_new = -1;
+      break;
+    }
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(del);
+  __FCELIB_OP_QemRelease(&s);
+
+  return retv ? pid_new : -1;
+}
+
+/* Returns new part index (order) on success, -1 on failure. */
+int FCELIB_OP_MergePartsToNew(FcelibMesh *mesh, int pid1, int pid2)
+{
+  int pid_new = -1;
+  int internal_pid_new = -1;
+  int internal_pid1;
+  int internal_pid2;
+  int i;
+  int j;
+  int n;
+  int vidx_1st;
+  int tidx_1st;
+  int *old_global_to_new_global_idxs = NULL;  /* maps vert ref's in copied triags */
+  FcelibPart *part_new;
+  FcelibPart *part_src1;
+  FcelibPart *part_src2;
+
+  if (pid1 == pid2)
+  {
+    fprintf(stderr, "MergePartsToNew: Cannot merge part with itself\n");
+    return -1;
+  }
+
+  internal_pid1 = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid1);
+  internal_pid2 = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid2);
+  if (internal_pid1 < 0)
+  {
+    fprintf(stderr, "MergePartsToNew: Invalid index (internal_pid1)\n");
+    return -1;
+  }
+  if (internal_pid2 < 0)
+  {
+    fprintf(stderr, "MergePartsToNew: Invalid index (internal_pid2)\n");
+    return -1;
+  }
+  part_src1 = mesh->parts[mesh->hdr.Parts[internal_pid1]];
+  part_src2 = mesh->parts[mesh->hdr.Parts[internal_pid2]];
+
+  for (;;)
+  {
+    if (mesh->hdr.Parts[mesh->parts_len - 1] >= 0)
+    {
+      if (!FCELIB_TYPES_AddParts(mesh, 1))
+      {
+        internal_pid_new = -1;
+        break;
+      }
+    }
+
+    /* Get first unused index */
+    internal_pid_new = FCELIB_TYPES_GetFirstUnusedGlobalPartIdx(mesh);
+    vidx_1st = FCELIB_TYPES_GetFirstUnusedGlobalVertexIdx(mesh);
+    tidx_1st = FCELIB_TYPES_GetFirstUnusedGlobalTriangleIdx(mesh);
+
+
+    /* Add part */
+    mesh->hdr.Parts[internal_pid_new] = FCELIB_UTIL_ArrMax(mesh->hdr.Parts, mesh->parts_len) + 1;
+    part_new = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part_new));
+    if (!part_new)
+    {
+      fprintf(stderr, "MergePartsToNew: Cannot allocate memory (part)\n");
+      internal_pid_new = -1;
+      break;
+    }
+    memset(part_new, 0, sizeof(*part_new));
+    part_new->pvertices_len = 0;
+    part_new->ptriangles_len = 0;
+
+    mesh->parts[ mesh->hdr.Parts[internal_pid_new] ] = part_new;
+
+    sprintf(part_new->PartName, "%d_%d", internal_pid1, internal_pid2);
+    part_new->PartPos.x = 0.0f;
+    part_new->PartPos.y = 0.0f;
+    part_new->PartPos.z = 0.0f;
+
+    part_new->PNumTriangles = part_src1->PNumTriangles + part_src2->PNumTriangles;
+    part_new->PNumVertices = part_src1->PNumVertices + part_src2->PNumVertices;
+
+    ++mesh->hdr.NumParts;
+
+#if SCL_DEBUG >= 1
+    printf("triangles %d + %d = %d\n", part_src1->PNumTriangles, part_src2->PNumTriangles, part_new->PNumTriangles);
+    printf("vertices %d + %d = %d\n", part_src1->PNumVertices, part_src2->PNumVertices, part_new->PNumVertices);
+#endif
+
+    /* Copy vertices */
+    if (!FCELIB_TYPES_AddVerticesToPart(part_new, part_new->PNumVertices))
+    {
+      internal_pid_new = -1;
+      break;
+    }
+
+    if (mesh->vertices_len < vidx_1st + part_new->PNumVertices)
+    {
+      if (!FCELIB_TYPES_AddVerticesToMesh(mesh, vidx_1st + part_new->PNumVertices - mesh->vertices_len))
+      {
+        internal_pid_new = -1;
+        break;
+      }
+    }
+    mesh->hdr.NumVertices += part_new->PNumVertices;
+
+    old_global_to_new_global_idxs = (int *)FCELIB_UTIL_Malloc(mesh->vertices_len * sizeof(*old_global_to_new_global_idxs));
+    if (!old_global_to_new_global_idxs)
+    {
+      fprintf(stderr, "MergePartsToNew: Cannot allocate memory (map)\n");
+      internal_pid_new = -1;
+      break;
+    }
+    memset(old_global_to_new_global_idxs, 0xFF, mesh->vertices_len * sizeof(*old_global_to_new_global_idxs));
+
+    /* i - vert index in source, j - vert index in receiver */
+    for (i = 0, j = 0; i < part_src1->pvertices_len && j < part_src1->PNumVertices; ++i)
+    {
+      if (part_src1->PVertices[i] < 0)
+        continue;
+
+      mesh->vertices[vidx_1st + j] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
+      if (!mesh->vertices[vidx_1st + j])
+      {
+        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (vert1)\n");
+        internal_pid_new = -1;
+        break;
+      }
+      part_new->PVertices[j] = vidx_1st + j;
+      FCELIB_TYPES_CpyVert(mesh->vertices[vidx_1st + j], mesh->vertices[ part_src1->PVertices[i] ]);
+      FCELIB_TYPES_VertAddPosition(mesh->vertices[vidx_1st + j], &part_src1->PartPos);
+      old_global_to_new_global_idxs[part_src1->PVertices[i]] = vidx_1st + j;
+
+      ++j;
+    }
+    if (internal_pid_new < 0)
+      break;
+
+    for (i = 0; i < part_src2->pvertices_len && j < part_src1->PNumVertices + part_src2->PNumVertices; ++i)
+    {
+      if (part_src2->PVertices[i] < 0)
+        continue;
+
+      mesh->vertices[vidx_1st + j] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
+      if (!mesh->vertices[vidx_1st + j])
+      {
+        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (vert2)\n");
+        internal_pid_new = -1;
+        break;
+      }
+      part_new->PVertices[j] = vidx_1st + j;
+      FCELIB_TYPES_CpyVert(mesh->vertices[vidx_1st + j], mesh->vertices[ part_src2->PVertices[i] ]);
+      FCELIB_TYPES_VertAddPosition(mesh->vertices[vidx_1st + j], &part_src2->PartPos);
+      old_global_to_new_global_idxs[ part_src2->PVertices[i] ] = vidx_1st + j;
+
+      ++j;
+    }
+    if (internal_pid_new < 0)
+      break;
+
+    /* Copy triangles */
+    if (!FCELIB_TYPES_AddTrianglesToPart(part_new, part_new->PNumTriangles))
+    {
+      internal_pid_new = -1;
+      break;
+    }
+
+    if (mesh->triangles_len < tidx_1st + part_new->PNumTriangles)
+    {
+      if (!FCELIB_TYPES_AddTrianglesToMesh(mesh, tidx_1st + part_new->PNumTriangles - mesh->triangles_len))
+      {
+        internal_pid_new = -1;
+        break;
+      }
+    }
+    mesh->hdr.NumTriangles += part_new->PNumTriangles;
+
+    for (i = 0, j = 0; i < part_src1->ptriangles_len && j < part_src1->PNumTriangles; ++i)
+    {
+      if (part_src1->PTriangles[i] < 0)
+        continue;
+      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
+      if (!mesh->triangles[tidx_1st + j])
+      {
+        /* fatal error? */
+        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (triag1)\n");
+        internal_pid_new = -1;
+        break;
+      }
+      part_new->PTriangles[j] = tidx_1st + j;
+      FCELIB_TYPES_CpyTriag(mesh->triangles[tidx_1st + j], mesh->triangles[ part_src1->PTriangles[i] ]);
+
+      for (n = 0; n < 3; ++n)
+        mesh->triangles[tidx_1st + j]->vidx[n] = old_global_to_new_global_idxs[mesh->triangles[tidx_1st + j]->vidx[n]];
+
+      ++j;
+    }
+    if (internal_pid_new < 0)
+      break;
+    for (i = 0; i < part_src2->ptriangles_len && j < part_src1->PNumTriangles + part_src2->PNumTriangles; ++i)
+    {
+      if (part_src2->PTriangles[i] < 0)
+        continue;
+
+      mesh->triangles[tidx_1st + j] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
+      if (!mesh->triangles[tidx_1st + j])
+      {
+        /* fatal error */
+        fprintf(stderr, "MergePartsToNew: Cannot allocate memory (triag2)\n");
+        internal_pid_new = -1;
+        break;
+      }
+      part_new->PTriangles[j] = tidx_1st + j;
+      FCELIB_TYPES_CpyTriag(mesh->triangles[tidx_1st + j], mesh->triangles[ part_src2->PTriangles[i] ]);
+      for (n = 0; n < 3; ++n)
+        mesh->triangles[tidx_1st + j]->vidx[n] = old_global_to_new_global_idxs[mesh->triangles[tidx_1st + j]->vidx[n]];
+
+      ++j;
+    }
+
+    pid_new = FCELIB_TYPES_GetOrderByInternalPartIdx(mesh, internal_pid_new);
+    if (pid_new < 0)
+    {
+      fprintf(stderr, "MergePartsToNew: Cannot get new part idx\n");
+      break;
+    }
+
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(old_global_to_new_global_idxs);
+
+  return pid_new;
+}
+
+/*
+  Merge parts pids[0], ..., pids[pids_len - 1] into part pids[0], in one pass.
+  Vertices and triangles are moved, not copied, and keep their global indexes.
+  Part order within the merged part follows pids. The merged part keeps name
+  and order position of pids[0], and is positioned at the origin (as for
+  FCELIB_OP_MergePartsToNew). Other source parts are removed.
+
+  Returns new part index (order) on success, -1 on failure (mesh unchanged).
+*/
+int FCELIB_OP_MergeParts(FcelibMesh *mesh, const int *pids, const int pids_len)
+{
+  int pid_new = -1;
+  int i;
+  int j;
+  int nv = 0;
+  int nt = 0;
+  int *internal_pids = NULL;
+  int *pvertices = NULL;
+  int *ptriangles = NULL;
+  unsigned char *used = NULL;
+  FcelibPart *part;
+  FcelibPart *part_new;
+
+  for (;;)
+  {
+    if (!pids || pids_len < 1)
+    {
+      fprintf(stderr, "MergeParts: Unexpected NULL (pids)\n");
+      break;
+    }
+
+    internal_pids = (int *)FCELIB_UTIL_Malloc(pids_len * sizeof(*internal_pids));
+    used = (unsigned char *)FCELIB_UTIL_Malloc(mesh->parts_len * sizeof(*used) + 1);
+    if (!internal_pids || !used)
+    {
+      fprintf(stderr, "MergeParts: Cannot allocate memory (internal_pids)\n");
+      break;
+    }
+    memset(used, 0, mesh->parts_len * sizeof(*used) + 1);
+
+    for (i = 0; i < pids_len; ++i)
+    {
+      internal_pids[i] = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pids[i]);
+      if (internal_pids[i] < 0)
+      {
+        fprintf(stderr, "MergeParts: Invalid index (pids[%d] = %d)\n", i, pids[i]);
+        break;
+      }
+      if (used[ internal_pids[i] ])
+      {
+        fprintf(stderr, "MergeParts: Cannot merge part with itself (pids[%d] = %d)\n", i, pids[i]);
+        break;
+      }
+      used[ internal_pids[i] ] = 1;
+      part = mesh->parts[ mesh->hdr.Parts[internal_pids[i]] ];
+      nv += part->PNumVertices;
+      nt += part->PNumTriangles;
+    }
+    if (i < pids_len)
+      break;
+
+    pvertices = (int *)FCELIB_UTIL_Malloc((nv + 1) * sizeof(*pvertices));
+    ptriangles = (int *)FCELIB_UTIL_Malloc((nt + 1) * sizeof(*ptriangles));
+    if (!pvertices || !ptriangles)
+    {
+      fprintf(stderr, "MergeParts: Cannot allocate memory (index arrays)\n");
+      break;
+    }
+
+    /* Move ownership: collect global indexes in order, localize to origin */
+    for (i = 0, nv = 0, nt = 0; i < pids_len; ++i)
+    {
+      part = mesh->parts[ mesh->hdr.Parts[internal_pids[i]] ];
+      for (j = 0; j < part->pvertices_len; ++j)
+      {
+        if (part->PVertices[j] < 0)
+          continue;
+        FCELIB_TYPES_VertAddPosition(mesh->vertices[ part->PVertices[j] ], &part->PartPos);
+        pvertices[nv++] = part->PVertices[j];
+      }
+      for (j = 0; j < part->ptriangles_len; ++j)
+      {
+        if (part->PTriangles[j] < 0)
+          continue;
+        ptriangles[nt++] = part->PTriangles[j];
+      }
+      FCELIB_TYPES_PartInvalidateCaches(part);
+
+      if (i == 0)
+        continue;
+
+      FCELIB_UTIL_Free(part->PVertices);
+      FCELIB_UTIL_Free(part->PTriangles);
+      FCELIB_UTIL_Free(part);
+      mesh->parts[ mesh->hdr.Parts[internal_pids[i]] ] = NULL;
+      mesh->hdr.Parts[internal_pids[i]] = -1;
+      --mesh->hdr.NumParts;
+    }
+
+    part_new = mesh->parts[ mesh->hdr.Parts[internal_pids[0]] ];
+    FCELIB_UTIL_Free(part_new->PVertices);
+    FCELIB_UTIL_Free(part_new->PTriangles);
+    part_new->PVertices = pvertices;
+    part_new->PTriangles = ptriangles;
+    pvertices = NULL;
+    ptriangles = NULL;
+    part_new->PNumVertices = part_new->pvertices_len = nv;
+    part_new->PNumTriangles = part_new->ptriangles_len = nt;
+    part_new->PartPos.x = 0.0f;
+    part_new->PartPos.y = 0.0f;
+    part_new->PartPos.z = 0.0f;
+
+    pid_new = FCELIB_TYPES_GetOrderByInternalPartIdx(mesh, mesh->hdr.Parts[internal_pids[0]]);
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(internal_pids);
+  FCELIB_UTIL_Free(used);
+  FCELIB_UTIL_Free(pvertices);
+  FCELIB_UTIL_Free(ptriangles);
+
+  return pid_new;
+}
+
+/* Returns 1 if triangle matches split predicate, see FCELIB_OP_SplitPart() */
+int __FCELIB_OP_TriagMatches(const FcelibTriangle *triag, const int key, const int mask, const int value)
+{
+  switch (key)
+  {
+    case FCELIB_OP_SORTKEY_FLAG_MASK: return (triag->flag & mask) != 0;
+    case FCELIB_OP_SORTKEY_FLAG: return (triag->flag & mask) == value;
+    default: return (triag->tex_page & mask) == value;
+  }
+}
+
+/*
+  Moves part triangles that match into a new part, in one pass. By key (see
+  FCELIB_OP_SORTKEY_*), a triangle matches if
+    FLAG_MASK: (flag & mask) != 0, value is ignored
+    FLAG:      (flag & mask) == value
+    TEXPAGE:   (tex_page & mask) == value
+  Vertices referenced by moved triangles only are moved, vertices shared with
+  remaining triangles are duplicated. Moved triangles and vertices keep their
+  global indexes. The new part is appended, with name and position of the
+  source part. Index arrays of the source part are compacted.
+
+  Returns new part index (order) on success, -1 on failure or if no triangle
+  matches (mesh unchanged).
+*/
+int FCELIB_OP_SplitPart(FcelibMesh *mesh, const int pid, const int key, const int mask, const int value)
+{
+  int pid_new = -1;
+  int internal_pid;
+  int internal_pid_new = -1;
+  int i;
+  int j;
+  int k;
+  int n;
+  int nt_new = 0;
+  int nv_new = 0;
+  int ndup = 0;
+  int vidx_1st;
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  unsigned char *use = NULL;  /* per local vert: 0x1 by remaining triags, 0x2 by moved triags */
+  int *remap = NULL;  /* per local vert: global vert idx in new part */
+  FcelibVertex **dups = NULL;
+  FcelibPart *part;
+  FcelibPart *part_new = NULL;
+  FcelibTriangle *triag;
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "SplitPart: Invalid index (internal_pid)\n");
+      break;
+    }
+    if (key < FCELIB_OP_SORTKEY_FLAG_MASK || key > FCELIB_OP_SORTKEY_TEXPAGE)
+    {
+      fprintf(stderr, "SplitPart: Invalid key %d\n", key);
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    n = part->PNumVertices + 1;
+
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    use = (unsigned char *)FCELIB_UTIL_Malloc(n * sizeof(*use));
+    remap = (int *)FCELIB_UTIL_Malloc(n * sizeof(*remap));
+    if (!use || !remap)
+    {
+      fprintf(stderr, "SplitPart: Cannot allocate memory (map)\n");
+      break;
+    }
+    memset(use, 0, n * sizeof(*use));
+
+    /* Mark vert usage */
+    for (j = 0; j < part->ptriangles_len; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      i = __FCELIB_OP_TriagMatches(triag, key, mask, value);
+      nt_new += i;
+      for (k = 0; k < 3; ++k)
+      {
+        n = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (n >= 0)
+          use[n] |= (unsigned char)(i ? 0x2 : 0x1);
+      }
+    }
+    if (nt_new < 1)
+    {
+      fprintf(stderr, "SplitPart: No matching triangles\n");
+      break;
+    }
+
+    for (j = 0, n = 0; j < part->pvertices_len; ++j)
+    {
+      if (part->PVertices[j] < 0)
+        continue;
+      i = use[n++];
+      nv_new += (i & 0x2) != 0;
+      ndup += i == 0x3;
+    }
+
+    /* Allocate everything first, the mesh is not modified on failure */
+    part_new = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part_new));
+    if (!part_new)
+    {
+      fprintf(stderr, "SplitPart: Cannot allocate memory (part_new)\n");
+      break;
+    }
+    memset(part_new, 0, sizeof(*part_new));
+    if (!FCELIB_TYPES_AddVerticesToPart(part_new, nv_new) ||
+        !FCELIB_TYPES_AddTrianglesToPart(part_new, nt_new))
+      break;
+
+    if (ndup > 0)
+    {
+      dups = (FcelibVertex **)FCELIB_UTIL_Malloc(ndup * sizeof(*dups));
+      if (!dups)
+      {
+        fprintf(stderr, "SplitPart: Cannot allocate memory (dups)\n");
+        break;
+      }
+      memset(dups, 0, ndup * sizeof(*dups));
+      for (i = 0; i < ndup; ++i)
+      {
+        dups[i] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**dups));
+        if (!dups[i])
+        {
+          fprintf(stderr, "SplitPart: Cannot allocate memory (vert)\n");
+          break;
+        }
+      }
+      if (i < ndup)
+        break;
+    }
+
+    if (!mesh->hdr.Parts || mesh->hdr.Parts[mesh->parts_len - 1] >= 0)
+    {
+      if (!FCELIB_TYPES_AddParts(mesh, 1))
+        break;
+    }
+    vidx_1st = FCELIB_TYPES_GetFirstUnusedGlobalVertexIdx(mesh);
+    if (mesh->vertices_len < vidx_1st + ndup)
+    {
+      if (!FCELIB_TYPES_AddVerticesToMesh(mesh, vidx_1st + ndup - mesh->vertices_len))
         break;
+    }
+
+    FCELIB_TYPES_PartInvalidateCaches(part);
+
+    /* Move or duplicate verts, keeping order; compact source */
+    for (j = 0, n = 0, i = 0, k = 0; j < part->pvertices_len; ++j)
+    {
+      const int vidx = part->PVertices[j];
+      const int v = FCELIB_TYPES_VertMapGet(&g2l, vidx);
+      if (vidx < 0)
+        continue;
+      switch (use[v])
+      {
+        case 0x2:
+          remap[v] = vidx;
+          part_new->PVertices[k++] = vidx;
+          continue;
+        case 0x3:
+          mesh->vertices[vidx_1st + i] = dups[i];
+          dups[i] = NULL;
+          FCELIB_TYPES_CpyVert(mesh->vertices[vidx_1st + i], mesh->vertices[vidx]);
+          remap[v] = vidx_1st + i;
+          part_new->PVertices[k++] = vidx_1st + i;
+          ++i;
+          break;
+        default:
+          break;
       }
-      part_new->PTriangles[j] = tidx_1st + j;
-      FCELIB_TYPES_CpyTriag(mesh->triangles[tidx_1st + j], mesh->triangles[ part_src2->PTriangles[i] ]);
-      for (n = 0; n < 3; ++n)
-        mesh->triangles[tidx_1st + j]->vidx[n] = old_global_to_new_global_idxs[mesh->triangles[tidx_1st + j]->vidx[n]];
+      part->PVertices[n++] = vidx;
+    }
+    if (n < part->pvertices_len)
+      memset(part->PVertices + n, 0xFF, (part->pvertices_len - n) * sizeof(*part->PVertices));
 
-      ++j;
+    /* Move triags, keeping order; compact source */
+    for (j = 0, n = 0, k = 0; j < part->ptriangles_len; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      if (!__FCELIB_OP_TriagMatches(triag, key, mask, value))
+      {
+        part->PTriangles[n++] = part->PTriangles[j];
+        continue;
+      }
+      for (i = 0; i < 3; ++i)
+      {
+        const int v = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[i]);
+        if (v >= 0)
+          triag->vidx[i] = remap[v];
+      }
+      part_new->PTriangles[k++] = part->PTriangles[j];
     }
+    if (n < part->ptriangles_len)
+      memset(part->PTriangles + n, 0xFF, (part->ptriangles_len - n) * sizeof(*part->PTriangles));
+
+    part->PNumVertices -= nv_new - ndup;
+    part->PNumTriangles -= nt_new;
+    part_new->PNumVertices = nv_new;
+    part_new->PNumTriangles = nt_new;
+    mesh->hdr.NumVertices += ndup;
+    sprintf(part_new->PartName, "%s", part->PartName);
+    memcpy(&part_new->PartPos, &part->PartPos, sizeof(part->PartPos));
+
+    /* Append part, in first free slot of mesh->parts */
+    internal_pid_new = FCELIB_TYPES_GetFirstUnusedGlobalPartIdx(mesh);
+    i = 0;
+    while (i < mesh->parts_len && mesh->parts[i])
+      ++i;
+    mesh->hdr.Parts[internal_pid_new] = i;
+    mesh->parts[i] = part_new;
+    part_new = NULL;
+    ++mesh->hdr.NumParts;
 
-    pid_new = FCELIB_TYPES_GetOrderByInternalPartIdx(mesh, internal_pid_new);
-    if (pid_new < 0)
+    pid_new = FCELIB_TYPES_GetOrderByInternalPartIdx(mesh, i);
+    break;
+  }  /* for (;;) */
+
+  if (part_new)
+  {
+    FCELIB_UTIL_Free(part_new->PVertices);
+    FCELIB_UTIL_Free(part_new->PTriangles);
+    FCELIB_UTIL_Free(part_new);
+  }
+  if (dups)
+  {
+    for (i = 0; i < ndup; ++i)
+      FCELIB_UTIL_Free(dups[i]);
+    FCELIB_UTIL_Free(dups);
+  }
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(use);
+  FCELIB_UTIL_Free(remap);
+
+  return pid_new;
+}
+
+/* Union-find: returns root of x, with path halving */
+int __FCELIB_OP_FindRoot(int *parent, int x)
+{
+  while (parent[x] != x)
+  {
+    parent[x] = parent[ parent[x] ];
+    x = parent[x];
+  }
+  return x;
+}
+
+/*
+  Labels connected components of part triangles, in
+  O(part vertices + part triangles). Triangles are connected if they share a
+  vertex (by index, not by position). Labels are numbered from 0 in order of
+  the first triangle of each component. labels must hold PNumTriangles items.
+
+  Returns number of components, -1 on failure.
+*/
+int FCELIB_OP_GetPartComponents(const FcelibMesh *mesh, const int pid, int *labels)
+{
+  int retv = -1;
+  int internal_pid;
+  int j;
+  int k;
+  int n;
+  int a;
+  int b;
+  int v[3];
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  int *parent = NULL;  /* per local vert: union-find parent */
+  int *roots = NULL;  /* per local vert: label, if root */
+  const FcelibPart *part;
+  const FcelibTriangle *triag;
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
     {
-      fprintf(stderr, "MergePartsToNew: Cannot get new part idx\n");
+      fprintf(stderr, "GetPartComponents: Invalid index (internal_pid)\n");
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+    n = part->PNumVertices + 1;
+
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    parent = (int *)FCELIB_UTIL_Malloc(n * sizeof(*parent));
+    roots = (int *)FCELIB_UTIL_Malloc(n * sizeof(*roots));
+    if (!parent || !roots)
+    {
+      fprintf(stderr, "GetPartComponents: Cannot allocate memory\n");
+      break;
+    }
+    for (j = 0; j < n; ++j)
+      parent[j] = j;
+    memset(roots, 0xFF, n * sizeof(*roots));
+
+    /* Union verts of each triangle, smaller root wins */
+    for (j = 0; j < part->ptriangles_len; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (k = 0; k < 3; ++k)
+      {
+        v[k] = FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[k]);
+        if (v[k] < 0)
+          break;
+      }
+      if (k < 3)
+      {
+        fprintf(stderr, "GetPartComponents: Triangle references vertex outside part\n");
+        break;
+      }
+      for (k = 1; k < 3; ++k)
+      {
+        a = __FCELIB_OP_FindRoot(parent, v[0]);
+        b = __FCELIB_OP_FindRoot(parent, v[k]);
+        if (a < b)
+          parent[b] = a;
+        else
+          parent[a] = b;
+      }
+    }
+    if (j < part->ptriangles_len)
       break;
+
+    /* Label by first triangle */
+    for (j = 0, n = 0, k = 0; j < part->ptriangles_len && k < part->PNumTriangles; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      a = __FCELIB_OP_FindRoot(parent, FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[0]));
+      if (roots[a] < 0)
+        roots[a] = n++;
+      labels[k++] = roots[a];
     }
 
+    retv = n;
     break;
   }  /* for (;;) */
 
-  free(old_global_to_new_global_idxs);
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(parent);
+  FCELIB_UTIL_Free(roots);
 
-  return pid_new;
+  return retv;
+}
+
+/*
+  Splits part into its connected components (see FCELIB_OP_GetPartComponents),
+  in one pass. The source part keeps component 0 and unreferenced vertices;
+  components 1.. are moved to new parts, appended in label order, with name
+  and position of the source part. Components share no vertices, so
+  triangles and vertices are moved, not copied, and keep their global
+  indexes. Index arrays of the source part are compacted.
+
+  Returns number of components, -1 on failure (mesh unchanged).
+*/
+int FCELIB_OP_SplitComponents(FcelibMesh *mesh, const int pid)
+{
+  int retv = -1;
+  int ncomp = 0;
+  int internal_pid;
+  int i;
+  int j;
+  int k;
+  int n;
+  int c;
+  struct __FcelibVertMap g2l = { 0, NULL, NULL };  /* global vert idx to local vert idx */
+  int *labels = NULL;  /* per triag */
+  int *vlabels = NULL;  /* per local vert */
+  int *nt = NULL;  /* per component: triags */
+  int *nv = NULL;  /* per component: verts */
+  FcelibPart **parts_new = NULL;
+  FcelibPart *part;
+  const FcelibTriangle *triag;
+
+  for (;;)
+  {
+    internal_pid = FCELIB_TYPES_GetInternalPartIdxByOrder(mesh, pid);
+    if (internal_pid < 0)
+    {
+      fprintf(stderr, "SplitComponents: Invalid index (internal_pid)\n");
+      break;
+    }
+    part = mesh->parts[ mesh->hdr.Parts[internal_pid] ];
+
+    labels = (int *)FCELIB_UTIL_Malloc((part->PNumTriangles + 1) * sizeof(*labels));
+    if (!labels)
+    {
+      fprintf(stderr, "SplitComponents: Cannot allocate memory (labels)\n");
+      break;
+    }
+    ncomp = FCELIB_OP_GetPartComponents(mesh, pid, labels);
+    if (ncomp < 0)
+      break;
+    if (ncomp < 2)
+    {
+      retv = ncomp;
+      break;
+    }
+
+    if (!FCELIB_TYPES_VertMapInit(&g2l, part))
+      break;
+    n = part->PNumVertices + 1;
+
+    vlabels = (int *)FCELIB_UTIL_Malloc(n * sizeof(*vlabels));
+    nt = (int *)FCELIB_UTIL_Malloc(ncomp * sizeof(*nt));
+    nv = (int *)FCELIB_UTIL_Malloc(ncomp * sizeof(*nv));
+    parts_new = (FcelibPart **)FCELIB_UTIL_Malloc(ncomp * sizeof(*parts_new));
+    if (!vlabels || !nt || !nv || !parts_new)
+    {
+      fprintf(stderr, "SplitComponents: Cannot allocate memory\n");
+      break;
+    }
+    memset(vlabels, 0, n * sizeof(*vlabels));  /* unreferenced verts stay */
+    memset(nt, 0, ncomp * sizeof(*nt));
+    memset(nv, 0, ncomp * sizeof(*nv));
+    memset(parts_new, 0, ncomp * sizeof(*parts_new));
+
+    for (j = 0, k = 0; j < part->ptriangles_len && k < part->PNumTriangles; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      triag = mesh->triangles[ part->PTriangles[j] ];
+      for (i = 0; i < 3; ++i)
+        vlabels[ FCELIB_TYPES_VertMapGet(&g2l, triag->vidx[i]) ] = labels[k];
+      ++nt[ labels[k++] ];
+    }
+    for (j = 0, k = 0; j < part->pvertices_len; ++j)
+    {
+      if (part->PVertices[j] >= 0)
+        ++nv[ vlabels[k++] ];
+    }
+
+    /* Allocate everything first, the mesh is not modified on failure */
+    for (c = 1; c < ncomp; ++c)
+    {
+      parts_new[c] = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(**parts_new));
+      if (!parts_new[c])
+      {
+        fprintf(stderr, "SplitComponents: Cannot allocate memory (part_new)\n");
+        break;
+      }
+      memset(parts_new[c], 0, sizeof(**parts_new));
+      if (!FCELIB_TYPES_AddVerticesToPart(parts_new[c], nv[c]) ||
+          !FCELIB_TYPES_AddTrianglesToPart(parts_new[c], nt[c]))
+        break;
+    }
+    if (c < ncomp)
+      break;
+    i = ncomp - 1 - (mesh->parts_len - FCELIB_TYPES_GetFirstUnusedGlobalPartIdx(mesh));
+    if (i > 0 && !FCELIB_TYPES_AddParts(mesh, i))
+      break;
+
+    FCELIB_TYPES_PartInvalidateCaches(part);
+
+    /* Move verts and triags, keeping order; compact source */
+    memset(nv, 0, ncomp * sizeof(*nv));
+    for (j = 0, n = 0, k = 0; j < part->pvertices_len; ++j)
+    {
+      if (part->PVertices[j] < 0)
+        continue;
+      c = vlabels[k++];
+      if (c > 0)
+        parts_new[c]->PVertices[ nv[c]++ ] = part->PVertices[j];
+      else
+        part->PVertices[n++] = part->PVertices[j];
+    }
+    if (n < part->pvertices_len)
+      memset(part->PVertices + n, 0xFF, (part->pvertices_len - n) * sizeof(*part->PVertices));
+    part->PNumVertices = n;
+
+    memset(nt, 0, ncomp * sizeof(*nt));
+    for (j = 0, n = 0, k = 0; j < part->ptriangles_len; ++j)
+    {
+      if (part->PTriangles[j] < 0)
+        continue;
+      c = labels[k++];
+      if (c > 0)
+        parts_new[c]->PTriangles[ nt[c]++ ] = part->PTriangles[j];
+      else
+        part->PTriangles[n++] = part->PTriangles[j];
+    }
+    if (n < part->ptriangles_len)
+      memset(part->PTriangles + n, 0xFF, (part->ptriangles_len - n) * sizeof(*part->PTriangles));
+    part->PNumTriangles = n;
+
+    /* Append parts, in first free slots of mesh->parts */
+    for (c = 1, i = 0; c < ncomp; ++c)
+    {
+      parts_new[c]->PNumVertices = nv[c];
+      parts_new[c]->PNumTriangles = nt[c];
+      sprintf(parts_new[c]->PartName, "%s", part->PartName);
+      memcpy(&parts_new[c]->PartPos, &part->PartPos, sizeof(part->PartPos));
+
+      while (i < mesh->parts_len && mesh->parts[i])
+        ++i;
+      mesh->hdr.Parts[FCELIB_TYPES_GetFirstUnusedGlobalPartIdx(mesh)] = i;
+      mesh->parts[i] = parts_new[c];
+      parts_new[c] = NULL;
+      ++mesh->hdr.NumParts;
+    }
+
+    retv = ncomp;
+    break;
+  }  /* for (;;) */
+
+  if (parts_new)
+  {
+    for (c = 1; c < ncomp; ++c)
+    {
+      if (!parts_new[c])
+        continue;
+      FCELIB_UTIL_Free(parts_new[c]->PVertices);
+      FCELIB_UTIL_Free(parts_new[c]->PTriangles);
+      FCELIB_UTIL_Free(parts_new[c]);
+    }
+  }
+  FCELIB_UTIL_Free(parts_new);
+  FCELIB_TYPES_VertMapRelease(&g2l);
+  FCELIB_UTIL_Free(labels);
+  FCELIB_UTIL_Free(vlabels);
+  FCELIB_UTIL_Free(nt);
+  FCELIB_UTIL_Free(nv);
+
+  return retv;
+}
+
+/*
+  Reorder all parts in one pass. new_order[i] is the current index (order) of
+  the part that is moved to index i. Expects a permutation of 0..NumParts-1.
+  Returns bool (on failure, mesh is unchanged).
+*/
+int FCELIB_OP_ReorderParts(FcelibMesh *mesh, const int *new_order, const int new_order_len)
+{
+  int retv = 0;
+  int i;
+  int j;
+  int *internal_pids = NULL;  /* by current order */
+  int *parts = NULL;
+  unsigned char *used = NULL;
+
+  for (;;)
+  {
+    if (!new_order || new_order_len != mesh->hdr.NumParts)
+    {
+      fprintf(stderr, "ReorderParts: Expects permutation of length %d\n", mesh->hdr.NumParts);
+      break;
+    }
+    if (new_order_len < 1)
+    {
+      retv = 1;
+      break;
+    }
+
+    internal_pids = (int *)FCELIB_UTIL_Malloc(new_order_len * sizeof(*internal_pids));
+    parts = (int *)FCELIB_UTIL_Malloc(new_order_len * sizeof(*parts));
+    used = (unsigned char *)FCELIB_UTIL_Malloc(new_order_len * sizeof(*used));
+    if (!internal_pids || !parts || !used)
+    {
+      fprintf(stderr, "ReorderParts: Cannot allocate memory\n");
+      break;
+    }
+    memset(used, 0, new_order_len * sizeof(*used));
+
+    for (i = 0, j = 0; i < mesh->parts_len && j < new_order_len; ++i)
+    {
+      if (mesh->hdr.Parts[i] < 0)
+        continue;
+      internal_pids[j] = i;
+      ++j;
+    }
+    if (j != new_order_len)
+    {
+      fprintf(stderr, "ReorderParts: inconsistent list (mesh->hdr.NumParts)\n");
+      break;
+    }
+
+    for (i = 0; i < new_order_len; ++i)
+    {
+      if (new_order[i] < 0 || new_order[i] >= new_order_len || used[ new_order[i] ])
+      {
+        fprintf(stderr, "ReorderParts: Not a permutation (new_order[%d] = %d)\n", i, new_order[i]);
+        break;
+      }
+      used[ new_order[i] ] = 1;
+      parts[i] = mesh->hdr.Parts[ internal_pids[ new_order[i] ] ];
+    }
+    if (i < new_order_len)
+      break;
+
+    /* Live entries keep their positions in hdr.Parts, only their values move */
+    for (i = 0; i < new_order_len; ++i)
+      mesh->hdr.Parts[ internal_pids[i] ] = parts[i];
+
+    retv = 1;
+    break;
+  }  /* for (;;) */
+
+  FCELIB_UTIL_Free(internal_pids);
+  FCELIB_UTIL_Free(parts);
+  FCELIB_UTIL_Free(used);
+
+  return retv;
+}
+
+/*
+  Returns FCE3 part index for canonical FCE3, FCE4, FCE4M part names,
+  FCELIB_UTIL_Fce3PartsImplemented otherwise.
+*/
+int __FCELIB_OP_Fce3PartIdxByName(const char *name)
+{
+  int i;
+  for (i = 0; i < FCELIB_UTIL_Fce3PartsImplemented; ++i)
+  {
+    if (strncmp(name, kFce3PartsNames[i], 64) == 0 ||
+        strncmp(name, kFce4PartsNamesInFce3Order[i], 64) == 0)
+      return i;
+  }
+  if (strncmp(name, ":Hbody", 64) == 0)
+    return 0;
+  return FCELIB_UTIL_Fce3PartsImplemented;
+}
+
+/*
+  Returns FCE4 high body part index (see kFce4HiBodyParts) for canonical FCE4
+  part names, and FCE3, FCE4M names of the same parts,
+  FCELIB_UTIL_Fce4PartsHighBody otherwise.
+*/
+int __FCELIB_OP_Fce4PartIdxByName(const char *name)
+{
+  int i = __FCELIB_OP_Fce3PartIdxByName(name);
+  if (i < FCELIB_UTIL_Fce3PartsImplemented)
+    name = kFce4PartsNamesInFce3Order[i];
+  for (i = 0; i < FCELIB_UTIL_Fce4PartsHighBody; ++i)
+  {
+    if (strncmp(name, kFce4HiBodyParts[i], 64) == 0)
+      return i;
+  }
+  return FCELIB_UTIL_Fce4PartsHighBody;
+}
+
+/*
+  Stable counting sort of parts by rank_fn(PartName) in [0, num_ranks].
+  Returns bool.
+*/
+int __FCELIB_OP_SortPartsByRank(FcelibMesh *mesh, int (*rank_fn)(const char *name), const int num_ranks)
+{
+  int retv;
+  int i;
+  int j;
+  int k;
+  int *counts;
+  int *ranks;
+  int *new_order;
+
+  if (mesh->hdr.NumParts < 2)
+    return 1;
+
+  counts = (int *)FCELIB_UTIL_Malloc((num_ranks + 2) * sizeof(*counts));
+  ranks = (int *)FCELIB_UTIL_Malloc(mesh->hdr.NumParts * sizeof(*ranks));
+  new_order = (int *)FCELIB_UTIL_Malloc(mesh->hdr.NumParts * sizeof(*new_order));
+  if (!counts || !ranks || !new_order)
+  {
+    fprintf(stderr, "SortPartsByRank: Cannot allocate memory\n");
+    FCELIB_UTIL_Free(counts);
+    FCELIB_UTIL_Free(ranks);
+    FCELIB_UTIL_Free(new_order);
+    return 0;
+  }
+  memset(counts, 0, (num_ranks + 2) * sizeof(*counts));
+
+  for (i = 0, j = 0; i < mesh->parts_len && j < mesh->hdr.NumParts; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+    ranks[j] = rank_fn(mesh->parts[ mesh->hdr.Parts[i] ]->PartName);
+    ++counts[ ranks[j] + 1 ];
+    ++j;
+  }
+  for (k = 1; k < num_ranks + 2; ++k)
+    counts[k] += counts[k - 1];
+  for (i = 0; i < j; ++i)
+    new_order[ counts[ ranks[i] ]++ ] = i;
+
+  retv = FCELIB_OP_ReorderParts(mesh, new_order, j);
+
+  FCELIB_UTIL_Free(counts);
+  FCELIB_UTIL_Free(ranks);
+  FCELIB_UTIL_Free(new_order);
+
+  return retv;
+}
+
+/*
+  Sort parts to canonical FCE3 order (see kFce3PartsNames), by name. FCE4 and
+  FCE4M names of the same parts are recognized. Other parts are moved to the
+  end. Stable: parts of equal rank keep their relative order.
+  Returns bool.
+*/
+int FCELIB_OP_SortPartsToFce3Order(FcelibMesh *mesh)
+{
+  return __FCELIB_OP_SortPartsByRank(mesh, __FCELIB_OP_Fce3PartIdxByName, FCELIB_UTIL_Fce3PartsImplemented);
+}
+
+/*
+  Sort parts to canonical FCE4 order (see kFce4HiBodyParts), by name. FCE3
+  names of the same parts are recognized. Other parts (e.g., medium and low
+  LOD parts) are moved to the end. Stable: parts of equal rank keep their
+  relative order.
+  Returns bool.
+*/
+int FCELIB_OP_SortPartsToFce4Order(FcelibMesh *mesh)
+{
+  return __FCELIB_OP_SortPartsByRank(mesh, __FCELIB_OP_Fce4PartIdxByName, FCELIB_UTIL_Fce4PartsHighBody);
 }
 
 /*
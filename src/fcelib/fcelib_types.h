@@ -45,9 +45,12 @@ extern "C" {
 #ifndef __cplusplus
 typedef struct FcelibVertex FcelibVertex;
 typedef struct FcelibTriangle FcelibTriangle;
+typedef struct FcelibAdjacency FcelibAdjacency;
+typedef struct FcelibBvh FcelibBvh;
 typedef struct FcelibPart FcelibPart;
 typedef struct FcelibHeader FcelibHeader;
 typedef struct FcelibMesh FcelibMesh;
+typedef struct FcelibMemoryStats FcelibMemoryStats;
 #endif
 
 struct FcelibVertex {
@@ -66,6 +69,35 @@ struct FcelibTriangle {
   float V[3];
 };
 
+/*
+  Part adjacency, by part vertex order and part triangle order. Built on
+  demand and cached in FcelibPart.adj, see FCELIB_OP_GetPartAdjacency().
+  Half-edge 3 * t + k is the edge of triangle t from corner k to corner
+  (k + 1) % 3.
+*/
+struct FcelibAdjacency {
+  int  num_vertices;     /* PNumVertices when built */
+  int  num_triangles;    /* PNumTriangles when built */
+  int  num_boundary;
+  int *vert_offsets;     /* num_vertices + 1 items; triangles of vert i are vert_triags[vert_offsets[i]..vert_offsets[i + 1] - 1] */
+  int *vert_triags;      /* 3 * num_triangles items */
+  int *twins;            /* per half-edge: opposite half-edge, -1 if boundary, -2 if shared by more than 2 triangles */
+  int *boundary;         /* half-edges with twin -1, ascending */
+};
+
+/*
+  Bounding volume hierarchy over part triangles, see fcelib_bvh.h. Built on
+  demand and cached in FcelibPart.bvh, see FCELIB_BVH_GetPartBvh().
+*/
+struct FcelibBvh {
+  int    nodes_len;
+  float *bounds;   /* per node: min xyz, max xyz */
+  int   *nodes;    /* per node: first child (inner) or first triag (leaf), triag count (0 for inner) */
+  int    triags_len;
+  float *triags;   /* per triag: vert positions xyzxyzxyz, in leaf order */
+  int   *order;    /* per triag: triangle index (order) in part */
+};
+
 struct FcelibPart {
   int     PNumVertices;    /* number of elements: true count for this part */
   int     pvertices_len;   /* capacity: array length */
@@ -76,6 +108,9 @@ struct FcelibPart {
   tVector PartPos;
   int    *PVertices;       /* ordered list of global vert idxs, -1 for unused */
   int    *PTriangles;      /* ordered list of global triag idxs, -1 for unused */
+
+  FcelibAdjacency *adj;    /* cache, NULL if not built; invalidated by ops that change part topology */
+  FcelibBvh       *bvh;    /* cache, NULL if not built; invalidated by ops that change part topology or geometry */
 };
 
 struct FcelibHeader {
@@ -124,12 +159,65 @@ struct FcelibMesh {
 #endif
 };
 
+/* Payload sizes in bytes, excluding allocator overhead. */
+struct FcelibMemoryStats {
+  long  parts_bytes;       /* parts, part pointer array */
+  long  triangles_bytes;   /* triangles, triangle pointer array */
+  long  vertices_bytes;    /* vertices, vertex pointer array */
+  long  index_bytes;       /* hdr.Parts, PTriangles, PVertices */
+  long  total_bytes;
+
+  int   NumParts;          /* live slots */
+  int   parts_len;         /* allocated slots */
+  int   NumTriangles;
+  int   triangles_len;
+  int   NumVertices;
+  int   vertices_len;
+  int   ptriangles_len;    /* sum of part capacities */
+  int   pvertices_len;
+
+  float fragmentation;     /* share of allocated slots that are unused, 0.0 if none allocated */
+};
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
 
 /* release, init, validate -------------------------------------------------- */
 
+/* Frees cached adjacency of part, if any. Call whenever part topology changes. */
+void FCELIB_TYPES_PartInvalidateAdjacency(FcelibPart *part)
+{
+  if (!part->adj)
+    return;
+  FCELIB_UTIL_Free(part->adj->vert_offsets);
+  FCELIB_UTIL_Free(part->adj->vert_triags);
+  FCELIB_UTIL_Free(part->adj->twins);
+  FCELIB_UTIL_Free(part->adj->boundary);
+  FCELIB_UTIL_Free(part->adj);
+  part->adj = NULL;
+}
+
+/* Frees cached BVH of part, if any. Call whenever part vertice positions or part position change. */
+void FCELIB_TYPES_PartInvalidateBvh(FcelibPart *part)
+{
+  if (!part->bvh)
+    return;
+  FCELIB_UTIL_Free(part->bvh->bounds);
+  FCELIB_UTIL_Free(part->bvh->nodes);
+  FCELIB_UTIL_Free(part->bvh->triags);
+  FCELIB_UTIL_Free(part->bvh->order);
+  FCELIB_UTIL_Free(part->bvh);
+  part->bvh = NULL;
+}
+
+/* Frees all cached data of part. Call whenever part topology changes. */
+void FCELIB_TYPES_PartInvalidateCaches(FcelibPart *part)
+{
+  FCELIB_TYPES_PartInvalidateAdjacency(part);
+  FCELIB_TYPES_PartInvalidateBvh(part);
+}
+
 /*
   Call via mesh->release(), never directly.
 
@@ -153,32 +241,33 @@ void FCELIB_TYPES_MeshRelease(FcelibMesh *mesh)
     {
       if (part->PVertices[n] < 0)
         continue;
-      free(mesh->vertices[ part->PVertices[n] ]);
+      FCELIB_UTIL_Free(mesh->vertices[ part->PVertices[n] ]);
       --k;
     }  /* for n, k */
-    free(part->PVertices);
+    FCELIB_UTIL_Free(part->PVertices);
 
     for (n = part->ptriangles_len - 1, k = part->PNumTriangles - 1; n >= 0 && k >= 0; --n)
     {
       if (part->PTriangles[n] < 0)
         continue;
-      free(mesh->triangles[ part->PTriangles[n] ]);
+      FCELIB_UTIL_Free(mesh->triangles[ part->PTriangles[n] ]);
       --k;
     }  /* for n, k */
-    free(part->PTriangles);
+    FCELIB_UTIL_Free(part->PTriangles);
+    FCELIB_TYPES_PartInvalidateCaches(part);
   }  /* for i */
 
   for (i = mesh->parts_len - 1; i >= 0 ; --i)
   {
     if (mesh->hdr.Parts[i] < 0)
       continue;
-    free(mesh->parts[ mesh->hdr.Parts[i] ]);
+    FCELIB_UTIL_Free(mesh->parts[ mesh->hdr.Parts[i] ]);
   }  /* for i */
 
-  free(mesh->hdr.Parts);
-  free(mesh->parts);
-  free(mesh->triangles);
-  free(mesh->vertices);
+  FCELIB_UTIL_Free(mesh->hdr.Parts);
+  FCELIB_UTIL_Free(mesh->parts);
+  FCELIB_UTIL_Free(mesh->triangles);
+  FCELIB_UTIL_Free(mesh->vertices);
 
   mesh->release = NULL;
 }
@@ -203,11 +292,183 @@ FcelibMesh *FCELIB_TYPES_MeshInit(FcelibMesh *mesh)
   return mesh;
 }
 
-/* Returns: 1 = valid mesh, -1 = empty valid mesh, 0 = invalid mesh */
-int FCELIB_TYPES_ValidateMesh(const FcelibMesh *mesh)
+/*
+  Deep copy of mesh_src into mesh. Silently re-initializes mesh (see MeshInit).
+  Capacities and internal indexes are kept, i.e., part, triangle, and vertex
+  indexes of mesh_src remain valid for mesh. Every slot is copied, nothing
+  is shared: time and memory are O(mesh).
+
+  Returns mesh on success, NULL on failure (mesh is then empty).
+*/
+FcelibMesh *FCELIB_TYPES_MeshClone(FcelibMesh *mesh, const FcelibMesh *mesh_src)
 {
+  FcelibMesh *retv = NULL;
   int i;
   int j;
+  const FcelibPart *part_src;
+  FcelibPart *part;
+
+  if (mesh == mesh_src)
+    return mesh;
+
+  FCELIB_TYPES_MeshInit(mesh);
+
+  for (;;)
+  {
+    memcpy(&mesh->hdr, &mesh_src->hdr, sizeof(mesh->hdr));
+    mesh->hdr.Parts = NULL;
+
+    if (mesh_src->parts_len > 0)
+    {
+      mesh->hdr.Parts = (int *)FCELIB_UTIL_Malloc(mesh_src->parts_len * sizeof(*mesh->hdr.Parts));
+      if (!mesh->hdr.Parts)
+      {
+        fprintf(stderr, "MeshClone: Cannot allocate memory (hdr.Parts)\n");
+        break;
+      }
+      /* for signed int, -1 is represented as 0xFFFFFFFF */
+      memset(mesh->hdr.Parts, 0xFF, mesh_src->parts_len * sizeof(*mesh->hdr.Parts));
+      mesh->parts = (FcelibPart **)FCELIB_UTIL_Malloc(mesh_src->parts_len * sizeof(*mesh->parts));
+      if (!mesh->parts)
+      {
+        fprintf(stderr, "MeshClone: Cannot allocate memory (parts)\n");
+        break;
+      }
+      memset(mesh->parts, 0, mesh_src->parts_len * sizeof(*mesh->parts));
+      mesh->parts_len = mesh_src->parts_len;
+    }
+
+    if (mesh_src->triangles_len > 0)
+    {
+      mesh->triangles = (FcelibTriangle **)FCELIB_UTIL_Malloc(mesh_src->triangles_len * sizeof(*mesh->triangles));
+      if (!mesh->triangles)
+      {
+        fprintf(stderr, "MeshClone: Cannot allocate memory (triangles)\n");
+        break;
+      }
+      memset(mesh->triangles, 0, mesh_src->triangles_len * sizeof(*mesh->triangles));
+      mesh->triangles_len = mesh_src->triangles_len;
+    }
+
+    if (mesh_src->vertices_len > 0)
+    {
+      mesh->vertices = (FcelibVertex **)FCELIB_UTIL_Malloc(mesh_src->vertices_len * sizeof(*mesh->vertices));
+      if (!mesh->vertices)
+      {
+        fprintf(stderr, "MeshClone: Cannot allocate memory (vertices)\n");
+        break;
+      }
+      memset(mesh->vertices, 0, mesh_src->vertices_len * sizeof(*mesh->vertices));
+      mesh->vertices_len = mesh_src->vertices_len;
+    }
+
+    /*
+      Index arrays are copied as a whole first, hence on failure, mesh can be
+      released safely (free'ing NULL elements).
+    */
+    for (i = 0; i < mesh_src->parts_len; ++i)
+    {
+      if (mesh_src->hdr.Parts[i] < 0)
+        continue;
+      part_src = mesh_src->parts[ mesh_src->hdr.Parts[i] ];
+
+      part = (FcelibPart *)FCELIB_UTIL_Malloc(sizeof(*part));
+      if (!part)
+      {
+        fprintf(stderr, "MeshClone: Cannot allocate memory (part)\n");
+        break;
+      }
+      memcpy(part, part_src, sizeof(*part));
+      part->adj = NULL;
+      part->bvh = NULL;
+      part->pvertices_len = 0;
+      part->ptriangles_len = 0;
+      part->PVertices = NULL;
+      part->PTriangles = NULL;
+      mesh->parts[ mesh_src->hdr.Parts[i] ] = part;
+      mesh->hdr.Parts[i] = mesh_src->hdr.Parts[i];
+
+      if (part_src->pvertices_len > 0)
+      {
+        part->PVertices = (int *)FCELIB_UTIL_Malloc(part_src->pvertices_len * sizeof(*part->PVertices));
+        if (!part->PVertices)
+        {
+          fprintf(stderr, "MeshClone: Cannot allocate memory (PVertices)\n");
+          break;
+        }
+        memcpy(part->PVertices, part_src->PVertices, part_src->pvertices_len * sizeof(*part->PVertices));
+        part->pvertices_len = part_src->pvertices_len;
+      }
+
+      if (part_src->ptriangles_len > 0)
+      {
+        part->PTriangles = (int *)FCELIB_UTIL_Malloc(part_src->ptriangles_len * sizeof(*part->PTriangles));
+        if (!part->PTriangles)
+        {
+          fprintf(stderr, "MeshClone: Cannot allocate memory (PTriangles)\n");
+          break;
+        }
+        memcpy(part->PTriangles, part_src->PTriangles, part_src->ptriangles_len * sizeof(*part->PTriangles));
+        part->ptriangles_len = part_src->ptriangles_len;
+      }
+
+      for (j = 0; j < part->pvertices_len; ++j)
+      {
+        if (part->PVertices[j] < 0)
+          continue;
+        mesh->vertices[ part->PVertices[j] ] = (FcelibVertex *)FCELIB_UTIL_Malloc(sizeof(**mesh->vertices));
+        if (!mesh->vertices[ part->PVertices[j] ])
+        {
+          fprintf(stderr, "MeshClone: Cannot allocate memory (vert)\n");
+          break;
+        }
+        memcpy(mesh->vertices[ part->PVertices[j] ], mesh_src->vertices[ part->PVertices[j] ], sizeof(**mesh->vertices));
+      }
+      if (j < part->pvertices_len)
+        break;
+
+      for (j = 0; j < part->ptriangles_len; ++j)
+      {
+        if (part->PTriangles[j] < 0)
+          continue;
+        mesh->triangles[ part->PTriangles[j] ] = (FcelibTriangle *)FCELIB_UTIL_Malloc(sizeof(**mesh->triangles));
+        if (!mesh->triangles[ part->PTriangles[j] ])
+        {
+          fprintf(stderr, "MeshClone: Cannot allocate memory (triag)\n");
+          break;
+        }
+        memcpy(mesh->triangles[ part->PTriangles[j] ], mesh_src->triangles[ part->PTriangles[j] ], sizeof(**mesh->triangles));
+      }
+      if (j < part->ptriangles_len)
+        break;
+    }  /* for i */
+    if (i < mesh_src->parts_len)
+      break;
+
+    retv = mesh;
+    break;
+  }  /* for (;;) */
+
+  if (!retv)
+  {
+    FCELIB_TYPES_MeshRelease(mesh);
+    FCELIB_TYPES_MeshInit(mesh);
+  }
+
+  return retv;
+}
+
+/*
+  Checks cached counts and capacities only, in O(parts): hdr.Parts, part
+  pointers, PNumTriangles/PNumVertices against part capacities, and their sums
+  against hdr.NumTriangles/hdr.NumVertices. Ops keep these counts up to date,
+  hence this is cheap enough to run before every access.
+
+  Returns: 1 = valid mesh, -1 = empty valid mesh, 0 = invalid mesh
+*/
+int FCELIB_TYPES_ValidateMeshSummary(const FcelibMesh *mesh)
+{
+  int i;
   int count_parts;
   int sum_triags = 0;
   int sum_verts = 0;
@@ -260,6 +521,27 @@ int FCELIB_TYPES_ValidateMesh(const FcelibMesh *mesh)
       return 0;
     }
 
+    if (part->PNumTriangles < 0 || part->PNumTriangles > part->ptriangles_len)
+    {
+      fprintf(stderr, "ValidateMesh: invalid count (part->PNumTriangles) i%d %d>%d\n", i, part->PNumTriangles, part->ptriangles_len);
+      return 0;
+    }
+    if (part->PNumVertices < 0 || part->PNumVertices > part->pvertices_len)
+    {
+      fprintf(stderr, "ValidateMesh: invalid count (part->PNumVertices) i%d %d>%d\n", i, part->PNumVertices, part->pvertices_len);
+      return 0;
+    }
+    if (part->ptriangles_len > 0 && !part->PTriangles)
+    {
+      fprintf(stderr, "ValidateMesh: unexpected NULL pointer (part->PTriangles) %d\n", i);
+      return 0;
+    }
+    if (part->pvertices_len > 0 && !part->PVertices)
+    {
+      fprintf(stderr, "ValidateMesh: unexpected NULL pointer (part->PVertices) %d\n", i);
+      return 0;
+    }
+
     sum_triags += part->PNumTriangles;
     sum_verts += part->PNumVertices;
   }  /* for i */
@@ -279,19 +561,40 @@ int FCELIB_TYPES_ValidateMesh(const FcelibMesh *mesh)
     fprintf(stderr, "ValidateMesh: inconsistent list (%d != mesh->hdr.NumVertices = %d)\n", sum_verts, mesh->hdr.NumVertices);
     return 0;
   }
+  if (mesh->hdr.NumTriangles > mesh->triangles_len || mesh->hdr.NumVertices > mesh->vertices_len)
+  {
+    fprintf(stderr, "ValidateMesh: invalid count (mesh->hdr.NumTriangles, mesh->hdr.NumVertices)\n");
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+  Full check of all index arrays and slots, in O(parts + triangles + vertices).
+  See FCELIB_TYPES_ValidateMeshSummary() for the cheap check.
+
+  Returns: 1 = valid mesh, -1 = empty valid mesh, 0 = invalid mesh
+*/
+int FCELIB_TYPES_ValidateMesh(const FcelibMesh *mesh)
+{
+  int i;
+  int j;
+  int sum_triags;
+  int sum_verts;
+  FcelibPart *part = NULL;
+  const int retv = FCELIB_TYPES_ValidateMeshSummary(mesh);
+
+  if (retv != 1)
+    return retv;
 
   for (i = 0; i < mesh->parts_len; ++i)
   {
     if (mesh->hdr.Parts[i] < 0)
       continue;
     part = mesh->parts[mesh->hdr.Parts[i]];
-    /* if (!part) - see above */
+    /* if (!part) - see FCELIB_TYPES_ValidateMeshSummary() */
 
-    if (!part->PTriangles)
-    {
-      fprintf(stderr, "ValidateMesh: unexpected NULL pointer (part->PTriangles) %d\n", i);
-      return 0;
-    }
     for (j = 0, sum_triags = 0; j < part->ptriangles_len; ++j)
     {
       if (sum_triags > part->PNumTriangles)
@@ -321,11 +624,6 @@ int FCELIB_TYPES_ValidateMesh(const FcelibMesh *mesh)
       return 0;
     }
 
-    if (!part->PVertices)
-    {
-      fprintf(stderr, "ValidateMesh: unexpected NULL pointer (part->PVertices) %d\n", i);
-      return 0;
-    }
     for (j = 0, sum_verts = 0; j < part->pvertices_len; ++j)
     {
       if (sum_verts > part->PNumVertices)
@@ -504,12 +802,82 @@ int FCELIB_TYPES_GetOrderByInternalPartIdx(const FcelibMesh *mesh, const int idx
   return order;
 }
 
+/*
+  Maps global vert idx to vert order in part. Open addressing, load <= 0.5,
+  so memory is O(part vertices), regardless of the global indexes spanned.
+*/
+struct __FcelibVertMap {
+  unsigned int mask;
+  int *keys;  /* global vert idx, -1 if empty */
+  int *vals;  /* vert order in part */
+};
+
+/* Returns 1 on success, 0 on failure. Release with FCELIB_TYPES_VertMapRelease(). */
+int FCELIB_TYPES_VertMapInit(struct __FcelibVertMap *map, const FcelibPart *part)
+{
+  unsigned int cap = 2;
+  unsigned int h;
+  int i;
+  int j;
+
+  while (cap < 2u * (unsigned int)SCL_max(0, part->PNumVertices))
+    cap <<= 1;
+  map->mask = cap - 1;
+  map->keys = (int *)FCELIB_UTIL_Malloc(2 * cap * sizeof(*map->keys));
+  map->vals = NULL;
+  if (!map->keys)
+  {
+    fprintf(stderr, "VertMapInit: Cannot allocate memory\n");
+    return 0;
+  }
+  map->vals = map->keys + cap;
+  memset(map->keys, 0xFF, cap * sizeof(*map->keys));
+
+  for (j = 0, i = 0; j < part->pvertices_len && i < part->PNumVertices; ++j)
+  {
+    if (part->PVertices[j] < 0)
+      continue;
+    h = ((unsigned int)part->PVertices[j] * 2654435761u) & map->mask;
+    while (map->keys[h] >= 0 && map->keys[h] != part->PVertices[j])
+      h = (h + 1) & map->mask;
+    map->keys[h] = part->PVertices[j];
+    map->vals[h] = i++;
+  }
+
+  return 1;
+}
+
+/* Returns vert order in part, -1 if vidx is not in part. */
+int FCELIB_TYPES_VertMapGet(const struct __FcelibVertMap *map, const int vidx)
+{
+  unsigned int h;
+
+  if (vidx < 0)
+    return -1;
+  h = ((unsigned int)vidx * 2654435761u) & map->mask;
+  while (map->keys[h] >= 0)
+  {
+    if (map->keys[h] == vidx)
+      return map->vals[h];
+    h = (h + 1) & map->mask;
+  }
+
+  return -1;
+}
+
+void FCELIB_TYPES_VertMapRelease(struct __FcelibVertMap *map)
+{
+  FCELIB_UTIL_Free(map->keys);
+  map->keys = NULL;
+  map->vals = NULL;
+}
+
 int FCELIB_TYPES_AddParts(FcelibMesh *mesh, const int num_required)
 {
   void *ptr = NULL;
   int new_len = mesh->parts_len + num_required;
 
-  ptr = realloc(mesh->hdr.Parts, new_len * sizeof(*mesh->hdr.Parts));
+  ptr = FCELIB_UTIL_Realloc(mesh->hdr.Parts, new_len * sizeof(*mesh->hdr.Parts));
   if (!ptr)
   {
     fprintf(stderr, "FCELIB_TYPES_AddParts: Cannot reallocate memory (hdr.Parts)\n");
@@ -520,7 +888,7 @@ int FCELIB_TYPES_AddParts(FcelibMesh *mesh, const int num_required)
   /* for signed int, -1 is represented as 0xFFFFFFFF */
   memset(mesh->hdr.Parts + mesh->parts_len, 0xFF, (new_len - mesh->parts_len) * sizeof(*mesh->hdr.Parts));
 
-  ptr = realloc(mesh->parts, new_len * sizeof(*mesh->parts));
+  ptr = FCELIB_UTIL_Realloc(mesh->parts, new_len * sizeof(*mesh->parts));
   if (!ptr)
   {
     fprintf(stderr, "FCELIB_TYPES_AddParts: Cannot reallocate memory (parts)\n");
@@ -539,7 +907,7 @@ int FCELIB_TYPES_AddTrianglesToMesh(FcelibMesh *mesh, const int num_required)
 {
   void *ptr = NULL;
 
-  ptr = realloc(mesh->triangles, (mesh->triangles_len + num_required) * sizeof(*mesh->triangles));
+  ptr = FCELIB_UTIL_Realloc(mesh->triangles, (mesh->triangles_len + num_required) * sizeof(*mesh->triangles));
   if (!ptr)
   {
     fprintf(stderr, "FCELIB_TYPES_AddTriangles: Cannot reallocate memory\n");
@@ -558,7 +926,7 @@ int FCELIB_TYPES_AddVerticesToMesh(FcelibMesh *mesh, const int num_required)
 {
   void *ptr = NULL;
 
-  ptr = realloc(mesh->vertices, (mesh->vertices_len + num_required) * sizeof(*mesh->vertices));
+  ptr = FCELIB_UTIL_Realloc(mesh->vertices, (mesh->vertices_len + num_required) * sizeof(*mesh->vertices));
   if (!ptr)
   {
     fprintf(stderr, "FCELIB_TYPES_AddVertices: Cannot reallocate memory\n");
@@ -577,7 +945,7 @@ int FCELIB_TYPES_AddTrianglesToPart(FcelibPart *part, const int num_required)
   void *ptr = NULL;
 
   part->ptriangles_len += num_required;
-  ptr = realloc(part->PTriangles, part->ptriangles_len * sizeof(*part->PTriangles));
+  ptr = FCELIB_UTIL_Realloc(part->PTriangles, part->ptriangles_len * sizeof(*part->PTriangles));
   if (!ptr)
   {
     fprintf(stderr, "AddTriangles2: Cannot reallocate memory (part->PTriangles)\n");
@@ -596,7 +964,7 @@ int FCELIB_TYPES_AddVerticesToPart(FcelibPart *part, const int num_required)
   void *ptr = NULL;
 
   part->pvertices_len += num_required;
-  ptr = realloc(part->PVertices, part->pvertices_len * sizeof(*part->PVertices));
+  ptr = FCELIB_UTIL_Realloc(part->PVertices, part->pvertices_len * sizeof(*part->PVertices));
   if (!ptr)
   {
     fprintf(stderr, "AddVertices2: Cannot reallocate memory (part->PVertices)\n");
@@ -669,7 +1037,7 @@ int FCELIB_TYPES_GetPartCentroid(const FcelibMesh *mesh, const FcelibPart *part,
       break;
     }
 
-    xyz_arr = (float *)malloc(3 * (PNumVertices + 1) * sizeof(*xyz_arr));
+    xyz_arr = (float *)FCELIB_UTIL_Malloc(3 * (PNumVertices + 1) * sizeof(*xyz_arr));
     if (!xyz_arr)
     {
       fprintf(stderr, "GetPartLocalCentroid: Cannot allocate memory\n");
@@ -716,7 +1084,7 @@ int FCELIB_TYPES_GetPartCentroid(const FcelibMesh *mesh, const FcelibPart *part,
     printf("centroid->z: %f (%f, %f)\n", centroid->z, z_arr[count_verts - 1], z_arr[0]);
 #endif
 
-    free(xyz_arr);
+    FCELIB_UTIL_Free(xyz_arr);
 
     retv = 1;
     break;
@@ -750,6 +1118,7 @@ void FCELIB_TYPES_ResetPartCenter(const FcelibMesh *mesh, FcelibPart *part, cons
   memcpy(&part->PartPos.x, &new_PartPos.x, sizeof(float));
   memcpy(&part->PartPos.y, &new_PartPos.y, sizeof(float));
   memcpy(&part->PartPos.z, &new_PartPos.z, sizeof(float));
+  FCELIB_TYPES_PartInvalidateBvh(part);
 }
 
 /* assumes typesz=1|4 */
@@ -780,6 +1149,52 @@ void FCELIB_TYPES_WriteFceColors(unsigned char *dest, const tColor4 * const src,
 
 /* stats ------------------------------------------------------------------------------------------------------------ */
 
+/*
+  Fills stats with the memory footprint of mesh. Slots are counted as
+  allocated whether they are in use or not. Returns 1.
+*/
+int FCELIB_TYPES_MeshMemoryStats(const FcelibMesh *mesh, FcelibMemoryStats *stats)
+{
+  int i;
+  int slots_used;
+  int slots_alloc;
+  FcelibPart *part;
+
+  memset(stats, 0, sizeof(*stats));
+
+  stats->NumParts = mesh->hdr.NumParts;
+  stats->parts_len = mesh->parts_len;
+  stats->NumTriangles = mesh->hdr.NumTriangles;
+  stats->triangles_len = mesh->triangles_len;
+  stats->NumVertices = mesh->hdr.NumVertices;
+  stats->vertices_len = mesh->vertices_len;
+
+  for (i = 0; i < mesh->parts_len; ++i)
+  {
+    if (mesh->hdr.Parts[i] < 0)
+      continue;
+    part = mesh->parts[ mesh->hdr.Parts[i] ];
+    stats->ptriangles_len += part->ptriangles_len;
+    stats->pvertices_len += part->pvertices_len;
+  }
+
+  stats->parts_bytes = (long)mesh->hdr.NumParts * (long)sizeof(**mesh->parts)
+                     + (long)mesh->parts_len * (long)sizeof(*mesh->parts);
+  stats->triangles_bytes = (long)mesh->hdr.NumTriangles * (long)sizeof(**mesh->triangles)
+                         + (long)mesh->triangles_len * (long)sizeof(*mesh->triangles);
+  stats->vertices_bytes = (long)mesh->hdr.NumVertices * (long)sizeof(**mesh->vertices)
+                        + (long)mesh->vertices_len * (long)sizeof(*mesh->vertices);
+  stats->index_bytes = ((long)mesh->parts_len + stats->ptriangles_len + stats->pvertices_len) * (long)sizeof(int);
+  stats->total_bytes = stats->parts_bytes + stats->triangles_bytes + stats->vertices_bytes + stats->index_bytes;
+
+  slots_used = mesh->hdr.NumParts + mesh->hdr.NumTriangles + mesh->hdr.NumVertices;
+  slots_alloc = mesh->parts_len + mesh->triangles_len + mesh->vertices_len;
+  if (slots_alloc > 0)
+    stats->fragmentation = 1.0f - (float)slots_used / (float)slots_alloc;
+
+  return 1;
+}
+
 void FCELIB_TYPES_PrintMeshInfo(const FcelibMesh *mesh)
 {
   int i;
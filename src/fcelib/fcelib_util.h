@@ -23,6 +23,7 @@
 #define FCELIB_UTIL_H_
 
 #include <ctype.h>
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,6 +47,96 @@
 #define FCELIB_UTIL_Fce3PartsImplemented 13
 #define FCELIB_UTIL_Fce4PartsHighBody 18
 
+/* allocator -------------------------------------------------------------------------------------------------------- */
+
+/*
+  All library memory is requested via FCELIB_UTIL_Malloc(), FCELIB_UTIL_Realloc(),
+  FCELIB_UTIL_Free(). Defaults to malloc(), realloc(), free().
+
+  Set a custom allocator before any mesh is initialized. Memory is free'd by
+  whichever allocator is set at that time, so never change it while meshes
+  are alive.
+*/
+typedef void *(*FcelibMallocFn)(void *ctx, size_t size);
+typedef void *(*FcelibReallocFn)(void *ctx, void *ptr, size_t size);
+typedef void (*FcelibFreeFn)(void *ctx, void *ptr);
+
+void *FCELIB_UTIL_StdMalloc(void *ctx, size_t size) { (void)ctx; return malloc(size); }
+void *FCELIB_UTIL_StdRealloc(void *ctx, void *ptr, size_t size) { (void)ctx; return realloc(ptr, size); }
+void FCELIB_UTIL_StdFree(void *ctx, void *ptr) { (void)ctx; free(ptr); }
+
+FcelibMallocFn FCELIB_UTIL_malloc_fn = FCELIB_UTIL_StdMalloc;
+FcelibReallocFn FCELIB_UTIL_realloc_fn = FCELIB_UTIL_StdRealloc;
+FcelibFreeFn FCELIB_UTIL_free_fn = FCELIB_UTIL_StdFree;
+void *FCELIB_UTIL_alloc_ctx = NULL;
+
+/* ctx is passed to every call. Resets to default if any function is NULL. */
+void FCELIB_UTIL_SetAllocator(FcelibMallocFn malloc_fn, FcelibReallocFn realloc_fn, FcelibFreeFn free_fn, void *ctx)
+{
+  if (!malloc_fn || !realloc_fn || !free_fn)
+  {
+    malloc_fn = FCELIB_UTIL_StdMalloc;
+    realloc_fn = FCELIB_UTIL_StdRealloc;
+    free_fn = FCELIB_UTIL_StdFree;
+    ctx = NULL;
+  }
+  FCELIB_UTIL_malloc_fn = malloc_fn;
+  FCELIB_UTIL_realloc_fn = realloc_fn;
+  FCELIB_UTIL_free_fn = free_fn;
+  FCELIB_UTIL_alloc_ctx = ctx;
+}
+
+void *FCELIB_UTIL_Malloc(size_t size)
+{
+  return FCELIB_UTIL_malloc_fn(FCELIB_UTIL_alloc_ctx, size);
+}
+
+void *FCELIB_UTIL_Realloc(void *ptr, size_t size)
+{
+  return FCELIB_UTIL_realloc_fn(FCELIB_UTIL_alloc_ctx, ptr, size);
+}
+
+void FCELIB_UTIL_Free(void *ptr)
+{
+  if (ptr)
+    FCELIB_UTIL_free_fn(FCELIB_UTIL_alloc_ctx, ptr);
+}
+
+/* parallel for ----------------------------------------------------------------------------------------------------- */
+
+/*
+  Work that splits into independent tasks is run via FCELIB_UTIL_ParallelFor(),
+  which calls fn(arg, i) for i in [0, n) and returns once all calls are done.
+  Serial by default; fcelib has no threading of its own.
+
+  A parallel_for_fn may run the calls concurrently, in any order. Tasks use
+  FCELIB_UTIL_Malloc() et al., so the allocator must then be thread-safe.
+*/
+typedef void (*FcelibTaskFn)(void *arg, const int i);
+typedef void (*FcelibParallelForFn)(void *ctx, const int n, FcelibTaskFn fn, void *arg);
+
+FcelibParallelForFn FCELIB_UTIL_parallel_for_fn = NULL;
+void *FCELIB_UTIL_parallel_for_ctx = NULL;
+
+/* ctx is passed to every call. Resets to serial if parallel_for_fn is NULL. */
+void FCELIB_UTIL_SetParallelFor(FcelibParallelForFn parallel_for_fn, void *ctx)
+{
+  FCELIB_UTIL_parallel_for_fn = parallel_for_fn;
+  FCELIB_UTIL_parallel_for_ctx = parallel_for_fn ? ctx : NULL;
+}
+
+void FCELIB_UTIL_ParallelFor(const int n, FcelibTaskFn fn, void *arg)
+{
+  int i;
+  if (FCELIB_UTIL_parallel_for_fn)
+  {
+    FCELIB_UTIL_parallel_for_fn(FCELIB_UTIL_parallel_for_ctx, n, fn, arg);
+    return;
+  }
+  for (i = 0; i < n; ++i)
+    fn(arg, i);
+}
+
 /*
   Represent FCE dummies (light/fx objects)
   Mainly used for OBJ output, hence kTrianglesDiamond has 1-based indexes.
@@ -142,13 +233,85 @@ int FCELIB_UTIL_CompareInts(const void *a, const void *b)
   return (arg1 > arg2) - (arg1 < arg2);
 }
 
+/*
+  Square root by Newton's method, avoids linking libm. Returns 0 for x <= 0
+  or NaN, x for +inf.
+*/
+double FCELIB_UTIL_Sqrt(double x)
+{
+  double g = 1.0;
+  double s = 1.0;
+  int i;
+  if (!(x > 0.0))
+    return 0.0;
+  if (x > DBL_MAX)
+    return x;
+  /* Reduce to [0.25, 4], where 6 iterations reach double precision. Coarse
+     steps of 2^64 first, so that any finite x takes few iterations. */
+  while (x > 18446744073709551616.0)
+  {
+    x *= 1.0 / 18446744073709551616.0;
+    s *= 4294967296.0;
+  }
+  while (x < 1.0 / 18446744073709551616.0)
+  {
+    x *= 18446744073709551616.0;
+    s *= 1.0 / 4294967296.0;
+  }
+  while (x > 4.0)
+  {
+    x *= 0.25;
+    s *= 2.0;
+  }
+  while (x < 0.25)
+  {
+    x *= 4.0;
+    s *= 0.5;
+  }
+  for (i = 0; i < 6; ++i)
+    g = 0.5 * (g + x / g);
+  return g * s;
+}
+
+/* atan2() without libm, absolute error < 1e-10. */
+double FCELIB_UTIL_Atan2(const double y, const double x)
+{
+  const double ax = SCL_abs(x);
+  const double ay = SCL_abs(y);
+  double t;
+  double t2;
+  double term;
+  double r = 0.0;
+  int k;
+  int shifted = 0;
+  if (ax == 0.0 && ay == 0.0)
+    return 0.0;
+  /* Reduce to |t| <= tan(pi/8), where the series converges quickly */
+  t = ay > ax ? ax / ay : ay / ax;
+  if (t > 0.41421356237309503)
+  {
+    t = (t - 1.0) / (t + 1.0);
+    shifted = 1;
+  }
+  t2 = t * t;
+  for (k = 1, term = t; k < 26; k += 2, term *= -t2)
+    r += term / k;
+  if (shifted)
+    r += 0.78539816339744831;
+  if (ay > ax)
+    r = 1.5707963267948966 - r;
+  if (x < 0.0)
+    r = 3.1415926535897931 - r;
+  return y < 0.0 ? -r : r;
+}
+
 /* Returns maximum or -100 on failure. Assumes nonnegative integers. */
 int FCELIB_UTIL_ArrMax(const int *arr, const int arr_len)
 {
   int retv = -100;
   for (;;)
   {
-    int *sortedarr = (int *)malloc(arr_len * sizeof(*sortedarr));
+    int *sortedarr = (int *)FCELIB_UTIL_Malloc(arr_len * sizeof(*sortedarr));
     if (!sortedarr)
     {
       fprintf(stderr, "Warning: FCELIB_UTIL_ArrMax: Cannot allocate memory, return default -100");
@@ -158,7 +321,7 @@ int FCELIB_UTIL_ArrMax(const int *arr, const int arr_len)
     qsort(sortedarr, arr_len, sizeof(*sortedarr), FCELIB_UTIL_CompareInts);
 
     retv = sortedarr[arr_len - 1];
-    free(sortedarr);
+    FCELIB_UTIL_Free(sortedarr);
     break;
   }
   return retv;
@@ -0,0 +1,109 @@
+/*
+  fcec-SetAllocator.cpp - test custom allocator
+  fcecodec Copyright (C) 2021 and later Benjamin Futasz <https://github.com/bfut>
+
+  You may not redistribute this program without its source code.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "../../src/fcelib/fcelib.h"
+#include "../../src/fcelib/fcelib_types.h"  /* line can be omitted */
+
+struct AllocCount {
+  long live;   // blocks currently allocated
+  long total;  // blocks ever allocated
+};
+
+void *CountMalloc(void *ctx, size_t size)
+{
+  void *ptr = malloc(size);
+  if (ptr)
+  {
+    ++static_cast<AllocCount *>(ctx)->live;
+    ++static_cast<AllocCount *>(ctx)->total;
+  }
+  return ptr;
+}
+
+void *CountRealloc(void *ctx, void *ptr, size_t size)
+{
+  void *ptr_new = realloc(ptr, size);
+  if (!ptr && ptr_new)
+  {
+    ++static_cast<AllocCount *>(ctx)->live;
+    ++static_cast<AllocCount *>(ctx)->total;
+  }
+  return ptr_new;
+}
+
+void CountFree(void *ctx, void *ptr)
+{
+  if (ptr)
+    --static_cast<AllocCount *>(ctx)->live;
+  free(ptr);
+}
+
+#define CHECK(x) if (!(x)) { std::cout << "line " << __LINE__ << ": " << #x << std::endl; retv = -1; break; }
+
+int main(void)
+{
+  int retv = 0;
+  AllocCount count = { 0, 0 };
+  FcelibMesh mesh;
+
+  std::ifstream f("../fce/Snowman_car.fce", std::ios::binary);
+  std::vector<char> buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+  FCELIB_SetAllocator(&CountMalloc, &CountRealloc, &CountFree, &count);
+  FCELIB_MeshInit(&mesh);
+
+  for (;;)
+  {
+    CHECK(buf.size() > 0);
+
+    // allocator counts rise on decode, fall back to zero on release
+    CHECK(FCELIB_DecodeFce(&mesh, buf.data(), static_cast<int>(buf.size())));
+    CHECK(count.live > 0);
+    CHECK(count.total >= count.live);
+    FCELIB_MeshRelease(&mesh);
+    CHECK(count.live == 0);
+    FCELIB_MeshInit(&mesh);
+    CHECK(FCELIB_DecodeFce(&mesh, buf.data(), static_cast<int>(buf.size())));
+    CHECK(count.live > 0);
+
+    break;
+  }  // for (;;)
+
+  FCELIB_MeshRelease(&mesh);
+  if (retv == 0 && count.live != 0)
+  {
+    std::cout << "leaked " << count.live << " blocks" << std::endl;
+    retv = -1;
+  }
+  FCELIB_SetAllocator(NULL, NULL, NULL, NULL);
+
+  if (retv == 0)
+    std::cout << "successful" << std::endl;
+  else
+    std::cout << "failed" << std::endl;
+
+  return retv;
+}
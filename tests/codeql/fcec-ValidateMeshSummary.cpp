@@ -0,0 +1,80 @@
+/*
+  fcec-ValidateMeshSummary.cpp - test mesh summary validation on corrupted mesh
+  fcecodec Copyright (C) 2021 and later Benjamin Futasz <https://github.com/bfut>
+
+  You may not redistribute this program without its source code.
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "../../src/fcelib/fcelib.h"
+#include "../../src/fcelib/fcelib_types.h"  /* line can be omitted */
+
+#define CHECK(x) if (!(x)) { std::cout << "line " << __LINE__ << ": " << #x << std::endl; retv = -1; break; }
+
+int main(void)
+{
+  int retv = 0;
+  FcelibMesh mesh;
+  FcelibPart *part;
+  int pvertices_len;
+  int internal_pid;
+
+  std::ifstream f("../fce/Snowman_car.fce", std::ios::binary);
+  std::vector<char> buf((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+  FCELIB_MeshInit(&mesh);
+
+  for (;;)
+  {
+    CHECK(buf.size() > 0);
+    CHECK(FCELIB_DecodeFce(&mesh, buf.data(), static_cast<int>(buf.size())));
+
+    // summary validation reports deliberately corrupted counts and lists
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 1);
+    ++mesh.hdr.NumTriangles;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 0);
+    --mesh.hdr.NumTriangles;
+    part = mesh.parts[ mesh.hdr.Parts[0] ];
+    pvertices_len = part->pvertices_len;
+    part->pvertices_len = part->PNumVertices - 1;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 0);
+    part->pvertices_len = pvertices_len;
+    internal_pid = mesh.hdr.Parts[0];
+    mesh.hdr.Parts[0] = mesh.parts_len;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 0);
+    mesh.hdr.Parts[0] = internal_pid;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 1);
+    ++mesh.hdr.NumParts;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 0);
+    --mesh.hdr.NumParts;
+    CHECK(FCELIB_MeshValidateSummary(&mesh) == 1);
+
+    break;
+  }  // for (;;)
+
+  FCELIB_MeshRelease(&mesh);
+
+  if (retv == 0)
+    std::cout << "successful" << std::endl;
+  else
+    std::cout << "failed" << std::endl;
+
+  return retv;
+}
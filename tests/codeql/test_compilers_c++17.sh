@@ -27,3 +27,10 @@ echo g++
 g++ -std=c++17 -DFSTDVERSx="${FSTDVERSx}" $CPPFLAGS $SRC -o .bin/$DEST"_linux_c++"
 echo clang++
 clang++ -std=c++17 -DFSTDVERSx="${FSTDVERSx}" $CPPFLAGS $SRC -o .bin/$DEST"_linux_clang++"
+
+# tests, run from this directory
+for DEST in fcec-SetAllocator fcec-ValidateMeshSummary
+do
+  echo g++ $DEST.cpp
+  g++ -std=c++17 $CPPFLAGS $CPPDEBUGFLAGS ./$DEST.cpp -o .bin/$DEST"_linux_c++" && .bin/$DEST"_linux_c++"
+done
@@ -0,0 +1,516 @@
+# fcecodec Copyright (C) 2021 and later Benjamin Futasz <https://github.com/bfut>
+#
+# You may not redistribute this program without its source code.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+"""
+  test_ops.py - testing mesh operations
+"""
+import copy
+import pathlib
+import sys
+import tracemalloc
+
+import fcecodec as fc
+import numpy as np
+import pytest
+
+sys.path.append(str((pathlib.Path(__file__).parent / "../scripts/").resolve()))
+from bfut_mywrappers import *  # fcecodec/scripts/bfut_mywrappers.py
+
+
+SCRIPT_PATH = pathlib.Path(__file__).parent
+filepath_fce_input = SCRIPT_PATH / "fce/Snowman_car.fce"
+
+
+@pytest.fixture
+def mesh():
+    return LoadFce(fc.Mesh(), filepath_fce_input)
+
+
+def test_copy(mesh):
+    mesh.OpDeletePart(1)
+    mesh_copy = copy.copy(mesh)
+    mesh_deepcopy = copy.deepcopy(mesh)
+    buf = mesh.IoEncode_Fce4(False)
+    mesh.OpDeletePart(0)
+    assert mesh_copy.IoEncode_Fce4(False) == buf
+    assert mesh_deepcopy.IoEncode_Fce4(False) == buf
+    assert mesh_copy.MNumParts == mesh.MNumParts + 1
+
+
+def test_memory_stats(mesh):
+    stats = mesh.MMemoryStats()
+    assert stats["NumTriangles"] == mesh.MNumTriags
+    assert stats["triangles_len"] >= mesh.MNumTriags
+    assert stats["total_bytes"] == stats["parts_bytes"] + stats["triangles_bytes"] + stats["vertices_bytes"] + stats["index_bytes"]
+    assert stats["fragmentation"] == 0.0
+    mesh.OpDeletePart(3)
+    stats = mesh.MMemoryStats()
+    assert stats["NumTriangles"] < stats["triangles_len"]
+    assert 0.0 < stats["fragmentation"] < 1.0
+
+
+def test_allocator():
+    buf = filepath_fce_input.read_bytes()
+    tracemalloc.start()
+    try:
+        base = tracemalloc.get_traced_memory()[0]
+        mesh = fc.Mesh()
+        mesh.IoDecode(buf)
+        total_bytes = mesh.MMemoryStats()["total_bytes"]
+        decoded = tracemalloc.get_traced_memory()[0] - base
+        del mesh
+        released = tracemalloc.get_traced_memory()[0] - base
+    finally:
+        tracemalloc.stop()
+    if decoded < total_bytes:
+        pytest.skip("fcelib allocator is not PyMem_Raw* (built without PYMEM_MALLOC)")
+    assert released < total_bytes
+
+
+def test_snapshot(mesh):
+    mesh.OpDeletePart(1)
+    buf = mesh.IoEncode_Fce4(False)
+    snapshot = mesh.IoEncode_Snapshot()
+    mesh2 = fc.Mesh()
+    mesh2.IoDecode_Snapshot(snapshot)
+    assert mesh2.IoEncode_Fce4(False) == buf
+    assert mesh2.IoEncode_Snapshot() == snapshot
+    with pytest.raises(RuntimeError):
+        mesh2.IoDecode_Snapshot(snapshot[:-1])
+    assert mesh2.MNumParts == 0
+    bad = bytearray(snapshot)
+    bad[0x18:0x1C] = (mesh.MNumTriags + 1).to_bytes(4, "little")  # hdr.NumTriangles
+    with pytest.raises(RuntimeError):
+        mesh2.IoDecode_Snapshot(bytes(bad))
+    assert mesh2.MNumParts == 0
+
+
+def test_encode_obj(mesh, tmp_path):
+    objpath = tmp_path / "Snowman_car.obj"
+    mtlpath = tmp_path / "Snowman_car.mtl"
+    mesh.IoExportObj(str(objpath), str(mtlpath), "car00.tga", 1, 1, 1, 1, 0)
+    obj, mtl = mesh.IoEncode_Obj(str(objpath), str(mtlpath), "car00.tga", 1, 1, 1, 1, 0)
+    assert obj == objpath.read_bytes()
+    assert mtl == mtlpath.read_bytes()
+    obj, mtl = mesh.IoEncode_Obj("Snowman_car.obj", "Snowman_car.mtl", "car00.tga")
+    assert obj.startswith(b"# fcecodec OBJ File: 'Snowman_car.obj'")
+    assert b"mtllib Snowman_car.mtl" in obj
+    assert mtl.count(b"newmtl ") > 0
+
+
+def test_journal(mesh):
+    with pytest.raises(RuntimeError):
+        mesh.Undo()
+    mesh.JournalEnable()
+    states = [mesh.IoEncode_Fce4(False)]
+    mesh.OpDeletePartTriags(3, [0, 1, 2, 3])
+    states.append(mesh.IoEncode_Fce4(False))
+    mesh.PSetName(0, "foo")
+    states.append(mesh.IoEncode_Fce4(False))
+    mesh.OpMergeParts([1, 3])
+    states.append(mesh.IoEncode_Fce4(False))
+    stats = mesh.MJournalStats()
+    assert stats["undo_steps"] == 3 and stats["redo_steps"] == 0
+    assert 0 < stats["bytes"] < len(mesh.IoEncode_Snapshot())
+    for buf in reversed(states[:-1]):
+        assert mesh.Undo()
+        assert mesh.IoEncode_Fce4(False) == buf
+    assert not mesh.Undo()
+    assert mesh.Redo()
+    assert mesh.IoEncode_Fce4(False) == states[1]
+    mesh.OpDeletePart(0)
+    assert not mesh.Redo()
+    assert mesh.MJournalStats()["undo_steps"] == 2
+    mesh.JournalEnable(budget=0)
+    assert mesh.MJournalStats()["undo_steps"] == 0
+    mesh.JournalDisable()
+    assert not mesh.MJournalStats()["enabled"]
+
+
+def test_journal_scoped(mesh):
+    mesh.PSetPos(2, np.array([1.0, 2.0, 3.0], dtype=np.float32))
+    mesh.JournalEnable()
+    snap = mesh.IoEncode_Snapshot()
+    mesh.IoEncode_Fce4(True)  # centers parts
+    assert mesh.IoEncode_Snapshot() != snap
+    assert mesh.Undo()
+    assert mesh.IoEncode_Snapshot() == snap
+    pid_new = mesh.OpCopyPart(3)
+    flags = mesh.PGetTriagsFlags(pid_new)
+    flags[::3] |= 0x20
+    mesh.PSetTriagsFlags(pid_new, flags)
+    mesh.OpSplitPart(pid_new, 0x20, 0x20)
+    mesh.OpDeletePart(0)
+    assert mesh.MJournalStats()["undo_steps"] == 4
+    while mesh.Undo():
+        pass
+    assert mesh.IoEncode_Snapshot() == snap
+    while mesh.Redo():
+        pass
+    assert mesh.MNumParts == 5 + 2 - 1
+
+
+def test_delete_triags(mesh):
+    num_triags = mesh.MNumTriags
+    flags3 = mesh.PGetTriagsFlags(3)
+    with pytest.raises(IndexError):
+        mesh.OpDeleteTriags(np.array([3, 0]), np.array([0, 9999]))
+    assert mesh.MNumTriags == num_triags
+    mesh.OpDeleteTriags(np.array([3, 3, 0, 3]), np.array([0, 5, 1, 0]))
+    assert mesh.MNumTriags == num_triags - 3
+    assert np.array_equal(mesh.PGetTriagsFlags(3), np.delete(flags3, [0, 5]))
+    mesh.OpDeleteTriags({4: [0], 3: [0, 1]})
+    assert mesh.MNumTriags == num_triags - 6
+    assert np.array_equal(mesh.PGetTriagsFlags(3), np.delete(flags3, [0, 1, 2, 5]))
+
+
+def test_delete_unrefd_verts(mesh):
+    mesh2 = copy.deepcopy(mesh)
+    mesh3 = copy.deepcopy(mesh)
+    mesh.OpDeletePartTriags(3, [0, 1, 2, 3])
+    mesh2.OpDeletePartTriags(3, [0, 1, 2, 3])
+    mesh3.OpDeletePartTriags(3, [0, 1, 2, 3])
+    assert mesh3.OpDelUnrefdVerts(compact=True)
+    num_verts = mesh.MNumVerts
+    assert mesh.OpDelUnrefdVerts()
+    assert mesh.MNumVerts < num_verts
+    assert mesh2.OpDelPartUnrefdVerts(3, compact=True)
+    assert mesh2.MNumVerts == mesh.MNumVerts
+    assert mesh2.IoEncode_Fce4(False) == mesh.IoEncode_Fce4(False)
+    assert mesh3.IoEncode_Snapshot() == mesh2.IoEncode_Snapshot()
+    with pytest.raises(IndexError):
+        mesh2.OpDelPartUnrefdVerts(mesh2.MNumParts)
+
+
+def test_merge_parts(mesh):
+    num_triags = mesh.MNumTriags
+    num_verts = mesh.MNumVerts
+    name = mesh.PGetName(1)
+    assert mesh.OpMergeParts([1, 3, 0]) == 0
+    assert mesh.MNumParts == 3
+    assert mesh.PGetName(0) == name
+    assert mesh.MNumTriags == num_triags
+    assert mesh.MNumVerts == num_verts
+    with pytest.raises(RuntimeError):
+        mesh.OpMergeParts([1, 1])
+    with pytest.raises(IndexError):
+        mesh.OpMergeParts([0, 3])
+
+
+def test_reorder_parts(mesh):
+    names = [mesh.PGetName(pid) for pid in range(mesh.MNumParts)]
+    new_order = [4, 0, 3, 1, 2]
+    assert mesh.OpReorderParts(new_order)
+    assert [mesh.PGetName(pid) for pid in range(mesh.MNumParts)] == [names[i] for i in new_order]
+    with pytest.raises(RuntimeError):
+        mesh.OpReorderParts([0, 0, 1, 2, 3])
+    with pytest.raises(RuntimeError):
+        mesh.OpReorderParts([0, 1])
+    assert mesh.OpSortPartsToFce3Order()
+    assert [mesh.PGetName(pid) for pid in range(mesh.MNumParts)] == [":HB", ":HLFW", ":HRFW", ":HLRW", ":HRRW"]
+    mesh.PSetName(1, "left front wheel")
+    mesh.PSetName(4, ":MB")
+    mesh.PSetName(2, ":OL")
+    assert mesh.OpSortPartsToFce4Order()
+    assert [mesh.PGetName(pid) for pid in range(mesh.MNumParts)] == [":HB", ":OL", "left front wheel", ":HLRW", ":MB"]
+
+
+def test_sort_part_triags(mesh):
+    pid = 3
+    flags = mesh.PGetTriagsFlags(pid)
+    vidx = mesh.PGetTriagsVidx(pid).reshape(-1, 3)
+    flags[::3] |= 0x8
+    mesh.PSetTriagsFlags(pid, flags)
+    num_verts = mesh.MNumVerts
+    assert mesh.OpSortPartTriags(pid, "flag_mask", 0x8)
+    order = np.argsort((flags & 0x8) != 0, kind="stable")
+    assert np.array_equal(mesh.PGetTriagsFlags(pid), flags[order])
+    assert np.array_equal(mesh.PGetTriagsVidx(pid).reshape(-1, 3), vidx[order])
+    assert mesh.MNumVerts == num_verts
+    assert mesh.OpSortPartTriags(pid, "texpage")
+    with pytest.raises(RuntimeError):
+        mesh.OpSortPartTriags(pid, "foo")
+
+
+def test_optimize_vertex_cache(mesh):
+    pid = 3
+    flags = mesh.PGetTriagsFlags(pid)
+    flags[::5] |= 0x8
+    mesh.PSetTriagsFlags(pid, flags)
+    vidx = mesh.PGetTriagsVidx(pid).reshape(-1, 3)
+    verts = mesh.MVertsPos.reshape(-1, 3)
+    assert mesh.OpOptimizeVertexCache(pid)
+    assert np.array_equal(mesh.MVertsPos.reshape(-1, 3), verts)
+    assert mesh.OpOptimizeVertexCache(pid, reorder_verts=True)
+    new_flags = mesh.PGetTriagsFlags(pid)
+    new_vidx = mesh.PGetTriagsVidx(pid).reshape(-1, 3)
+    transparent = (flags & 0x8) != 0
+    assert np.array_equal(new_flags & 0x8, flags & 0x8)
+    assert np.array_equal(new_vidx[transparent], vidx[transparent])
+    assert sorted(map(tuple, new_vidx)) == sorted(map(tuple, vidx))
+    assert sorted(map(tuple, mesh.MVertsPos.reshape(-1, 3))) == sorted(map(tuple, verts))
+    with pytest.raises(IndexError):
+        mesh.OpOptimizeVertexCache(mesh.MNumParts)
+
+
+def test_split_part(mesh):
+    pid = 3
+    flags = mesh.PGetTriagsFlags(pid)
+    flags[::3] |= 0x20
+    mesh.PSetTriagsFlags(pid, flags)
+    num_parts = mesh.MNumParts
+    num_triags = mesh.MNumTriags
+    num_verts = mesh.MNumVerts
+    pid_new = mesh.OpSplitPart(pid, 0x20, 0x20)
+    assert pid_new == num_parts
+    assert mesh.MNumParts == num_parts + 1
+    assert mesh.MNumTriags == num_triags
+    assert mesh.PNumTriags(pid_new) == np.count_nonzero(flags & 0x20)
+    assert mesh.PNumTriags(pid) == np.count_nonzero((flags & 0x20) == 0)
+    assert np.all(mesh.PGetTriagsFlags(pid_new) & 0x20)
+    assert mesh.MNumVerts > num_verts
+    assert mesh.PGetName(pid_new) == mesh.PGetName(pid)
+    with pytest.raises(RuntimeError):
+        mesh.OpSplitPart(pid, 0x20, 0, "flag_mask")
+    with pytest.raises(RuntimeError):
+        mesh.OpSplitPart(pid, 0x20, 0, "foo")
+
+
+def test_components(mesh):
+    pid = 3
+    labels = mesh.PGetComponents(pid)
+    assert labels.shape == (mesh.PNumTriags(pid), )
+    num_comps = labels.max() + 1
+    assert labels[0] == 0
+    assert num_comps > 1
+    assert np.array_equal(mesh.PGetComponents(0), np.zeros(mesh.PNumTriags(0), dtype=int))
+    num_parts = mesh.MNumParts
+    num_triags = mesh.MNumTriags
+    num_verts = mesh.MNumVerts
+    counts = np.bincount(labels)
+    assert mesh.OpSplitComponents(pid) == num_comps
+    assert mesh.MNumParts == num_parts + num_comps - 1
+    assert mesh.MNumTriags == num_triags
+    assert mesh.MNumVerts == num_verts
+    assert mesh.PNumTriags(pid) == counts[0]
+    for i in range(1, num_comps):
+        assert mesh.PNumTriags(num_parts + i - 1) == counts[i]
+        assert mesh.PGetName(num_parts + i - 1) == mesh.PGetName(pid)
+        assert np.all(mesh.PGetComponents(num_parts + i - 1) == 0)
+    assert mesh.OpSplitComponents(pid) == 1
+    with pytest.raises(IndexError):
+        mesh.PGetComponents(mesh.MNumParts)
+
+
+def test_part_adjacency(mesh):
+    pid = 3
+    num_triags = mesh.PNumTriags(pid)
+    neighbors = mesh.PGetTriagsNeighbors(pid)
+    assert neighbors.shape == (num_triags * 3, )
+    assert neighbors.min() >= -2 and neighbors.max() < num_triags
+    offsets, triags = mesh.PGetVertTriags(pid)
+    assert offsets.shape == (mesh.PNumVerts(pid) + 1, )
+    assert offsets[0] == 0 and offsets[-1] == num_triags * 3
+    assert np.array_equal(np.sort(triags), np.repeat(np.arange(num_triags), 3))
+    boundary = mesh.PGetBoundaryEdges(pid)
+    assert boundary.size > 0
+    assert np.array_equal(np.flatnonzero(neighbors == -1), boundary)
+    for h in range(num_triags * 3):
+        t = neighbors[h]
+        if t >= 0:
+            assert h // 3 in neighbors[3 * t:3 * t + 3]
+    assert mesh.OpDeletePartTriags(pid, np.arange(num_triags // 2))
+    assert mesh.PGetTriagsNeighbors(pid).shape == (mesh.PNumTriags(pid) * 3, )
+    assert mesh.PGetVertTriags(pid)[1].shape == (mesh.PNumTriags(pid) * 3, )
+    with pytest.raises(IndexError):
+        mesh.PGetBoundaryEdges(mesh.MNumParts)
+
+
+def test_transform(mesh):
+    ref = copy.deepcopy(mesh)
+    mesh.MSetDummyPos(np.array([1, 2, 3], dtype=np.float32))
+    assert mesh.OpTransform(np.diag([2, 2, 2, 1]).astype(np.float32))
+    for pid in range(mesh.MNumParts):
+        assert np.allclose(mesh.PGetPos(pid), 2 * ref.PGetPos(pid))
+    assert np.allclose(mesh.MVertsPos, 2 * ref.MVertsPos)
+    assert np.allclose(mesh.MVertsNorms, ref.MVertsNorms)
+    assert np.allclose(mesh.MGetDummyPos(), [2, 4, 6])
+    mat = np.eye(4, dtype=np.float32)
+    mat[0, 3] = 5
+    assert mesh.OpTransform(mat, pids=[1])
+    assert np.allclose(mesh.PGetPos(1), 2 * ref.PGetPos(1) + [5, 0, 0])
+    assert np.allclose(mesh.PGetPos(0), 2 * ref.PGetPos(0))
+    with pytest.raises(IndexError):
+        mesh.OpTransform(mat, pids=[mesh.MNumParts])
+    with pytest.raises(RuntimeError):
+        mesh.OpTransform(np.eye(3, dtype=np.float32))
+
+
+def test_generate_damage(mesh):
+    pid = 3
+    ref = copy.deepcopy(mesh)
+    center = mesh.PGetPos(pid)
+    assert mesh.OpGenerateDamage([pid], np.array([center], dtype=np.float32), 10.0, 0.05, seed=1)
+    dpos = mesh.MVertsDamgdPos.reshape(-1, 3) - mesh.MVertsPos.reshape(-1, 3)
+    assert np.any(dpos != 0)
+    assert np.allclose(mesh.MVertsPos, ref.MVertsPos)
+    assert np.allclose(mesh.MVertsNorms, ref.MVertsNorms)
+    other = copy.deepcopy(ref)
+    assert other.OpGenerateDamage([pid], np.array([center], dtype=np.float32), 10.0, 0.05, seed=1)
+    assert np.array_equal(other.MVertsDamgdPos, mesh.MVertsDamgdPos)
+    dnorms = mesh.MVertsDamgdNorms
+    dnorms[::3] *= -1
+    mesh.MVertsDamgdNorms = dnorms
+    assert mesh.OpGenerateDamage([pid], np.array([center], dtype=np.float32), 10.0, 0.05, seed=1)
+    assert np.array_equal(mesh.MVertsDamgdNorms, dnorms)  # positions unchanged, normals kept
+    other = copy.deepcopy(ref)
+    assert other.OpGenerateDamage([pid], np.array([center], dtype=np.float32), 10.0, 0.05, seed=1, crease_angle=30.0)
+    assert np.array_equal(other.MVertsDamgdPos, mesh.MVertsDamgdPos)
+    assert mesh.OpGenerateDamage(None, np.zeros((0, 3), dtype=np.float32), 1.0, 0.05)
+    assert np.allclose(mesh.MVertsDamgdPos, mesh.MVertsPos)
+    with pytest.raises(IndexError):
+        mesh.OpGenerateDamage([mesh.MNumParts], np.zeros(3, dtype=np.float32), 1.0, 0.05)
+    with pytest.raises(RuntimeError):
+        mesh.OpGenerateDamage(None, np.zeros(4, dtype=np.float32), 1.0, 0.05)
+    with pytest.raises(RuntimeError):
+        mesh.OpGenerateDamage(None, np.zeros(3, dtype=np.float32), 0.0, 0.05)
+
+
+def test_mirror_part(mesh):
+    pid = 3
+    num_parts = mesh.MNumParts
+    pid_new = mesh.OpMirrorPart(pid, 0, "mirrored")
+    assert pid_new == num_parts
+    assert mesh.PGetName(pid_new) == "mirrored"
+    assert mesh.PNumVerts(pid_new) == mesh.PNumVerts(pid)
+    assert mesh.PNumTriags(pid_new) == mesh.PNumTriags(pid)
+    assert np.allclose(mesh.PGetPos(pid_new), mesh.PGetPos(pid) * [-1, 1, 1])
+    matches = mesh.PFindSymmetry(pid, pid_new, 1e-4)
+    assert matches.shape == (mesh.PNumVerts(pid), )
+    assert np.all(matches >= 0)
+    flags = mesh.PGetTriagsFlags(pid)
+    assert np.array_equal(mesh.PGetTriagsFlags(pid_new), flags)
+    pid_copy = mesh.OpMirrorPart(pid_new)
+    assert mesh.PGetName(pid_copy) == "mirrored"
+    assert np.allclose(mesh.PGetPos(pid_copy), mesh.PGetPos(pid))
+    with pytest.raises(IndexError):
+        mesh.OpMirrorPart(mesh.MNumParts)
+    with pytest.raises(RuntimeError):
+        mesh.OpMirrorPart(pid, 3)
+    with pytest.raises(RuntimeError):
+        mesh.PFindSymmetry(pid, pid, axis=3)
+
+
+def test_compute_normals(mesh):
+    ref = mesh.MVertsNorms.reshape(-1, 3)
+    assert mesh.OpComputeNormals()
+    norms = mesh.MVertsNorms.reshape(-1, 3)
+    assert np.allclose(np.linalg.norm(norms, axis=1), 1, atol=1e-5)
+    assert np.mean(np.sum(norms * ref, axis=1)) > 0.8
+    assert np.allclose(mesh.MVertsDamgdNorms, mesh.MVertsNorms)
+    assert mesh.OpComputeNormals(3, "angle", crease_angle=60, apply_to_damage=False)
+    with pytest.raises(RuntimeError):
+        mesh.OpComputeNormals(mode="foo")
+    with pytest.raises(IndexError):
+        mesh.OpComputeNormals(mesh.MNumParts)
+
+
+def test_compute_normals_nonfinite(mesh):
+    verts = mesh.MVertsPos.reshape(-1, 3)
+    verts[::7, 0] = np.inf
+    verts[3::7, 1] = np.nan
+    mesh.MVertsPos = verts.flatten()
+    assert mesh.OpComputeNormals()
+    assert mesh.OpComputeNormals(mode="angle", crease_angle=60)
+    assert mesh.MVertsNorms.shape == verts.flatten().shape
+
+
+def test_bvh_queries(mesh):
+    pid = 3
+    ppos = mesh.PGetPos(pid)
+    vidx = mesh.PGetTriagsVidx(pid).reshape(-1, 3)
+    verts = mesh.MVertsPos.reshape(-1, 3)
+    centroid = np.mean(verts[vidx[0]], axis=0) + ppos
+    idx, dist = mesh.PClosestPoint(pid, centroid)[0::2]
+    assert idx >= 0
+    assert dist < 1e-4
+    origin = centroid + 10 * (centroid - ppos)
+    idx, t = mesh.PRaycast(pid, origin, ppos - origin)
+    assert idx >= 0 and 0 < t < 1
+    idx, t = mesh.PRaycast(pid, origin, origin - ppos)
+    assert idx == -1
+    points = np.tile(centroid, 4).astype(np.float32)
+    idxs, closest, dists = mesh.PClosestPointBatch(pid, points)
+    assert idxs.shape == (4, ) and closest.shape == (12, ) and np.all(dists < 1e-4)
+    idxs, ts = mesh.PRaycastBatch(pid, points, np.tile([0, 0, 1], 4).astype(np.float32))
+    assert idxs.shape == (4, ) and ts.shape == (4, )
+    # cached BVH follows part edits
+    mesh.PSetPos(pid, ppos + np.array([0, 100, 0], dtype=np.float32))
+    assert mesh.PClosestPoint(pid, centroid)[2] > 50
+    assert mesh.PClosestPoint(pid, centroid + np.array([0, 100, 0], dtype=np.float32))[2] < 1e-3
+    mesh.PSetPos(pid, ppos)
+    mesh.MVertsPos = mesh.MVertsPos + np.float32(5.0)
+    assert mesh.PClosestPoint(pid, centroid + np.float32(5.0))[2] < 1e-3
+    with pytest.raises(IndexError):
+        mesh.PRaycast(mesh.MNumParts, origin, origin)
+    with pytest.raises(RuntimeError):
+        mesh.PClosestPointBatch(pid, np.zeros(4, dtype=np.float32))
+
+
+def test_decimate_part(mesh):
+    pid = 3
+    ref = copy.deepcopy(mesh)
+    num_parts = mesh.MNumParts
+    target = mesh.PNumTriags(pid) // 2
+    pid_new = mesh.OpDecimatePart(pid, target)
+    assert pid_new == num_parts
+    assert mesh.PNumTriags(pid_new) <= target
+    assert mesh.PNumVerts(pid_new) < mesh.PNumVerts(pid)
+    assert mesh.PGetName(pid_new) == mesh.PGetName(pid)
+    assert np.allclose(mesh.PGetPos(pid_new), mesh.PGetPos(pid))
+    assert mesh.PNumTriags(pid) == ref.PNumTriags(pid)
+    assert np.array_equal(mesh.PGetTriagsVidx(pid), ref.PGetTriagsVidx(pid))
+    assert set(np.unique(mesh.PGetTriagsTexpages(pid_new))) <= set(np.unique(mesh.PGetTriagsTexpages(pid)))
+    pid_low = mesh.OpDecimatePart(pid, target // 2, preserve_uv_seams=False)
+    assert mesh.PNumTriags(pid_low) <= target // 2
+    pid_min = mesh.OpDecimatePart(pid, 1, preserve_uv_seams=False)
+    assert 1 <= mesh.PNumTriags(pid_min) < mesh.PNumTriags(pid_low)
+    vidx = np.sort(mesh.PGetTriagsVidx(pid_min).reshape(-1, 3), axis=1)
+    assert len(np.unique(vidx, axis=0)) == len(vidx)
+    num_parts = mesh.MNumParts
+    with pytest.raises(IndexError):
+        mesh.OpDecimatePart(mesh.MNumParts, target)
+    with pytest.raises(RuntimeError):
+        mesh.OpDecimatePart(pid, -1)
+    with pytest.raises(RuntimeError):
+        mesh.OpDecimatePart(pid, 0)
+    assert mesh.MNumParts == num_parts
+
+
+def test_weld_vertices(mesh):
+    vert_idxs = np.arange(6, dtype=np.int32)
+    texcoords = np.zeros(12, dtype=np.float32)
+    pos = np.array([0, 0, 0, 1, 0, 0, 1, 1, 0,
+                    0, 0, 0, 1, 1, 0, 0, 1, 0], dtype=np.float32)
+    norms = np.tile(np.array([0, 0, 1], dtype=np.float32), 6)
+    num_verts = mesh.MNumVerts
+    pid = mesh.IoGeomDataToNewPart(vert_idxs, texcoords, pos, norms)
+    assert mesh.MNumVerts == num_verts + 6
+    assert mesh.OpWeldVertices(pid) == 2
+    assert mesh.MNumVerts == num_verts + 4
+    assert mesh.PNumTriags(pid) == 2
+    assert mesh.OpWeldVertices(pid) == 0